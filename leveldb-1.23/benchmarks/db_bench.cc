@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -33,16 +34,22 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      readrandompinned -- readrandom, reading values through PinnableSlice
 //      readmissing   -- read N missing keys in random order
+//      multireadrandom -- read N times in random order, 100 keys per MultiGet
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      lrulookup     -- N random lookups per thread in an LRU cache holding
+//                       N entries (in --cache_shards shards)
+//      clocklookup   -- lrulookup with the CLOCK cache
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      cachestats  -- Print per-shard block cache statistics
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -100,13 +107,52 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// If true, use the scan-resistant CLOCK cache instead of the LRU cache.
+static bool FLAGS_clock_cache = false;
+
+// Number of shards in the block cache (0 means pick from the number of
+// hardware threads).
+static int FLAGS_cache_shards = 16;
+
+// Compression type of the table blocks (a CompressionType value, i.e.
+// 0=none, 1=snappy, 2=zstd, 3=lz4; -1 means use the default)
+static int FLAGS_compression = -1;
+
+// If non-zero, train a Zstd dictionary of this many bytes for each table.
+static int FLAGS_zstd_dict_bytes = 0;
+
+// If true, split the index and filter of each table into partitions.
+static bool FLAGS_partition_index = false;
+
+// If true, append a hash index of the keys to each data block.
+static bool FLAGS_data_block_hash_index = false;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// Maximum number of table files to memory-map (the Env decides if < 0)
+static int FLAGS_mmap_files = -1;
+
+// If true, compactions bypass the page cache
+static bool FLAGS_direct_io_compaction = false;
+
+// Bytes per second that flushes and compactions may write (no limit if <= 0)
+static int FLAGS_rate_limit = 0;
+
+// Compaction style (0: level, 1: universal, 2: FIFO)
+static int FLAGS_compaction_style = leveldb::kLevelCompaction;
+
+// Seconds after which FIFO compaction drops data (never if 0)
+static int FLAGS_ttl_seconds = 0;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, use a cache-line-blocked bloom filter, as a single full filter
+// per table.
+static bool FLAGS_full_filter = false;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
@@ -370,6 +416,7 @@ class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  RateLimiter* rate_limiter_;
   DB* db_;
   int num_;
   int value_size_;
@@ -379,6 +426,7 @@ class Benchmark {
   int heap_counter_;
   CountComparator count_comparator_;
   int total_thread_count_;
+  Cache* lookup_cache_;  // Cache read by the lookup benchmarks
 
   void PrintHeader() {
     const int kKeySize = 16 + FLAGS_key_prefix;
@@ -460,10 +508,17 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(FLAGS_cache_size < 0 ? nullptr
+               : FLAGS_clock_cache
+                   ? NewClockCache(FLAGS_cache_size, FLAGS_cache_shards)
+                   : NewLRUCache(FLAGS_cache_size, FLAGS_cache_shards)),
+        filter_policy_(FLAGS_bloom_bits < 0 ? nullptr
+                       : FLAGS_full_filter
+                           ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                           : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+        rate_limiter_(FLAGS_rate_limit <= 0
+                          ? nullptr
+                          : NewTokenBucketRateLimiter(FLAGS_rate_limit)),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -471,7 +526,8 @@ class Benchmark {
         reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
         heap_counter_(0),
         count_comparator_(BytewiseComparator()),
-        total_thread_count_(0) {
+        total_thread_count_(0),
+        lookup_cache_(nullptr) {
     std::vector<std::string> files;
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -488,6 +544,7 @@ class Benchmark {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    delete rate_limiter_;
   }
 
   void Run() {
@@ -550,6 +607,11 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("readrandompinned")) {
+        method = &Benchmark::ReadRandomPinned;
+      } else if (name == Slice("multireadrandom")) {
+        entries_per_batch_ = 100;
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -572,6 +634,12 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("lrulookup")) {
+        FillLookupCache(NewLRUCache(2 * num_, FLAGS_cache_shards));
+        method = &Benchmark::CacheLookup;
+      } else if (name == Slice("clocklookup")) {
+        FillLookupCache(NewClockCache(2 * num_, FLAGS_cache_shards));
+        method = &Benchmark::CacheLookup;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -582,6 +650,8 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("cachestats")) {
+        PrintStats("leveldb.block-cache-stats");
       } else {
         if (!name.empty()) {  // No error message for empty name
           std::fprintf(stderr, "unknown benchmark '%s'\n",
@@ -605,6 +675,8 @@ class Benchmark {
       if (method != nullptr) {
         RunBenchmark(num_threads, name, method);
       }
+      delete lookup_cache_;
+      lookup_cache_ = nullptr;
     }
   }
 
@@ -709,6 +781,36 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  static void DeleteNothing(const Slice& key, void* value) {}
+
+  // Make "cache" the lookup_cache_, holding the keys 0..num_-1.  The cache
+  // has room for twice as many, so that no shard evicts any of them.
+  void FillLookupCache(Cache* cache) {
+    lookup_cache_ = cache;
+    KeyBuffer key;
+    for (int i = 0; i < num_; i++) {
+      key.Set(i);
+      cache->Release(cache->Insert(key.slice(), nullptr, 1, &DeleteNothing));
+    }
+  }
+
+  void CacheLookup(ThreadState* thread) {
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      key.Set(thread->rand.Uniform(num_));
+      Cache::Handle* handle = lookup_cache_->Lookup(key.slice());
+      if (handle != nullptr) {
+        found++;
+        lookup_cache_->Release(handle);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -765,10 +867,23 @@ class Benchmark {
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    if (FLAGS_compression >= 0) {
+      options.compression = static_cast<CompressionType>(FLAGS_compression);
+    }
+    options.zstd_max_dict_bytes = FLAGS_zstd_dict_bytes;
+    options.partition_index_and_filters = FLAGS_partition_index;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    options.full_filter = FLAGS_full_filter;
     if (FLAGS_comparisons) {
       options.comparator = &count_comparator_;
     }
     options.max_open_files = FLAGS_open_files;
+    options.max_mmap_files = FLAGS_mmap_files;
+    options.use_direct_io_for_compaction = FLAGS_direct_io_compaction;
+    options.compaction_style =
+        static_cast<CompactionStyle>(FLAGS_compaction_style);
+    options.ttl_seconds = FLAGS_ttl_seconds;
+    options.rate_limiter = rate_limiter_;
     options.filter_policy = filter_policy_;
     options.reuse_logs = FLAGS_reuse_logs;
     Status s = DB::Open(options, FLAGS_db, &db_);
@@ -864,6 +979,52 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void ReadRandomPinned(ThreadState* thread) {
+    ReadOptions options;
+    PinnableSlice value;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Uniform(FLAGS_num);
+      key.Set(k);
+      if (db_->Get(options, key.slice(), &value).ok()) {
+        found++;
+      }
+      value.Reset();
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> keys(entries_per_batch_);
+    std::vector<Slice> key_slices(entries_per_batch_);
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i += entries_per_batch_) {
+      for (int j = 0; j < entries_per_batch_; j++) {
+        key.Set(thread->rand.Uniform(FLAGS_num));
+        keys[j] = key.slice().ToString();
+        key_slices[j] = keys[j];
+      }
+      db_->MultiGet(options, key_slices, &values, &statuses);
+      for (int j = 0; j < entries_per_batch_; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -1063,10 +1224,42 @@ int main(int argc, char** argv) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
+    } else if (sscanf(argv[i], "--cache_shards=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shards = n;
+    } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= leveldb::kLZ4Compression) {
+      FLAGS_compression = n;
+    } else if (sscanf(argv[i], "--zstd_dict_bytes=%d%c", &n, &junk) == 1) {
+      FLAGS_zstd_dict_bytes = n;
+    } else if (sscanf(argv[i], "--partition_index=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_partition_index = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--full_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_filter = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--mmap_files=%d%c", &n, &junk) == 1) {
+      FLAGS_mmap_files = n;
+    } else if (sscanf(argv[i], "--direct_io_compaction=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_direct_io_compaction = n;
+    } else if (sscanf(argv[i], "--rate_limit=%d%c", &n, &junk) == 1) {
+      FLAGS_rate_limit = n;
+    } else if (sscanf(argv[i], "--compaction_style=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= leveldb::kFIFOCompaction) {
+      FLAGS_compaction_style = n;
+    } else if (sscanf(argv[i], "--ttl_seconds=%d%c", &n, &junk) == 1) {
+      FLAGS_ttl_seconds = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
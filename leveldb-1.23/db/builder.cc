@@ -14,31 +14,111 @@
 
 namespace leveldb {
 
+namespace {
+class RateLimitedFile : public WritableFile {
+ public:
+  RateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                  RateLimiter::IOPriority priority, double charge_ratio)
+      : base_(base),
+        limiter_(limiter),
+        priority_(priority),
+        charge_ratio_(charge_ratio) {}
+
+  ~RateLimitedFile() override { delete base_; }
+
+  Status Append(const Slice& data) override {
+    const size_t charge = static_cast<size_t>(data.size() * charge_ratio_);
+    if (charge > 0) {
+      limiter_->Request(charge, priority_);
+    }
+    return base_->Append(data);
+  }
+  Status Close() override { return base_->Close(); }
+  Status Flush() override { return base_->Flush(); }
+  Status Sync() override { return base_->Sync(); }
+
+ private:
+  WritableFile* const base_;
+  RateLimiter* const limiter_;
+  const RateLimiter::IOPriority priority_;
+  const double charge_ratio_;
+};
+}  // namespace
+
+WritableFile* NewRateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                                 RateLimiter::IOPriority priority,
+                                 double charge_ratio) {
+  return new RateLimitedFile(base, limiter, priority, charge_ratio);
+}
+
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->largest_seq = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+    meta->has_range_deletions = range_del_iter->Valid();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || meta->has_range_deletions) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
       return s;
     }
+    if (options.rate_limiter != nullptr) {
+      file = NewRateLimitedFile(file, options.rate_limiter, RateLimiter::kHigh,
+                                1.0);
+    }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    ParsedInternalKey ikey;
     Slice key;
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
       builder->Add(key, iter->value());
+      if (ParseInternalKey(key, &ikey) && ikey.sequence > meta->largest_seq) {
+        meta->largest_seq = ikey.sequence;
+      }
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
 
+    // The bounds of the table cover the ranges of its tombstones.  A range
+    // ends right before the first entry for its (exclusive) end key.
+    const Comparator* icmp = options.comparator;
+    bool has_bounds = !key.empty();
+    for (; meta->has_range_deletions && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      const Slice start = range_del_iter->key();
+      const Slice end = range_del_iter->value();
+      builder->AddRangeDeletion(start, end);
+      if (!ParseInternalKey(start, &ikey)) {
+        continue;
+      }
+      if (ikey.sequence > meta->largest_seq) {
+        meta->largest_seq = ikey.sequence;
+      }
+      const InternalKey limit(end, kMaxSequenceNumber, kValueTypeForSeek);
+      if (!has_bounds || icmp->Compare(start, meta->smallest.Encode()) < 0) {
+        meta->smallest.DecodeFrom(start);
+      }
+      if (!has_bounds ||
+          icmp->Compare(limit.Encode(), meta->largest.Encode()) > 0) {
+        meta->largest = limit;
+      }
+      has_bounds = true;
+    }
+
     // Finish and check for builder errors
     s = builder->Finish();
     if (s.ok()) {
@@ -70,6 +150,9 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   if (!iter->status().ok()) {
     s = iter->status();
   }
+  if (range_del_iter != nullptr && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
+  }
 
   if (s.ok() && meta->file_size > 0) {
     // Keep it
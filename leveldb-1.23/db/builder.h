@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 
 namespace leveldb {
@@ -16,14 +17,28 @@ class Env;
 class Iterator;
 class TableCache;
 class VersionEdit;
-
-// Build a Table file from the contents of *iter.  The generated file
-// will be named according to meta->number.  On success, the rest of
-// *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+class WritableFile;
+
+// Build a Table file from the contents of *iter and the range tombstones
+// of *range_del_iter (see MemTable::NewRangeTombstoneIterator()), which
+// may be null.  The generated file will be named according to
+// meta->number.  On success, the rest of *meta, but for
+// meta->newest_write_time, will be filled with metadata about the
+// generated table.  If no data is present in *iter and *range_del_iter,
+// meta->file_size will be set to zero, and no Table file will be produced.
+//
+// If options.rate_limiter is set, the file is written at
+// RateLimiter::kHigh priority.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta);
+
+// Return a file that charges "charge_ratio" times the size of every append
+// to "limiter" at "priority" before appending to "base".  The result owns
+// "base".
+WritableFile* NewRateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                                 RateLimiter::IOPriority priority,
+                                 double charge_ratio);
 
 }  // namespace leveldb
 
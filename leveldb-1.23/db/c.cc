@@ -33,6 +33,7 @@ using leveldb::Logger;
 using leveldb::NewBloomFilterPolicy;
 using leveldb::NewLRUCache;
 using leveldb::Options;
+using leveldb::PinnableSlice;
 using leveldb::RandomAccessFile;
 using leveldb::Range;
 using leveldb::ReadOptions;
@@ -158,7 +159,7 @@ static bool SaveError(char** errptr, const Status& s) {
   return true;
 }
 
-static char* CopyString(const std::string& str) {
+static char* CopyString(const Slice& str) {
   char* result =
       reinterpret_cast<char*>(std::malloc(sizeof(char) * str.size()));
   std::memcpy(result, str.data(), sizeof(char) * str.size());
@@ -202,7 +203,7 @@ char* leveldb_get(leveldb_t* db, const leveldb_readoptions_t* options,
                   const char* key, size_t keylen, size_t* vallen,
                   char** errptr) {
   char* result = nullptr;
-  std::string tmp;
+  PinnableSlice tmp;
   Status s = db->rep->Get(options->rep, Slice(key, keylen), &tmp);
   if (s.ok()) {
     *vallen = tmp.size();
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
 #include <set>
 #include <string>
 #include <vector>
@@ -19,6 +20,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -29,6 +31,7 @@
 #include "leveldb/table_builder.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/format.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
@@ -42,21 +45,48 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        insert_into(nullptr),
+        leader(nullptr),
+        pending_inserts(0),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+
+  // Set by the group leader when this writer should apply its own batch
+  // to *insert_into and then report back to *leader (concurrent memtable
+  // writes only).
+  MemTable* insert_into;
+  Writer* leader;
+  int pending_inserts;  // Leader only: number of followers still inserting
+
   port::CondVar cv;
 };
 
+// A group of writes that has been appended to the log and waits for its
+// turn to be applied to the memtable.  Only used for pipelined writes.
+struct DBImpl::MemTableWriteGroup {
+  MemTableWriteGroup() : batch(nullptr), last_sequence(0) {}
+
+  WriteBatch* batch;              // Combined updates of all writers
+  SequenceNumber last_sequence;   // Sequence number of the last update
+  std::vector<Writer*> writers;   // writers[0] leads the group
+  WriteBatch scratch;             // Backing store for combined batches
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    SequenceNumber largest_seq;
+    bool has_range_deletions;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
@@ -64,6 +94,11 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        start(nullptr),
+        limit(nullptr),
+        tombstones(nullptr),
+        has_tombstone_lower(false),
+        input(nullptr),
         outfile(nullptr),
         builder(nullptr),
         total_bytes(0) {}
@@ -76,6 +111,27 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Range of user keys [*start,*limit) merged by this state.  A
+  // compaction that is split into subcompactions has one state per
+  // range.  null means unbounded on that side.
+  const Slice* start;
+  const Slice* limit;
+
+  // Range tombstones of all the compaction inputs, shared by the
+  // subcompactions, or null if the inputs hold none.
+  const RangeTombstoneList* tombstones;
+
+  // If has_tombstone_lower, the tombstones before tombstone_lower have
+  // been written to earlier outputs.
+  std::string tombstone_lower;
+  bool has_tombstone_lower;
+
+  // Iterator over the compaction inputs, positioned at *start by
+  // DoSubcompactionWork().
+  Iterator* input;
+  Compaction::Cursor cursor;
+  Status status;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -85,6 +141,52 @@ struct DBImpl::CompactionState {
   uint64_t total_bytes;
 };
 
+// A referenced snapshot of mem_, imm_ and the current version, which
+// readers use without holding mutex_.  The references to the memtables
+// and the version are dropped with mutex_ held, once the last reference
+// to the super version is gone.
+struct DBImpl::SuperVersion {
+  MemTable* mem;
+  MemTable* imm;      // null if there is no immutable memtable
+  Version* current;
+  uint64_t number;    // Increases with every installed super version
+  std::atomic<int> refs;
+};
+
+// Cached reference to a super version for the threads that share the
+// slot.  Holds null, a referenced super version, or InUse() while a
+// reader borrows the reference.  Padded to a cache line so that the slots
+// of different threads do not share one.
+struct DBImpl::SuperVersionSlot {
+  SuperVersionSlot() : sv(nullptr) {}
+
+  static SuperVersion* InUse() { return &in_use; }
+
+  std::atomic<SuperVersion*> sv;
+  char padding[64 - sizeof(std::atomic<SuperVersion*>)];
+
+ private:
+  static SuperVersion in_use;  // Only its address is used
+};
+
+DBImpl::SuperVersion DBImpl::SuperVersionSlot::in_use;
+
+namespace {
+
+const int kNumSuperVersionSlots = 64;
+
+// Slot index of the calling thread.  Threads are spread over the slots
+// in the order they first read from a DB.
+int SuperVersionSlotIndex() {
+  static std::atomic<int> next_index(0);
+  static thread_local int index =
+      next_index.fetch_add(1, std::memory_order_relaxed) %
+      kNumSuperVersionSlots;
+  return index;
+}
+
+}  // namespace
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -102,6 +204,11 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.universal_size_ratio, 0, 10000);
+  ClipToRange(&result.universal_min_merge_width, 2, 64);
+  ClipToRange(&result.universal_max_size_amplification_percent, 0, 1000000);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -123,10 +230,23 @@ static int TableCacheSize(const Options& sanitized_options) {
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
 }
 
+// Returns the options to build a table for "level" with: "options" with
+// the compression type for that level.
+static Options TableOptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  if (!options.compression_per_level.empty()) {
+    const size_t i = std::min(static_cast<size_t>(level),
+                              options.compression_per_level.size() - 1);
+    result.compression = options.compression_per_level[i];
+  }
+  return result;
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
-      internal_filter_policy_(raw_options.filter_policy),
+      internal_filter_policy_(raw_options.filter_policy,
+                              raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
@@ -143,25 +263,63 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      super_version_(nullptr),
+      last_super_version_number_(0),
+      super_version_number_(0),
+      super_version_slots_(new SuperVersionSlot[kNumSuperVersionSlots]),
+      first_recyclable_log_(~static_cast<uint64_t>(0)),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      group_commit_leader_(nullptr),
+      wal_sync_thread_running_(false),
+      log_appending_(false),
+      log_syncing_(false),
+      log_sync_requested_(0),
+      log_synced_(0),
+      log_sync_pending_bytes_(0),
+      unpublished_sequence_(0),
+      log_sync_requested_signal_(&mutex_),
+      log_sync_state_signal_(&mutex_),
+      expiry_thread_running_(false),
+      expiry_signal_(&mutex_),
+      memtable_write_finished_signal_(&mutex_),
+      background_flush_scheduled_(false),
+      flushing_memtable_(false),
+      background_compactions_scheduled_(0),
+      writing_manifest_(false),
+      manifest_write_finished_signal_(&mutex_),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      split_subcompactions_(0),
+      seek_compaction_locks_(0) {}
 
 DBImpl::~DBImpl() {
+  // Values pinned by Get() hold table cache and block cache handles, so
+  // they must be released before the DB is deleted.
+  assert(table_cache_->NumPinnedValues() == 0);
+
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_flush_scheduled_ || background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
+  log_sync_requested_signal_.Signal();
+  while (wal_sync_thread_running_) {
+    log_sync_state_signal_.Wait();
+  }
+  while (expiry_thread_running_) {
+    expiry_signal_.SignalAll();
+    expiry_signal_.Wait();
+  }
+  ReplaceSuperVersion(nullptr);
   mutex_.Unlock();
 
   if (db_lock_ != nullptr) {
     env_->UnlockFile(db_lock_);
   }
 
+  delete[] super_version_slots_;
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
   if (imm_ != nullptr) imm_->Unref();
@@ -247,6 +405,18 @@ void DBImpl::RemoveObsoleteFiles() {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
                   (number == versions_->PrevLogNumber()));
+          if (!keep && number >= first_recyclable_log_) {
+            // Keep the log to be overwritten by a new one, so that the
+            // file system need not allocate space for the new log.
+            if (std::find(log_recycle_files_.begin(), log_recycle_files_.end(),
+                          number) != log_recycle_files_.end()) {
+              keep = true;
+            } else if (log_recycle_files_.size() <
+                       options_.recycle_log_file_num) {
+              log_recycle_files_.push_back(number);
+              keep = true;
+            }
+          }
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -289,6 +459,181 @@ void DBImpl::RemoveObsoleteFiles() {
   mutex_.Lock();
 }
 
+namespace {
+
+// Records of a log file are replayed in chunks of about this many bytes.
+const size_t kRecoveryChunkBytes = 1 << 20;
+
+// At most this many chunks are read ahead of the replay.
+const size_t kMaxReadAheadChunks = 4;
+
+// Reads the records of a log file for DBImpl::RecoverLogFile(), in chunks
+// that are replayed as a whole.  The records may be read by a thread of
+// its own, ahead of their replay (see StartReadAhead()).
+class LogRecordReader {
+ public:
+  LogRecordReader(SequentialFile* file, uint64_t log_number,
+                  const std::string& fname, Logger* info_log,
+                  bool paranoid_checks)
+      : reporter_(fname, info_log, paranoid_checks ? &status_ : nullptr),
+        // We intentionally make log::Reader do checksumming even if
+        // paranoid_checks==false so that corruptions cause entire commits
+        // to be skipped instead of propagating bad information (like
+        // overly large sequence numbers).
+        reader_(file, &reporter_, true /*checksum*/, 0 /*initial_offset*/,
+                log_number),
+        read_ahead_(false),
+        cv_(&mu_),
+        stopped_(false),
+        done_(false) {}
+
+  LogRecordReader(const LogRecordReader&) = delete;
+  LogRecordReader& operator=(const LogRecordReader&) = delete;
+
+  ~LogRecordReader() {
+    if (read_ahead_) {
+      StopReadAhead();
+    }
+  }
+
+  // Read the next records into *chunk.  Returns false once the end of the
+  // log, or an error, has been reached; *chunk may still hold records then.
+  bool ReadChunk(std::vector<std::string>* chunk) {
+    Slice record;
+    std::string scratch;
+    size_t bytes = 0;
+    while (bytes < kRecoveryChunkBytes) {
+      if (!reader_.ReadRecord(&record, &scratch) || !status_.ok()) {
+        return false;
+      }
+      if (record.size() < 12) {
+        reporter_.Corruption(record.size(),
+                             Status::Corruption("log record too small"));
+        if (!status_.ok()) {
+          return false;
+        }
+        continue;
+      }
+      chunk->emplace_back(record.data(), record.size());
+      bytes += record.size();
+    }
+    return true;
+  }
+
+  // Start a thread that reads the chunks that NextChunk() returns.
+  void StartReadAhead(Env* env) {
+    read_ahead_ = true;
+    env->StartThread(&LogRecordReader::ReadAheadThread, this);
+  }
+
+  // Like ReadChunk(), for the chunks read by the read-ahead thread.
+  bool NextChunk(std::vector<std::string>* chunk) {
+    MutexLock l(&mu_);
+    while (chunks_.empty() && !done_) {
+      cv_.Wait();
+    }
+    if (chunks_.empty()) {
+      return false;
+    }
+    chunk->swap(chunks_.front());
+    chunks_.pop_front();
+    cv_.SignalAll();
+    return true;
+  }
+
+  // Stop the read-ahead thread and wait for it to exit.
+  void StopReadAhead() {
+    MutexLock l(&mu_);
+    stopped_ = true;
+    cv_.SignalAll();
+    while (!done_) {
+      cv_.Wait();
+    }
+    read_ahead_ = false;
+  }
+
+  // Error that ended the reading (paranoid checks only).
+  // REQUIRES: the read-ahead thread, if any, has been stopped.
+  Status status() const { return status_; }
+
+  bool recyclable() const { return reader_.recyclable(); }
+
+ private:
+  class Reporter : public log::Reader::Reporter {
+   public:
+    Reporter(const std::string& fname, Logger* info_log, Status* status)
+        : fname_(fname), info_log_(info_log), status_(status) {}
+
+    void Corruption(size_t bytes, const Status& s) override {
+      Log(info_log_, "%s%s: dropping %d bytes; %s",
+          (status_ == nullptr ? "(ignoring error) " : ""), fname_.c_str(),
+          static_cast<int>(bytes), s.ToString().c_str());
+      if (status_ != nullptr && status_->ok()) *status_ = s;
+    }
+
+   private:
+    const std::string fname_;
+    Logger* const info_log_;
+    Status* const status_;  // null if options_.paranoid_checks==false
+  };
+
+  static void ReadAheadThread(void* arg) {
+    LogRecordReader* reader = reinterpret_cast<LogRecordReader*>(arg);
+    bool more = true;
+    while (more) {
+      std::vector<std::string> chunk;
+      more = reader->ReadChunk(&chunk);
+      MutexLock l(&reader->mu_);
+      while (!reader->stopped_ &&
+             reader->chunks_.size() >= kMaxReadAheadChunks) {
+        reader->cv_.Wait();
+      }
+      if (reader->stopped_) {
+        break;
+      }
+      reader->chunks_.push_back(std::move(chunk));
+      reader->cv_.SignalAll();
+    }
+    MutexLock l(&reader->mu_);
+    reader->done_ = true;
+    reader->cv_.SignalAll();
+  }
+
+  Status status_;  // Only accessed by the thread reading the records
+  Reporter reporter_;
+  log::Reader reader_;
+  bool read_ahead_;
+
+  // State shared with the read-ahead thread
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  std::deque<std::vector<std::string>> chunks_ GUARDED_BY(mu_);
+  bool stopped_ GUARDED_BY(mu_);  // The replay does not want more chunks
+  bool done_ GUARDED_BY(mu_);     // The read-ahead thread is done
+};
+
+}  // namespace
+
+// State of the replay of the log files by Recover().
+struct DBImpl::RecoveryState {
+  // With options_.enable_pipelined_recovery, the replay waits for the
+  // flush of older memtables once this many are waiting or being flushed.
+  static const size_t kMaxFlushingMemTables = 2;
+
+  RecoveryState(DBImpl* db, VersionEdit* edit)
+      : db(db), edit(edit), flushing(false), flushed(&db->mutex_) {}
+
+  DBImpl* const db;
+  VersionEdit* const edit;  // Records the level-0 tables written
+
+  // State shared with the thread that writes the full memtables to
+  // level-0 tables (pipelined recovery only), protected by db->mutex_.
+  std::deque<MemTable*> memtables;  // Oldest first
+  bool flushing;                    // Is the flush thread running?
+  Status status;                    // First error of the flush thread
+  port::CondVar flushed;
+};
+
 Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   mutex_.AssertHeld();
 
@@ -360,19 +705,34 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
     return Status::Corruption(buf, TableFileName(dbname_, *(expected.begin())));
   }
 
+  // The previous incarnation may not have written any MANIFEST
+  // records after allocating these log numbers.  So we manually
+  // update the file number allocation counter in VersionSet, before
+  // the replay allocates numbers to the tables it writes.
+  for (size_t i = 0; i < logs.size(); i++) {
+    versions_->MarkFileNumberUsed(logs[i]);
+  }
+
   // Recover in the order in which the logs were generated
   std::sort(logs.begin(), logs.end());
+  RecoveryState recovery(this, edit);
   for (size_t i = 0; i < logs.size(); i++) {
-    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest, edit,
-                       &max_sequence);
+    s = RecoverLogFile(logs[i], (i == logs.size() - 1), save_manifest,
+                       &recovery, &max_sequence);
     if (!s.ok()) {
-      return s;
+      break;
     }
+  }
 
-    // The previous incarnation may not have written any MANIFEST
-    // records after allocating this log number.  So we manually
-    // update the file number allocation counter in VersionSet.
-    versions_->MarkFileNumberUsed(logs[i]);
+  // Wait for the memtables being written to level-0 tables.
+  while (recovery.flushing) {
+    recovery.flushed.Wait();
+  }
+  if (s.ok()) {
+    s = recovery.status;
+  }
+  if (!s.ok()) {
+    return s;
   }
 
   if (versions_->LastSequence() < max_sequence) {
@@ -383,21 +743,8 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
 }
 
 Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
-                              bool* save_manifest, VersionEdit* edit,
+                              bool* save_manifest, RecoveryState* recovery,
                               SequenceNumber* max_sequence) {
-  struct LogReporter : public log::Reader::Reporter {
-    Env* env;
-    Logger* info_log;
-    const char* fname;
-    Status* status;  // null if options_.paranoid_checks==false
-    void Corruption(size_t bytes, const Status& s) override {
-      Log(info_log, "%s%s: dropping %d bytes; %s",
-          (this->status == nullptr ? "(ignoring error) " : ""), fname,
-          static_cast<int>(bytes), s.ToString().c_str());
-      if (this->status != nullptr && this->status->ok()) *this->status = s;
-    }
-  };
-
   mutex_.AssertHeld();
 
   // Open the log file
@@ -410,66 +757,77 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   }
 
   // Create the log reader.
-  LogReporter reporter;
-  reporter.env = env_;
-  reporter.info_log = options_.info_log;
-  reporter.fname = fname.c_str();
-  reporter.status = (options_.paranoid_checks ? &status : nullptr);
-  // We intentionally make log::Reader do checksumming even if
-  // paranoid_checks==false so that corruptions cause entire commits
-  // to be skipped instead of propagating bad information (like overly
-  // large sequence numbers).
-  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
+  LogRecordReader* reader = new LogRecordReader(
+      file, log_number, fname, options_.info_log, options_.paranoid_checks);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long)log_number);
 
-  // Read all the records and add to a memtable
-  std::string scratch;
-  Slice record;
+  // Read all the records and add to a memtable.  With pipelined recovery,
+  // the records are read ahead of their replay, and the full memtables are
+  // written to level-0 tables in the background while the replay goes on.
+  const bool pipelined = options_.enable_pipelined_recovery;
+  if (pipelined) {
+    reader->StartReadAhead(env_);
+  }
+  std::vector<std::string> chunk;
   WriteBatch batch;
   int compactions = 0;
   MemTable* mem = nullptr;
-  while (reader.ReadRecord(&record, &scratch) && status.ok()) {
-    if (record.size() < 12) {
-      reporter.Corruption(record.size(),
-                          Status::Corruption("log record too small"));
-      continue;
-    }
-    WriteBatchInternal::SetContents(&batch, record);
-
-    if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
-      mem->Ref();
-    }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
-    MaybeIgnoreError(&status);
-    if (!status.ok()) {
-      break;
-    }
-    const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
-                                    WriteBatchInternal::Count(&batch) - 1;
-    if (last_seq > *max_sequence) {
-      *max_sequence = last_seq;
-    }
-
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      compactions++;
-      *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
-      mem->Unref();
-      mem = nullptr;
+  mutex_.Unlock();
+  bool more = true;
+  while (more && status.ok()) {
+    chunk.clear();
+    more = pipelined ? reader->NextChunk(&chunk) : reader->ReadChunk(&chunk);
+    for (size_t i = 0; i < chunk.size(); i++) {
+      WriteBatchInternal::SetContents(&batch, chunk[i]);
+
+      if (mem == nullptr) {
+        mem = new MemTable(internal_comparator_);
+        mem->Ref();
+      }
+      status = WriteBatchInternal::InsertInto(&batch, mem);
+      MaybeIgnoreError(&status);
       if (!status.ok()) {
-        // Reflect errors immediately so that conditions like full
-        // file-systems cause the DB::Open() to fail.
         break;
       }
+      const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                      WriteBatchInternal::Count(&batch) - 1;
+      if (last_seq > *max_sequence) {
+        *max_sequence = last_seq;
+      }
+
+      if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+        compactions++;
+        *save_manifest = true;
+        mutex_.Lock();
+        status = FlushRecoveredMemTable(mem, recovery);
+        mutex_.Unlock();
+        mem = nullptr;
+        if (!status.ok()) {
+          // Reflect errors immediately so that conditions like full
+          // file-systems cause the DB::Open() to fail.
+          break;
+        }
+      }
     }
   }
+  mutex_.Lock();
 
+  if (pipelined) {
+    reader->StopReadAhead();
+  }
+  if (status.ok()) {
+    status = reader->status();
+  }
+  const bool recyclable = reader->recyclable();
+  delete reader;
   delete file;
 
-  // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  // See if we should keep reusing the last log file.  A recyclable log may
+  // hold leftover data from an older log past its end, so it is not
+  // appended to.
+  if (status.ok() && options_.reuse_logs && last_log && compactions == 0 &&
+      !recyclable) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
@@ -494,29 +852,82 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      status = FlushRecoveredMemTable(mem, recovery);
+    } else {
+      mem->Unref();
     }
-    mem->Unref();
   }
 
   return status;
 }
 
+Status DBImpl::FlushRecoveredMemTable(MemTable* mem, RecoveryState* recovery) {
+  mutex_.AssertHeld();
+  if (!options_.enable_pipelined_recovery) {
+    uint64_t file_number;
+    Status s = WriteLevel0Table(mem, recovery->edit, nullptr, &file_number);
+    // No background work runs during recovery, so the table is safe
+    // from RemoveObsoleteFiles() until *edit is applied.
+    pending_outputs_.erase(file_number);
+    mem->Unref();
+    return s;
+  }
+
+  while (recovery->memtables.size() >= RecoveryState::kMaxFlushingMemTables) {
+    recovery->flushed.Wait();
+  }
+  if (!recovery->status.ok()) {
+    mem->Unref();
+    return recovery->status;
+  }
+  recovery->memtables.push_back(mem);
+  if (!recovery->flushing) {
+    recovery->flushing = true;
+    env_->StartThread(&DBImpl::BGRecoveryFlush, recovery);
+  }
+  return Status::OK();
+}
+
+void DBImpl::BGRecoveryFlush(void* arg) {
+  RecoveryState* recovery = reinterpret_cast<RecoveryState*>(arg);
+  DBImpl* db = recovery->db;
+  MutexLock l(&db->mutex_);
+  // Memtables are flushed in the order of their logs, so that the numbers
+  // of the level-0 tables do the same.
+  while (!recovery->memtables.empty()) {
+    MemTable* mem = recovery->memtables.front();
+    if (recovery->status.ok()) {
+      uint64_t file_number;
+      recovery->status =
+          db->WriteLevel0Table(mem, recovery->edit, nullptr, &file_number);
+      db->pending_outputs_.erase(file_number);
+    }
+    recovery->memtables.pop_front();
+    mem->Unref();
+    recovery->flushed.SignalAll();
+  }
+  recovery->flushing = false;
+  recovery->flushed.SignalAll();
+}
+
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* file_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  *file_number = meta.number;
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, TableOptionsForLevel(options_, 0),
+                   table_cache_, iter, range_del_iter, &meta);
     mutex_.Lock();
   }
 
@@ -524,7 +935,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  delete range_del_iter;
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -532,11 +943,13 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
+    // Universal compaction sees every level above level-0 as one sorted
+    // run that is older than all level-0 files, so flushes stay in level-0.
+    if (base != nullptr && options_.compaction_style == kLevelCompaction) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+    meta.newest_write_time = env_->NowMicros() / 1000000;
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
@@ -549,12 +962,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
+  assert(!flushing_memtable_);
+  flushing_memtable_ = true;
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t file_number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &file_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -565,14 +981,17 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
+  pending_outputs_.erase(file_number);
+  flushing_memtable_ = false;
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.store(false, std::memory_order_release);
+    InstallSuperVersion();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -659,21 +1078,73 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (writing_manifest_) {
+    manifest_write_finished_signal_.Wait();
+  }
+  writing_manifest_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  writing_manifest_ = false;
+  manifest_write_finished_signal_.SignalAll();
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  return s;
+}
+
+bool DBImpl::HasCompactionToStart() {
+  mutex_.AssertHeld();
+  if (manual_compaction_ != nullptr) {
+    // Automatic compactions wait for the pending manual compaction.
+    return versions_->CanCompactLevel(manual_compaction_->level);
+  }
+  return versions_->NeedsCompaction();
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    if (imm_ != nullptr && !background_flush_scheduled_) {
+      background_flush_scheduled_ = true;
+      env_->ScheduleHighPriority(&DBImpl::BGFlushWork, this);
+    }
+    if (background_compactions_scheduled_ <
+            options_.max_background_compactions &&
+        HasCompactionToStart()) {
+      // Once it has picked its inputs, the new compaction calls us again
+      // so that compactions of other levels can start next to it.
+      background_compactions_scheduled_++;
+      env_->Schedule(&DBImpl::BGWork, this);
+    }
+  }
+}
+
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr && !flushing_memtable_) {
+    CompactMemTable();
   }
+
+  background_flush_scheduled_ = false;
+
+  // The flush may have produced too many level-0 files, or a new
+  // immutable memtable may be waiting.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
 }
 
 void DBImpl::BGWork(void* db) {
@@ -682,7 +1153,7 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
@@ -691,7 +1162,7 @@ void DBImpl::BackgroundCall() {
     BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
   // so reschedule another compaction if needed.
@@ -699,19 +1170,27 @@ void DBImpl::BackgroundCall() {
   background_work_finished_signal_.SignalAll();
 }
 
+// Returns the number of input files of "c" in the levels below c->level().
+static int NumLowerInputFiles(const Compaction* c) {
+  int n = 0;
+  for (int which = 1; which < c->num_input_levels(); which++) {
+    n += c->num_input_files(which);
+  }
+  return n;
+}
+
 void DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
-  }
-
   Compaction* c;
-  bool is_manual = (manual_compaction_ != nullptr);
+  ManualCompaction* m = manual_compaction_;
+  const bool is_manual = (m != nullptr);
   InternalKey manual_end;
   if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
+    if (!versions_->CanCompactLevel(m->level)) {
+      // Another thread is compacting the levels of the manual compaction.
+      return;
+    }
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
     if (c != nullptr) {
@@ -729,23 +1208,38 @@ void DBImpl::BackgroundCompaction() {
   Status status;
   if (c == nullptr) {
     // Nothing to do
+  } else if (c->IsDeletion()) {
+    // Drop expired files without reading them
+    c->AddInputDeletions(c->edit());
+    status = LogAndApply(c->edit());
+    if (!status.ok()) {
+      RecordBackgroundError(status);
+    }
+    VersionSet::LevelSummaryStorage tmp;
+    Log(options_.info_log, "Dropped %d expired files from level-%d: %s: %s\n",
+        c->num_input_files(0) + NumLowerInputFiles(c), c->level(),
+        status.ToString().c_str(), versions_->LevelSummary(&tmp));
+    c->ReleaseInputs();
+    RemoveObsoleteFiles();
   } else if (!is_manual && c->IsTrivialMove()) {
     // Move file to next level
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->output_level(), *f);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
+        static_cast<unsigned long long>(f->number), c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
+    // Let compactions of other levels start while this one runs.
+    MaybeScheduleCompaction();
+
     CompactionState* compact = new CompactionState(c);
     status = DoCompactionWork(compact);
     if (!status.ok()) {
@@ -755,6 +1249,9 @@ void DBImpl::BackgroundCompaction() {
     c->ReleaseInputs();
     RemoveObsoleteFiles();
   }
+  if (c != nullptr) {
+    versions_->ReleaseCompactionLevels(c);
+  }
   delete c;
 
   if (status.ok()) {
@@ -765,8 +1262,9 @@ void DBImpl::BackgroundCompaction() {
     Log(options_.info_log, "Compaction error: %s", status.ToString().c_str());
   }
 
-  if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
+  // The waiting thread cancels its manual compaction (and *m goes away)
+  // if it gives up early.
+  if (is_manual && manual_compaction_ == m) {
     if (!status.ok()) {
       m->done = true;
     }
@@ -797,50 +1295,157 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
   delete compact;
 }
 
+// Fraction of the bytes written by a compaction that is charged to
+// Options::rate_limiter when level-0 holds "level0_files" files.  The less
+// room level-0 has left before writes are slowed down, the faster
+// compactions are let through.
+static double CompactionRateLimiterCharge(int level0_files) {
+  if (level0_files <= config::kL0_CompactionTrigger) {
+    return 1.0;
+  }
+  if (level0_files >= config::kL0_SlowdownWritesTrigger) {
+    return 0.0;
+  }
+  return static_cast<double>(config::kL0_SlowdownWritesTrigger -
+                             level0_files) /
+         (config::kL0_SlowdownWritesTrigger - config::kL0_CompactionTrigger);
+}
+
 Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   assert(compact != nullptr);
   assert(compact->builder == nullptr);
   uint64_t file_number;
+  int level0_files;
   {
     mutex_.Lock();
+    level0_files = versions_->NumLevelFiles(0);
     file_number = versions_->NewFileNumber();
     pending_outputs_.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.largest_seq = 0;
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s = options_.use_direct_io_for_compaction
+                 ? env_->NewDirectWritableFile(fname, &compact->outfile)
+                 : env_->NewWritableFile(fname, &compact->outfile);
+  if (s.ok() && options_.rate_limiter != nullptr) {
+    compact->outfile = NewRateLimitedFile(
+        compact->outfile, options_.rate_limiter, RateLimiter::kLow,
+        CompactionRateLimiterCharge(level0_files));
+  }
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    compact->builder = new TableBuilder(
+        TableOptionsForLevel(options_, compact->compaction->output_level()),
+        compact->outfile);
   }
   return s;
 }
 
+void DBImpl::CollectOutputTombstones(
+    CompactionState* compact, const Slice* upper,
+    std::vector<RangeTombstoneList::Fragment>* fragments) {
+  if (compact->tombstones == nullptr) {
+    return;
+  }
+  const Comparator* ucmp = user_comparator();
+  const SequenceNumber smallest_snapshot = compact->smallest_snapshot;
+  const std::vector<RangeTombstoneList::Fragment>& all =
+      compact->tombstones->fragments();
+  for (size_t i = 0; i < all.size(); i++) {
+    Slice start = all[i].start;
+    Slice end = all[i].end;
+    if (compact->has_tombstone_lower &&
+        ucmp->Compare(start, compact->tombstone_lower) < 0) {
+      start = compact->tombstone_lower;
+    }
+    if (upper != nullptr && ucmp->Compare(*upper, end) < 0) {
+      end = *upper;
+    }
+    if (ucmp->Compare(start, end) >= 0) {
+      continue;
+    }
+
+    RangeTombstoneList::Fragment f;
+    const std::vector<SequenceNumber>& seqs = all[i].seqs;
+    const bool base_level =
+        compact->compaction->IsBaseLevelForRange(start, end);
+    for (size_t j = 0; j < seqs.size(); j++) {
+      if (j > 0 && seqs[j - 1] <= smallest_snapshot) {
+        // Every snapshot sees the newer tombstone, which covers the range.
+        break;
+      }
+      if (seqs[j] <= smallest_snapshot && base_level) {
+        // The entries it deletes are all dropped by this compaction.
+        break;
+      }
+      f.seqs.push_back(seqs[j]);
+    }
+    if (!f.seqs.empty()) {
+      f.start = start.ToString();
+      f.end = end.ToString();
+      fragments->push_back(f);
+    }
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* upper) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
 
-  const uint64_t output_number = compact->current_output()->number;
+  CompactionState::Output* out = compact->current_output();
+  const uint64_t output_number = out->number;
   assert(output_number != 0);
 
+  // Add the range tombstones for the keys covered by this output, and
+  // widen its bounds to the ranges they delete.
+  std::vector<RangeTombstoneList::Fragment> fragments;
+  CollectOutputTombstones(compact, upper, &fragments);
+  bool has_bounds = (compact->builder->NumEntries() > 0);
+  for (size_t i = 0; i < fragments.size(); i++) {
+    const RangeTombstoneList::Fragment& f = fragments[i];
+    for (size_t j = 0; j < f.seqs.size(); j++) {
+      InternalKey start(f.start, f.seqs[j], kTypeRangeDeletion);
+      compact->builder->AddRangeDeletion(start.Encode(), f.end);
+      if (!has_bounds ||
+          internal_comparator_.Compare(start, out->smallest) < 0) {
+        out->smallest = start;
+      }
+      out->largest_seq = std::max(out->largest_seq, f.seqs[j]);
+    }
+    InternalKey limit(f.end, kMaxSequenceNumber, kValueTypeForSeek);
+    if (!has_bounds || internal_comparator_.Compare(limit, out->largest) > 0) {
+      out->largest = limit;
+    }
+    has_bounds = true;
+    out->has_range_deletions = true;
+  }
+  if (upper != nullptr) {
+    compact->tombstone_lower = upper->ToString();
+    compact->has_tombstone_lower = true;
+  }
+
   // Check for iterator errors
   Status s = input->status();
-  const uint64_t current_entries = compact->builder->NumEntries();
+  const uint64_t current_entries =
+      compact->builder->NumEntries() + compact->builder->NumRangeDeletions();
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
   }
   const uint64_t current_bytes = compact->builder->FileSize();
-  compact->current_output()->file_size = current_bytes;
+  out->file_size = current_bytes;
   compact->total_bytes += current_bytes;
   delete compact->builder;
   compact->builder = nullptr;
@@ -875,18 +1480,47 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      NumLowerInputFiles(compact->compaction),
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
-  }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+    FileMetaData meta;
+    meta.number = out.number;
+    meta.file_size = out.file_size;
+    meta.smallest = out.smallest;
+    meta.largest = out.largest;
+    meta.newest_write_time = compact->compaction->NewestWriteTime();
+    meta.largest_seq = out.largest_seq;
+    meta.has_range_deletions = out.has_range_deletions;
+    compact->compaction->edit()->AddFile(level, meta);
+  }
+  return LogAndApply(compact->compaction->edit());
+}
+
+// Arguments for a subcompaction that runs on a thread of its own.
+struct DBImpl::SubcompactionThreadArg {
+  DBImpl* db;
+  CompactionState* compact;
+  int* remaining;  // Protected by db->mutex_
+  port::CondVar* finished;
+};
+
+void DBImpl::BGSubcompaction(void* arg) {
+  SubcompactionThreadArg* thread_arg =
+      reinterpret_cast<SubcompactionThreadArg*>(arg);
+  DBImpl* db = thread_arg->db;
+  db->DoSubcompactionWork(thread_arg->compact, nullptr);
+
+  db->mutex_.Lock();
+  --*thread_arg->remaining;
+  thread_arg->finished->SignalAll();
+  db->mutex_.Unlock();
+  delete thread_arg;
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -895,8 +1529,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      NumLowerInputFiles(compact->compaction),
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
@@ -907,37 +1541,200 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  // Read the range tombstones of the inputs once for all subcompactions,
+  // and skip the input files they delete entirely.
+  RangeTombstoneList* tombstones = nullptr;
+  if (compact->compaction->HasRangeDeletions()) {
+    Compaction* c = compact->compaction;
+    tombstones = new RangeTombstoneList(user_comparator());
+    Status s;
+    mutex_.Unlock();
+    for (int which = 0; s.ok() && which < c->num_input_levels(); which++) {
+      for (int i = 0; s.ok() && i < c->num_input_files(which); i++) {
+        const FileMetaData* f = c->input(which, i);
+        if (f->has_range_deletions) {
+          s = table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                               tombstones);
+        }
+      }
+    }
+    mutex_.Lock();
+    if (!s.ok()) {
+      delete tombstones;
+      RecordBackgroundError(s);
+      return s;
+    }
+    tombstones->Finish();
+    const int skipped =
+        c->SkipCoveredInputs(*tombstones, compact->smallest_snapshot);
+    if (skipped > 0) {
+      Log(options_.info_log, "Skipping %d input files deleted by ranges",
+          skipped);
+    }
+    compact->tombstones = tombstones;
+  }
+
+  // Split the compaction into key ranges that are merged in parallel.
+  // With a single range, *compact does the work itself.
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+  std::vector<Slice> boundary_keys(boundaries.begin(), boundaries.end());
+  std::vector<CompactionState*> subcompactions;
+  if (boundary_keys.empty()) {
+    subcompactions.push_back(compact);
+  } else {
+    for (size_t i = 0; i <= boundary_keys.size(); i++) {
+      CompactionState* sub = new CompactionState(compact->compaction);
+      sub->smallest_snapshot = compact->smallest_snapshot;
+      sub->tombstones = tombstones;
+      sub->start = (i == 0 ? nullptr : &boundary_keys[i - 1]);
+      sub->limit = (i == boundary_keys.size() ? nullptr : &boundary_keys[i]);
+      subcompactions.push_back(sub);
+    }
+    Log(options_.info_log, "Compaction split into %d subcompactions",
+        static_cast<int>(subcompactions.size()));
+    split_subcompactions_ += subcompactions.size();
+  }
+  for (size_t i = 0; i < subcompactions.size(); i++) {
+    subcompactions[i]->input =
+        versions_->MakeInputIterator(compact->compaction);
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  // The first range is merged on this thread, which is also the only one
+  // that flushes the immutable memtable while the compaction runs.
+  int remaining = static_cast<int>(subcompactions.size()) - 1;
+  port::CondVar subcompactions_finished(&mutex_);
+  for (size_t i = 1; i < subcompactions.size(); i++) {
+    SubcompactionThreadArg* arg = new SubcompactionThreadArg;
+    arg->db = this;
+    arg->compact = subcompactions[i];
+    arg->remaining = &remaining;
+    arg->finished = &subcompactions_finished;
+    env_->StartThread(&DBImpl::BGSubcompaction, arg);
+  }
+  DoSubcompactionWork(subcompactions[0], &imm_micros);
+
+  mutex_.Lock();
+  while (remaining > 0) {
+    subcompactions_finished.Wait();
+  }
+
   Status status;
-  ParsedInternalKey ikey;
-  std::string current_user_key;
-  bool has_current_user_key = false;
-  SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-  while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != nullptr) {
-        CompactMemTable();
-        // Wake up MakeRoomForWrite() if necessary.
-        background_work_finished_signal_.SignalAll();
+  if (subcompactions[0] == compact) {
+    status = compact->status;
+  } else {
+    // Gather the output files of all ranges into *compact.  Ranges are
+    // disjoint and ordered, so the outputs remain sorted.
+    for (size_t i = 0; i < subcompactions.size(); i++) {
+      CompactionState* sub = subcompactions[i];
+      if (status.ok()) {
+        status = sub->status;
       }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
-    }
-
-    Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
+      if (sub->builder != nullptr) {
+        // The range stopped early; its last output was never finished.
+        sub->builder->Abandon();
+        delete sub->builder;
+      }
+      delete sub->outfile;
+      compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                              sub->outputs.end());
+      compact->total_bytes += sub->total_bytes;
+      delete sub;
+    }
+  }
+  compact->tombstones = nullptr;
+  delete tombstones;
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < compact->compaction->num_input_levels();
+       which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  stats_[compact->compaction->output_level()].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::DoSubcompactionWork(CompactionState* compact,
+                                 int64_t* imm_micros) {
+  Iterator* input = compact->input;
+  if (compact->start != nullptr) {
+    InternalKey start(*compact->start, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
+  if (compact->start != nullptr) {
+    compact->tombstone_lower = compact->start->ToString();
+    compact->has_tombstone_lower = true;
+  }
+  Status status;
+  ParsedInternalKey ikey;
+  std::string current_user_key;
+  bool has_current_user_key = false;
+  SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  bool finish_output = false;  // Finish the current output before "key"
+  while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
+    // Prioritize immutable compaction work, unless the flush thread is
+    // already on it
+    if (imm_micros != nullptr && has_imm_.load(std::memory_order_relaxed)) {
+      const uint64_t imm_start = env_->NowMicros();
+      mutex_.Lock();
+      if (imm_ != nullptr && !flushing_memtable_) {
+        CompactMemTable();
+        // Wake up MakeRoomForWrite() if necessary.
+        background_work_finished_signal_.SignalAll();
+      }
+      mutex_.Unlock();
+      *imm_micros += (env_->NowMicros() - imm_start);
+    }
+
+    Slice key = input->key();
+    if (compact->limit != nullptr && key.size() >= 8 &&
+        user_comparator()->Compare(ExtractUserKey(key), *compact->limit) >=
+            0) {
+      // Reached the range of the next subcompaction
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
+        compact->builder != nullptr) {
+      finish_output = true;
+    }
+    // An output holds the range tombstones for the keys it covers, so if
+    // there are tombstones, outputs are only split between user keys.
+    if (finish_output &&
+        (compact->tombstones == nullptr ||
+         (key.size() >= 8 &&
+          user_comparator()->Compare(
+              ExtractUserKey(key),
+              compact->current_output()->largest.user_key()) > 0))) {
+      Slice upper;
+      if (key.size() >= 8) {
+        upper = ExtractUserKey(key);
+      }
+      status = FinishCompactionOutputFile(compact, input, &upper);
+      finish_output = false;
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -963,7 +1760,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;  // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -972,6 +1770,12 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (compact->tombstones != nullptr &&
+                 compact->tombstones->MaxCoveringSequence(
+                     ikey.user_key, compact->smallest_snapshot) >
+                     ikey.sequence) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       }
 
       last_sequence_for_key = ikey.sequence;
@@ -982,7 +1786,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -999,14 +1804,15 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
       compact->current_output()->largest.DecodeFrom(key);
       compact->builder->Add(key, input->value());
+      if (has_current_user_key) {
+        SequenceNumber* largest_seq = &compact->current_output()->largest_seq;
+        *largest_seq = std::max(*largest_seq, ikey.sequence);
+      }
 
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
           compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+        finish_output = true;
       }
     }
 
@@ -1016,88 +1822,203 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == nullptr) {
+    // Tombstones may remain even though no entry was left to write.
+    std::vector<RangeTombstoneList::Fragment> fragments;
+    CollectOutputTombstones(compact, compact->limit, &fragments);
+    if (!fragments.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, compact->limit);
   }
   if (status.ok()) {
     status = input->status();
   }
   delete input;
-  input = nullptr;
+  compact->input = nullptr;
+  compact->status = status;
+}
 
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->mem->Ref();
+  sv->imm = imm_;
+  if (sv->imm != nullptr) sv->imm->Ref();
+  sv->current = versions_->current();
+  sv->current->Ref();
+  sv->number = ++last_super_version_number_;
+  sv->refs.store(1, std::memory_order_relaxed);  // Held by super_version_
+  ReplaceSuperVersion(sv);
+}
+
+void DBImpl::ReplaceSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  SuperVersion* old;
+  {
+    MutexLock l(&super_version_mutex_);
+    old = super_version_;
+    super_version_ = sv;
+  }
+  if (sv != nullptr) {
+    super_version_number_.store(sv->number, std::memory_order_release);
+  }
+
+  // Drop the cached references so that readers pick up "sv".  A reader
+  // that borrowed a reference finds its slot emptied when returning it,
+  // and drops the reference itself.
+  for (int i = 0; i < kNumSuperVersionSlots; i++) {
+    SuperVersion* cached =
+        super_version_slots_[i].sv.exchange(nullptr, std::memory_order_acq_rel);
+    if (cached != nullptr && cached != SuperVersionSlot::InUse()) {
+      UnrefSuperVersionLocked(cached);
     }
   }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
+  if (old != nullptr) {
+    UnrefSuperVersionLocked(old);
   }
+}
 
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+DBImpl::SuperVersion* DBImpl::GetSuperVersion(int* slot) {
+  const int index = SuperVersionSlotIndex();
+  std::atomic<SuperVersion*>* cache = &super_version_slots_[index].sv;
+  SuperVersion* sv =
+      cache->exchange(SuperVersionSlot::InUse(), std::memory_order_acquire);
+  if (sv == SuperVersionSlot::InUse()) {
+    // Another thread that shares the slot is reading.
+    *slot = -1;
+    return RefSuperVersion();
+  }
+  if (sv == nullptr ||
+      sv->number != super_version_number_.load(std::memory_order_acquire)) {
+    // A reader returned an outdated reference to a slot that was emptied
+    // while it was borrowed.
+    if (sv != nullptr) UnrefSuperVersion(sv);
+    sv = RefSuperVersion();
+  }
+  *slot = index;
+  return sv;
+}
 
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
+void DBImpl::ReturnSuperVersion(SuperVersion* sv, int slot) {
+  if (slot >= 0) {
+    SuperVersion* expected = SuperVersionSlot::InUse();
+    if (super_version_slots_[slot].sv.compare_exchange_strong(
+            expected, sv, std::memory_order_release,
+            std::memory_order_relaxed)) {
+      return;
+    }
+    // The slot was emptied by ReplaceSuperVersion().
   }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
+  UnrefSuperVersion(sv);
+}
+
+DBImpl::SuperVersion* DBImpl::RefSuperVersion() {
+  MutexLock l(&super_version_mutex_);
+  SuperVersion* sv = super_version_;
+  sv->refs.fetch_add(1, std::memory_order_relaxed);
+  return sv;
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  if (sv->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    // Rare: only the last reader of a replaced super version gets here.
+    MutexLock l(&mutex_);
+    DeleteSuperVersion(sv);
   }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
 }
 
-namespace {
+void DBImpl::UnrefSuperVersionLocked(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  if (sv->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    DeleteSuperVersion(sv);
+  }
+}
 
-struct IterState {
-  port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+void DBImpl::DeleteSuperVersion(SuperVersion* sv) {
+  mutex_.AssertHeld();
+  sv->mem->Unref();
+  if (sv->imm != nullptr) sv->imm->Unref();
+  sv->current->Unref();
+  delete sv;
+}
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
-};
+void DBImpl::CleanupSuperVersion(void* arg1, void* arg2) {
+  DBImpl* db = reinterpret_cast<DBImpl*>(arg1);
+  db->UnrefSuperVersion(reinterpret_cast<SuperVersion*>(arg2));
+}
 
-static void CleanupIteratorState(void* arg1, void* arg2) {
-  IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
-  delete state;
+static void UnrefMemTableTombstones(void* arg1, void* arg2) {
+  MemTable::UnrefRangeTombstones(reinterpret_cast<RangeTombstoneList*>(arg1));
 }
 
-}  // anonymous namespace
+void DBImpl::PickSeekCompaction(Version* v, FileMetaData* f, int level) {
+  Version::GetStats stats;
+  stats.seek_file = f;
+  stats.seek_file_level = level;
+  MutexLock l(&mutex_);
+  seek_compaction_locks_++;
+  if (v->PickSeekCompaction(stats)) {
+    MaybeScheduleCompaction();
+  }
+}
 
-Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
-                                      SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
-  mutex_.Lock();
-  *latest_snapshot = versions_->LastSequence();
+SequenceNumber DBImpl::LastSequence() const {
+  // VersionSet::LastSequence() does not need mutex_.
+  return versions_->LastSequence();
+}
+
+Iterator* DBImpl::NewInternalIterator(
+    const ReadOptions& options, SequenceNumber* latest_snapshot, uint32_t* seed,
+    std::vector<const RangeTombstoneList*>* tombstones) {
+  int slot;
+  SuperVersion* sv = GetSuperVersion(&slot);
+  sv->refs.fetch_add(1, std::memory_order_relaxed);  // Held by the iterator
+  ReturnSuperVersion(sv, slot);
+  // Read after pinning sv, which holds all the writes published so far.
+  *latest_snapshot = LastSequence();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  list.push_back(sv->mem->NewIterator());
+  if (sv->imm != nullptr) {
+    list.push_back(sv->imm->NewIterator());
   }
-  versions_->current()->AddIterators(options, &list);
+  sv->current->AddIterators(options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
-
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
-  internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
-
-  *seed = ++seed_;
-  mutex_.Unlock();
+  internal_iter->RegisterCleanup(&DBImpl::CleanupSuperVersion, this, sv);
+
+  *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+  if (tombstones != nullptr) {
+    // Taken after *latest_snapshot, so that they hold every tombstone it
+    // can see.  The version's list lives as long as sv.
+    tombstones->clear();
+    MemTable* const mems[] = {sv->mem, sv->imm};
+    for (MemTable* mem : mems) {
+      const RangeTombstoneList* list =
+          (mem != nullptr) ? mem->RefRangeTombstones() : nullptr;
+      if (list != nullptr) {
+        internal_iter->RegisterCleanup(&UnrefMemTableTombstones,
+                                       const_cast<RangeTombstoneList*>(list),
+                                       nullptr);
+        tombstones->push_back(list);
+      }
+    }
+    const RangeTombstoneList* list;
+    Status s = sv->current->GetRangeTombstones(&list);
+    if (!s.ok()) {
+      delete internal_iter;
+      internal_iter = NewErrorIterator(s);
+      tombstones->clear();
+    } else if (list != nullptr) {
+      tombstones->push_back(list);
+    }
+  }
   return internal_iter;
 }
 
@@ -1107,6 +2028,16 @@ Iterator* DBImpl::TEST_NewInternalIterator() {
   return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
 }
 
+int64_t DBImpl::TEST_NumSeekCompactionLocks() {
+  MutexLock l(&mutex_);
+  return seek_compaction_locks_;
+}
+
+int64_t DBImpl::TEST_NumSplitSubcompactions() {
+  MutexLock l(&mutex_);
+  return split_subcompactions_;
+}
+
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   MutexLock l(&mutex_);
   return versions_->MaxNextLevelOverlappingBytes();
@@ -1114,56 +2045,127 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  PinnableSlice pinned;
+  Status s = Get(options, key, &pinned);
+  if (s.ok()) {
+    if (pinned.IsPinned()) {
+      value->assign(pinned.data(), pinned.size());
+    } else {
+      value->swap(*pinned.GetSelf());
+    }
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   PinnableSlice* value) {
+  value->Reset();
   Status s;
-  MutexLock l(&mutex_);
+  int slot;
+  SuperVersion* sv = GetSuperVersion(&slot);
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
         static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
   } else {
-    snapshot = versions_->LastSequence();
+    // Read after pinning sv, which holds all the writes published so far.
+    snapshot = LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
+  bool have_stat_update = false;
+  Version::GetStats stats;
+
+  // First look in the memtable, then in the immutable memtable (if any).
+  // Values found in the memtables are copied; memtables may be released
+  // before the caller is done with the value.
+  LookupKey lkey(key, snapshot);
+  if (sv->mem->Get(lkey, value->GetSelf(), &s)) {
+    // Done
+  } else if (sv->imm != nullptr && sv->imm->Get(lkey, value->GetSelf(), &s)) {
+    // Done
+  } else {
+    s = sv->current->Get(options, lkey, value, &stats);
+    have_stat_update = true;
+  }
+  if (s.ok() && !value->IsPinned()) {
+    value->PinSelf();
+  }
+
+  if (have_stat_update && sv->current->UpdateStats(stats)) {
+    PickSeekCompaction(sv->current, stats.seek_file, stats.seek_file_level);
+  }
+  ReturnSuperVersion(sv, slot);
+  return s;
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const int n = keys.size();
+  values->resize(n);
+  statuses->resize(n);
+
+  int slot;
+  SuperVersion* sv = GetSuperVersion(&slot);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    // Read after pinning sv, which holds all the writes published so far.
+    snapshot = LastSequence();
+  }
 
   bool have_stat_update = false;
   Version::GetStats stats;
 
-  // Unlock while reading from files and memtables
-  {
-    mutex_.Unlock();
+  std::vector<LookupKey*> lkeys(n);
+  std::vector<const LookupKey*> file_keys;
+  std::vector<std::string*> file_values;
+  std::vector<Status*> file_statuses;
+  for (int i = 0; i < n; i++) {
+    lkeys[i] = new LookupKey(keys[i], snapshot);
+    std::string* value = &(*values)[i];
+    Status* s = &(*statuses)[i];
+    *s = Status::OK();
     // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    // The remaining keys are looked up in the files together.
+    if (sv->mem->Get(*lkeys[i], value, s)) {
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    } else if (sv->imm != nullptr && sv->imm->Get(*lkeys[i], value, s)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+      file_keys.push_back(lkeys[i]);
+      file_values.push_back(value);
+      file_statuses.push_back(s);
     }
-    mutex_.Lock();
+  }
+  if (!file_keys.empty()) {
+    sv->current->MultiGet(options, file_keys.size(), &file_keys[0],
+                          &file_values[0], &file_statuses[0], &stats);
+    have_stat_update = true;
+  }
+  for (int i = 0; i < n; i++) {
+    delete lkeys[i];
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  if (have_stat_update && sv->current->UpdateStats(stats)) {
+    PickSeekCompaction(sv->current, stats.seek_file, stats.seek_file_level);
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
-  return s;
+  ReturnSuperVersion(sv, slot);
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  std::vector<const RangeTombstoneList*> tombstones;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, &tombstones);
+  if (!options.prefix.empty()) {
+    iter = NewPrefixBoundedIterator(iter, user_comparator(), options.prefix);
+  }
+  return NewDBIterator(this, user_comparator(), iter, tombstones,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
@@ -1172,10 +2174,13 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
 }
 
 void DBImpl::RecordReadSample(Slice key) {
-  MutexLock l(&mutex_);
-  if (versions_->current()->RecordReadSample(key)) {
-    MaybeScheduleCompaction();
+  int slot;
+  SuperVersion* sv = GetSuperVersion(&slot);
+  Version::GetStats stats;
+  if (sv->current->RecordReadSample(key, &stats)) {
+    PickSeekCompaction(sv->current, stats.seek_file, stats.seek_file_level);
   }
+  ReturnSuperVersion(sv, slot);
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -1198,6 +2203,10 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1205,19 +2214,40 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  if (group_commit_leader_ != nullptr && options_.wal_group_commit_bytes > 0) {
+    group_commit_leader_->cv.Signal();
+  }
+  // Once its group has been logged, a follower that waits for the sync of
+  // the log is no longer in writers_.
+  while (!w.done && w.insert_into == nullptr &&
+         (writers_.empty() || &w != writers_.front())) {
     w.cv.Wait();
   }
+  if (w.insert_into != nullptr) {
+    InsertFollowerBatch(&w);
+  }
   if (w.done) {
     return w.status;
   }
 
+  // With the WAL-sync thread, the log is synced after this writer leaves
+  // the front of the queue.
+  const bool sync_in_thread = options.sync && options_.enable_wal_sync_thread;
+  if (updates != nullptr && options.sync && !sync_in_thread &&
+      options_.wal_group_commit_micros > 0) {
+    AwaitGroupCommit(&w);
+  }
+
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
-  uint64_t last_sequence = versions_->LastSequence();
+  uint64_t last_sequence =
+      std::max(versions_->LastSequence(), unpublished_sequence_);
   Writer* last_writer = &w;
+  bool await_sync = false;
+  bool publish_later = false;
+  SequenceNumber publish_after = 0;  // Publish once synced up to here
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
 
@@ -1225,20 +2255,26 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     // during this phase since &w is currently responsible for logging
     // and protects against concurrent loggers and concurrent writes
     // into mem_.
+    const bool insert_concurrently =
+        options_.allow_concurrent_memtable_write && last_writer != &w;
     {
+      const Slice record = WriteBatchInternal::Contents(write_batch);
+      BeginLogAppend();
       mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+      status = log_->AddRecord(record);
       bool sync_error = false;
-      if (status.ok() && options.sync) {
+      if (status.ok() && options.sync && !sync_in_thread) {
         status = logfile_->Sync();
         if (!status.ok()) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !insert_concurrently) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
+      await_sync = status.ok() && sync_in_thread;
+      EndLogAppend(await_sync, last_sequence, record.size());
       if (sync_error) {
         // The state of the log file is indeterminate: the log record we
         // just added may or may not show up when the DB is re-opened.
@@ -1246,33 +2282,266 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
+    if (status.ok() && insert_concurrently) {
+      // Every writer of the group applies its own batch.
+      std::vector<Writer*> group;
+      for (std::deque<Writer*>::iterator iter = writers_.begin();; ++iter) {
+        group.push_back(*iter);
+        if (*iter == last_writer) break;
+      }
+      status = InsertGroupConcurrently(
+          group, mem_, WriteBatchInternal::Sequence(write_batch));
+    }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
-    versions_->SetLastSequence(last_sequence);
+    // Updates synced by the WAL-sync thread, and the updates of the groups
+    // after them, are only published once the log is synced up to them, so
+    // that a failed sync leaves them invisible.
+    if (await_sync || unpublished_sequence_ > versions_->LastSequence()) {
+      unpublished_sequence_ = last_sequence;
+      publish_later = true;
+      publish_after = log_sync_requested_;
+    } else {
+      versions_->SetLastSequence(last_sequence);
+    }
   }
 
+  std::vector<Writer*> followers;
   while (true) {
     Writer* ready = writers_.front();
     writers_.pop_front();
     if (ready != &w) {
+      followers.push_back(ready);
+    }
+    if (ready == last_writer) break;
+  }
+
+  // Notify new head of write queue
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  if (publish_later) {
+    Status synced = AwaitLogSync(publish_after);
+    if (synced.ok() && versions_->LastSequence() < last_sequence) {
+      versions_->SetLastSequence(last_sequence);
+    }
+    if (status.ok()) {
+      status = synced;
+    }
+    // MakeRoomForWrite() waits for the publication.
+    log_sync_state_signal_.SignalAll();
+  }
+  for (size_t i = 0; i < followers.size(); i++) {
+    followers[i]->status = status;
+    followers[i]->done = true;
+    followers[i]->cv.Signal();
+  }
+  return status;
+}
+
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  if (group_commit_leader_ != nullptr && options_.wal_group_commit_bytes > 0) {
+    group_commit_leader_->cv.Signal();
+  }
+  // Once its group has been logged, a follower is no longer in writers_.
+  while (!w.done && w.insert_into == nullptr &&
+         (writers_.empty() || &w != writers_.front())) {
+    w.cv.Wait();
+  }
+  if (w.insert_into != nullptr) {
+    InsertFollowerBatch(&w);
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  const bool sync_in_thread = options.sync && options_.enable_wal_sync_thread;
+  if (updates != nullptr && options.sync && !sync_in_thread &&
+      options_.wal_group_commit_micros > 0) {
+    AwaitGroupCommit(&w);
+  }
+
+  // May temporarily unlock and wait.  Also waits for the memtable stage
+  // to drain before it switches to a new memtable.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  Writer* last_writer = &w;
+  MemTableWriteGroup group;
+  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+    group.batch = BuildBatchGroup(&last_writer, &group.scratch);
+
+    // Sequence numbers are handed out here, ahead of the last published
+    // sequence number whenever earlier groups are still in the memtable
+    // stage.
+    SequenceNumber last_sequence = memtable_write_groups_.empty()
+                                       ? versions_->LastSequence()
+                                       : memtable_write_groups_.back()
+                                             ->last_sequence;
+    WriteBatchInternal::SetSequence(group.batch, last_sequence + 1);
+    group.last_sequence =
+        last_sequence + WriteBatchInternal::Count(group.batch);
+
+    // Add to log.  We can release the lock during this phase since &w is
+    // currently responsible for logging and protects against concurrent
+    // loggers.
+    {
+      const Slice record = WriteBatchInternal::Contents(group.batch);
+      BeginLogAppend();
+      mutex_.Unlock();
+      status = log_->AddRecord(record);
+      bool sync_error = false;
+      if (status.ok() && options.sync && !sync_in_thread) {
+        status = logfile_->Sync();
+        if (!status.ok()) {
+          sync_error = true;
+        }
+      }
+      mutex_.Lock();
+      EndLogAppend(status.ok() && sync_in_thread, group.last_sequence,
+                   record.size());
+      if (sync_error) {
+        // The state of the log file is indeterminate: the log record we
+        // just added may or may not show up when the DB is re-opened.
+        // So we force the DB into a mode where all future writes fail.
+        RecordBackgroundError(status);
+      }
+    }
+  }
+
+  // Hand the log over to the next group.
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (status.ok() && updates != nullptr) {
+      group.writers.push_back(ready);
+    } else if (ready != &w) {
       ready->status = status;
       ready->done = true;
       ready->cv.Signal();
     }
     if (ready == last_writer) break;
   }
-
-  // Notify new head of write queue
   if (!writers_.empty()) {
     writers_.front()->cv.Signal();
   }
+  if (group.writers.empty()) {
+    return status;
+  }
+
+  // Apply to memtable once all earlier groups have been applied.  mem_
+  // cannot change while groups are queued here, see MakeRoomForWrite().
+  memtable_write_groups_.push_back(&group);
+  while (memtable_write_groups_.front() != &group) {
+    w.cv.Wait();
+  }
+  if (options_.allow_concurrent_memtable_write && group.writers.size() > 1) {
+    status = InsertGroupConcurrently(group.writers, mem_,
+                                     WriteBatchInternal::Sequence(group.batch));
+  } else {
+    MemTable* mem = mem_;
+    mutex_.Unlock();
+    status = WriteBatchInternal::InsertInto(group.batch, mem);
+    mutex_.Lock();
+  }
+
+  // Publish the sequence numbers of this group.  Groups leave the memtable
+  // stage in order, so readers never see a later write without the
+  // earlier ones.  Updates synced by the WAL-sync thread are published once
+  // they are durable, so that a failed sync leaves them (and the updates of
+  // the groups after them) invisible.
+  if (status.ok() && sync_in_thread) {
+    status = AwaitLogSync(group.last_sequence);
+  }
+  if (bg_error_.ok()) {
+    versions_->SetLastSequence(group.last_sequence);
+  } else if (status.ok()) {
+    status = bg_error_;
+  }
+  memtable_write_groups_.pop_front();
+  if (!memtable_write_groups_.empty()) {
+    memtable_write_groups_.front()->writers[0]->cv.Signal();
+  }
+  memtable_write_finished_signal_.SignalAll();
 
+  for (size_t i = 1; i < group.writers.size(); i++) {
+    Writer* ready = group.writers[i];
+    ready->status = status;
+    ready->done = true;
+    ready->cv.Signal();
+  }
   return status;
 }
 
+// REQUIRES: group[0] is the calling thread and has a non-null batch
+Status DBImpl::InsertGroupConcurrently(const std::vector<Writer*>& group,
+                                       MemTable* mem, SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  Writer* leader = group[0];
+  assert(leader->batch != nullptr);
+  assert(leader->pending_inserts == 0);
+
+  // Give every batch the sequence numbers it has in the logged group
+  // and wake up the followers to insert their own batches.
+  for (size_t i = 0; i < group.size(); i++) {
+    Writer* writer = group[i];
+    if (writer->batch == nullptr) {
+      continue;
+    }
+    WriteBatchInternal::SetSequence(writer->batch, sequence);
+    sequence += WriteBatchInternal::Count(writer->batch);
+    if (writer != leader) {
+      writer->insert_into = mem;
+      writer->leader = leader;
+      leader->pending_inserts++;
+      writer->cv.Signal();
+    }
+  }
+
+  mutex_.Unlock();
+  Status status =
+      WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+  mutex_.Lock();
+
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  for (size_t i = 1; i < group.size() && status.ok(); i++) {
+    if (group[i]->batch != nullptr) {
+      status = group[i]->status;
+    }
+  }
+  return status;
+}
+
+void DBImpl::InsertFollowerBatch(Writer* w) {
+  mutex_.AssertHeld();
+  MemTable* mem = w->insert_into;
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, mem);
+  mutex_.Lock();
+  w->insert_into = nullptr;
+  w->status = s;
+  if (--w->leader->pending_inserts == 0) {
+    w->leader->cv.Signal();
+  }
+
+  // The leader publishes the sequence numbers of the whole group.
+  while (!w->done) {
+    w->cv.Wait();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer, WriteBatch* scratch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1299,25 +2568,169 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
+    if (w->batch == nullptr) {
+      // Memtable compactions and file ingestions need their own turn at
+      // the front of the queue.
+      break;
+    }
+
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = scratch;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
+    }
+    WriteBatchInternal::Append(result, w->batch);
+    *last_writer = w;
+  }
+  return result;
+}
+
+// REQUIRES: w is at the front of the writer queue
+void DBImpl::AwaitGroupCommit(Writer* w) {
+  mutex_.AssertHeld();
+  const uint64_t deadline =
+      env_->NowMicros() + options_.wal_group_commit_micros;
+  group_commit_leader_ = w;
+  while (true) {
+    if (options_.wal_group_commit_bytes > 0) {
+      // Writers that join the queue wake us up to check their size.
+      size_t bytes = 0;
+      for (std::deque<Writer*>::iterator iter = writers_.begin();
+           iter != writers_.end(); ++iter) {
+        if ((*iter)->batch != nullptr) {
+          bytes += WriteBatchInternal::ByteSize((*iter)->batch);
+        }
+      }
+      if (bytes >= options_.wal_group_commit_bytes) {
         break;
       }
+    }
+    const uint64_t now = env_->NowMicros();
+    if (now >= deadline) {
+      break;
+    }
+    w->cv.TimedWait(deadline - now);
+  }
+  group_commit_leader_ = nullptr;
+}
+
+void DBImpl::BeginLogAppend() {
+  mutex_.AssertHeld();
+  while (log_syncing_) {
+    log_sync_state_signal_.Wait();
+  }
+  log_appending_ = true;
+}
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
+void DBImpl::EndLogAppend(bool sync, SequenceNumber last_sequence,
+                          size_t bytes) {
+  mutex_.AssertHeld();
+  log_appending_ = false;
+  if (sync) {
+    log_sync_requested_ = last_sequence;
+    log_sync_pending_bytes_ += bytes;
+    log_sync_requested_signal_.Signal();
+  }
+  if (log_sync_requested_ > log_synced_) {
+    // The WAL-sync thread may be waiting for the log.
+    log_sync_state_signal_.SignalAll();
+  }
+}
+
+Status DBImpl::AwaitLogSync(SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  while (log_synced_ < sequence) {
+    if (!bg_error_.ok()) {
+      return bg_error_;
+    }
+    log_sync_state_signal_.Wait();
+  }
+  return Status::OK();
+}
+
+void DBImpl::BGLogSync(void* db) {
+  reinterpret_cast<DBImpl*>(db)->LogSyncLoop();
+}
+
+void DBImpl::LogSyncLoop() {
+  MutexLock l(&mutex_);
+  while (true) {
+    // Stop syncing after an error, like the writers do.
+    while ((log_synced_ >= log_sync_requested_ || !bg_error_.ok()) &&
+           !shutting_down_.load(std::memory_order_acquire)) {
+      log_sync_requested_signal_.Wait();
+    }
+    if (log_synced_ >= log_sync_requested_ || !bg_error_.ok()) {
+      break;  // Shutting down
+    }
+
+    // Let more groups append to the log before it is synced.
+    const uint64_t deadline =
+        env_->NowMicros() + options_.wal_group_commit_micros;
+    while (options_.wal_group_commit_bytes == 0 ||
+           log_sync_pending_bytes_ < options_.wal_group_commit_bytes) {
+      const uint64_t now = env_->NowMicros();
+      if (now >= deadline) {
+        break;
       }
-      WriteBatchInternal::Append(result, w->batch);
+      log_sync_requested_signal_.TimedWait(deadline - now);
     }
-    *last_writer = w;
+    while (log_appending_) {
+      log_sync_state_signal_.Wait();
+    }
+
+    // All the updates up to log_sync_requested_ are in the log, which no
+    // writer appends to until the sync is done.
+    const SequenceNumber sequence = log_sync_requested_;
+    WritableFile* const file = logfile_;
+    log_syncing_ = true;
+    log_sync_pending_bytes_ = 0;
+    mutex_.Unlock();
+    Status s = file->Sync();
+    mutex_.Lock();
+    log_syncing_ = false;
+    if (s.ok()) {
+      log_synced_ = sequence;
+    } else {
+      // The state of the log file is indeterminate, see Write().
+      RecordBackgroundError(s);
+    }
+    log_sync_state_signal_.SignalAll();
   }
-  return result;
+  wal_sync_thread_running_ = false;
+  log_sync_state_signal_.SignalAll();
+}
+
+void DBImpl::BGExpiry(void* db) { reinterpret_cast<DBImpl*>(db)->ExpiryLoop(); }
+
+void DBImpl::ExpiryLoop() {
+  MutexLock l(&mutex_);
+  while (!shutting_down_.load(std::memory_order_acquire)) {
+    // Files that have expired already are dropped by the compaction that
+    // this schedules, or by the next one if their levels are busy.
+    MaybeScheduleCompaction();
+
+    // Files added later expire at least ttl_seconds from now.
+    uint64_t wait_micros = options_.ttl_seconds * 1000000;
+    const uint64_t next_expiry_micros = versions_->NextExpiryTime() * 1000000;
+    const uint64_t now_micros = env_->NowMicros();
+    if (next_expiry_micros != 0) {
+      wait_micros = (next_expiry_micros > now_micros)
+                        ? std::min(wait_micros, next_expiry_micros - now_micros)
+                        : 0;
+    }
+    expiry_signal_.TimedWait(wait_micros);
+  }
+  expiry_thread_running_ = false;
+  expiry_signal_.SignalAll();
 }
 
 // REQUIRES: mutex_ is held
@@ -1326,14 +2739,17 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
+  // FIFO compaction keeps every file in level-0 on purpose.
+  const bool limit_level0 = (options_.compaction_style != kFIFOCompaction);
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+    } else if (allow_delay && limit_level0 &&
+               versions_->NumLevelFiles(0) >=
+                   config::kL0_SlowdownWritesTrigger) {
       // We are getting close to hitting a hard limit on the number of
       // L0 files.  Rather than delaying a single write by several
       // seconds when we hit the hard limit, start delaying each
@@ -1353,16 +2769,28 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
       background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    } else if (limit_level0 &&
+               versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       background_work_finished_signal_.Wait();
+    } else if (!memtable_write_groups_.empty()) {
+      // Pipelined writes that have already been logged are still being
+      // applied to the current memtable.
+      memtable_write_finished_signal_.Wait();
+    } else if (log_syncing_ || log_synced_ < log_sync_requested_ ||
+               versions_->LastSequence() < unpublished_sequence_) {
+      // The WAL-sync thread has yet to sync the current log, or writers
+      // have yet to publish the updates it synced.  The memtable must not
+      // hold unpublished updates once it is flushed.
+      log_sync_state_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      log::Writer* new_log = nullptr;
+      s = NewLogFile(new_log_number, &lfile, &new_log);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1372,11 +2800,12 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       delete logfile_;
       logfile_ = lfile;
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
+      log_ = new_log;
       imm_ = mem_;
       has_imm_.store(true, std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1384,6 +2813,260 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+Status DBImpl::NewLogFile(uint64_t log_number, WritableFile** file,
+                          log::Writer** writer) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(dbname_, log_number);
+  Status s;
+  if (!log_recycle_files_.empty()) {
+    const uint64_t old_number = log_recycle_files_.front();
+    log_recycle_files_.pop_front();
+    Log(options_.info_log, "Recycling log #%llu as #%llu\n",
+        static_cast<unsigned long long>(old_number),
+        static_cast<unsigned long long>(log_number));
+    s = env_->ReuseWritableFile(fname, LogFileName(dbname_, old_number), file);
+  } else {
+    s = env_->NewWritableFile(fname, file);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  if (options_.recycle_log_file_num > 0) {
+    // Readers of the log must be able to tell its records from the ones
+    // left over from the previous use of the file.
+    if (log_number < first_recyclable_log_) {
+      first_recyclable_log_ = log_number;
+    }
+    *writer = new log::Writer(*file, 0, log_number);
+  } else {
+    *writer = new log::Writer(*file);
+  }
+  if (options_.preallocate_log_files) {
+    // The log of a memtable is about as large as the memtable.
+    (*file)->Preallocate(options_.write_buffer_size +
+                         options_.write_buffer_size / 8);
+  }
+  return s;
+}
+
+// Returns true iff "mem" holds an entry or a range tombstone for some key
+// in [smallest_user_key,largest_user_key].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest_user_key,
+                             const Slice& largest_user_key) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  bool overlaps = iter->Valid() && ucmp->Compare(ExtractUserKey(iter->key()),
+                                                 largest_user_key) <= 0;
+  delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  for (iter->SeekToFirst(); !overlaps && iter->Valid(); iter->Next()) {
+    overlaps = ucmp->Compare(ExtractUserKey(iter->key()), largest_user_key) <=
+                   0 &&
+               ucmp->Compare(iter->value(), smallest_user_key) > 0;
+  }
+  delete iter;
+  return overlaps;
+}
+
+// Copies the file "src" to "dst", which is synced.
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* src_file;
+  Status s = env->NewSequentialFile(src, &src_file);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* dst_file;
+  s = env->NewWritableFile(dst, &dst_file);
+  if (!s.ok()) {
+    delete src_file;
+    return s;
+  }
+  static const int kBufferSize = 65536;
+  char* space = new char[kBufferSize];
+  while (true) {
+    Slice fragment;
+    s = src_file->Read(kBufferSize, &fragment, space);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = dst_file->Append(fragment);
+    if (!s.ok()) {
+      break;
+    }
+  }
+  delete[] space;
+  delete src_file;
+  if (s.ok()) {
+    s = dst_file->Sync();
+  }
+  if (s.ok()) {
+    s = dst_file->Close();
+  }
+  delete dst_file;
+  if (!s.ok()) {
+    env->RemoveFile(dst);
+  }
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions& options,
+                                  const std::string& fname) {
+  // Find the range of the file.  Its entries all have the same sequence
+  // number, zero unless the file was ingested before.
+  InternalKey smallest, largest;
+  ParsedInternalKey first, last;
+  {
+    uint64_t size;
+    RandomAccessFile* file = nullptr;
+    Table* table = nullptr;
+    Status s = env_->GetFileSize(fname, &size);
+    if (s.ok()) {
+      s = env_->NewRandomAccessFile(fname, &file);
+    }
+    if (s.ok()) {
+      Options table_options = options_;
+      table_options.block_cache = nullptr;
+      s = Table::Open(table_options, file, size, &table);
+    }
+    if (s.ok()) {
+      Iterator* iter = table->NewIterator(ReadOptions());
+      iter->SeekToFirst();
+      if (iter->Valid()) {
+        smallest.DecodeFrom(iter->key());
+        iter->SeekToLast();
+        largest.DecodeFrom(iter->key());
+      }
+      s = iter->status();
+      delete iter;
+    }
+    delete table;
+    delete file;
+    if (!s.ok()) {
+      return s;
+    }
+    if (!ParseInternalKey(smallest.Encode(), &first) ||
+        !ParseInternalKey(largest.Encode(), &last) ||
+        first.sequence != last.sequence) {
+      return Status::InvalidArgument("not a file of SstFileWriter", fname);
+    }
+  }
+  const Slice smallest_user_key = first.user_key;
+  const Slice largest_user_key = last.user_key;
+
+  // Bring a copy of the file into the database directory ahead of time;
+  // it only gets its final name once the file is placed, see below.
+  mutex_.Lock();
+  const uint64_t temp_number = versions_->NewFileNumber();
+  pending_outputs_.insert(temp_number);
+  mutex_.Unlock();
+  std::string staged = fname;
+  Status s;
+  if (!options.move_files) {
+    staged = TempFileName(dbname_, temp_number);
+    s = CopyFile(env_, fname, staged);
+  }
+
+  MutexLock l(&mutex_);
+  Writer w(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+
+  // Flush the memtables that hold entries in the range of the file, which
+  // must end up below it, and let pipelined writes reach the memtable.
+  while (s.ok() && !memtable_write_groups_.empty()) {
+    memtable_write_finished_signal_.Wait();
+  }
+  while (s.ok() && versions_->LastSequence() < unpublished_sequence_) {
+    if (!bg_error_.ok()) {
+      s = bg_error_;
+    } else {
+      log_sync_state_signal_.Wait();
+    }
+  }
+  if (s.ok() &&
+      MemTableOverlaps(mem_, user_comparator(), smallest_user_key,
+                       largest_user_key)) {
+    s = MakeRoomForWrite(true);
+  }
+  while (s.ok() && imm_ != nullptr &&
+         MemTableOverlaps(imm_, user_comparator(), smallest_user_key,
+                          largest_user_key)) {
+    if (!bg_error_.ok()) {
+      s = bg_error_;
+    } else {
+      background_work_finished_signal_.Wait();
+    }
+  }
+
+  // The file is newer than all the files that overlap it, including in
+  // level-0 where the files are ordered by number.
+  FileMetaData meta;
+  meta.number = 0;
+  const SequenceNumber seq = versions_->LastSequence() + 1;
+  if (s.ok()) {
+    meta.number = versions_->NewFileNumber();
+    pending_outputs_.insert(meta.number);
+    mutex_.Unlock();
+    const std::string table_name = TableFileName(dbname_, meta.number);
+    s = env_->RenameFile(staged, table_name);
+    if (s.ok()) {
+      staged = table_name;
+      s = SetTableGlobalSequence(env_, table_name, seq, &meta.file_size);
+    }
+    mutex_.Lock();
+  }
+
+  if (s.ok()) {
+    while (writing_manifest_) {
+      manifest_write_finished_signal_.Wait();
+    }
+    int level = 0;
+    if (options_.compaction_style == kLevelCompaction) {
+      level = versions_->PickLevelForExternalFile(smallest_user_key,
+                                                  largest_user_key);
+    }
+    meta.smallest.SetFrom(
+        ParsedInternalKey(smallest_user_key, seq, first.type));
+    meta.largest.SetFrom(ParsedInternalKey(largest_user_key, seq, last.type));
+    meta.largest_seq = seq;
+    meta.newest_write_time = env_->NowMicros() / 1000000;
+    VersionEdit edit;
+    edit.AddFile(level, meta);
+    edit.SetLastSequence(seq);
+    s = LogAndApply(&edit);
+    if (s.ok()) {
+      versions_->SetLastSequence(seq);
+      Log(options_.info_log, "Ingested #%llu into level-%d: %lld bytes",
+          static_cast<unsigned long long>(meta.number), level,
+          static_cast<long long>(meta.file_size));
+    }
+  }
+  if (!s.ok()) {
+    // Leave the database unchanged.
+    if (options.move_files) {
+      env_->RenameFile(staged, fname);
+    } else {
+      env_->RemoveFile(staged);
+    }
+  }
+  pending_outputs_.erase(temp_number);
+  if (meta.number != 0) {
+    pending_outputs_.erase(meta.number);
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1441,6 +3124,9 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "block-cache-stats") {
+    *value = options_.block_cache->GetStats();
+    return true;
   }
 
   return false;
@@ -1478,6 +3164,45 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::IngestExternalFile(const IngestExternalFileOptions& options,
+                              const std::string& fname) {
+  return Status::NotSupported("IngestExternalFile", fname);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  Status s = Get(options, key, value->GetSelf());
+  if (s.ok()) {
+    value->PinSelf();
+  }
+  return s;
+}
+
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->resize(keys.size());
+  statuses->resize(keys.size());
+  ReadOptions read_options = options;
+  if (options.snapshot == nullptr) {
+    read_options.snapshot = GetSnapshot();
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(read_options, keys[i], &(*values)[i]);
+  }
+  if (options.snapshot == nullptr) {
+    ReleaseSnapshot(read_options.snapshot);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1493,13 +3218,13 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    log::Writer* new_log;
+    s = impl->NewLogFile(new_log_number, &lfile, &new_log);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
+      impl->log_ = new_log;
       impl->mem_ = new MemTable(impl->internal_comparator_);
       impl->mem_->Ref();
     }
@@ -1507,11 +3232,23 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   if (s.ok() && save_manifest) {
     edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
     edit.SetLogNumber(impl->logfile_number_);
-    s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+    s = impl->LogAndApply(&edit);
   }
   if (s.ok()) {
+    impl->InstallSuperVersion();
+    impl->env_->SetBackgroundThreads(
+        impl->options_.max_background_compactions);
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
+    if (impl->options_.enable_wal_sync_thread) {
+      impl->wal_sync_thread_running_ = true;
+      impl->env_->StartThread(&DBImpl::BGLogSync, impl);
+    }
+    if (impl->options_.compaction_style == kFIFOCompaction &&
+        impl->options_.ttl_seconds > 0) {
+      impl->expiry_thread_running_ = true;
+      impl->env_->StartThread(&DBImpl::BGExpiry, impl);
+    }
   }
   impl->mutex_.Unlock();
   if (s.ok()) {
@@ -9,9 +9,11 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
+#include "db/range_tombstone.h"
 #include "db/snapshot.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
@@ -20,6 +22,7 @@
 
 namespace leveldb {
 
+struct FileMetaData;
 class MemTable;
 class TableCache;
 class Version;
@@ -40,8 +43,15 @@ class DBImpl : public DB {
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status IngestExternalFile(const IngestExternalFileOptions& options,
+                            const std::string& fname) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -66,6 +76,14 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Return the number of subcompactions run by compactions that were
+  // split into several key ranges.
+  int64_t TEST_NumSplitSubcompactions();
+
+  // Return the number of times readers took the DB mutex to pick a file
+  // that ran out of allowed seeks for compaction.
+  int64_t TEST_NumSeekCompactionLocks();
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
@@ -74,6 +92,11 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct MemTableWriteGroup;
+  struct RecoveryState;
+  struct SubcompactionThreadArg;
+  struct SuperVersion;
+  struct SuperVersionSlot;
   struct Writer;
 
   // Information for a manual compaction
@@ -101,9 +124,44 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
-  Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+  // If "tombstones" is non-null, also stores in *tombstones the cached
+  // range tombstone lists of the memtables and files that the returned
+  // iterator reads and that hold tombstones.  The lists live as long as
+  // the returned iterator.
+  Iterator* NewInternalIterator(
+      const ReadOptions&, SequenceNumber* latest_snapshot, uint32_t* seed,
+      std::vector<const RangeTombstoneList*>* tombstones = nullptr);
+
+  // Make a new super version of mem_, imm_ and the current version
+  // visible to readers.  Must be called whenever one of them changes.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Replace the installed super version with "sv" (possibly null) and
+  // drop the references to the old one held by the slots.
+  void ReplaceSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return the installed super version for a read.  The caller must pass
+  // it and *slot to ReturnSuperVersion() once done with it.  Usually
+  // takes no lock at all: the reference is borrowed from the slot that
+  // caches it for the calling thread.
+  SuperVersion* GetSuperVersion(int* slot) LOCKS_EXCLUDED(mutex_);
+  void ReturnSuperVersion(SuperVersion* sv, int slot) LOCKS_EXCLUDED(mutex_);
+  // Return a new reference to the installed super version.
+  SuperVersion* RefSuperVersion() LOCKS_EXCLUDED(super_version_mutex_);
+  // Drop a reference to "sv", deleting it if it was the last one.
+  void UnrefSuperVersion(SuperVersion* sv) LOCKS_EXCLUDED(mutex_);
+  void UnrefSuperVersionLocked(SuperVersion* sv)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void DeleteSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Iterator cleanup function that unreferences the super version "sv".
+  static void CleanupSuperVersion(void* db, void* sv);
+
+  // Called by readers whose seek used up the allowed seeks of file "f" at
+  // "level" of version "v": picks the file for a seek compaction.
+  void PickSeekCompaction(Version* v, FileMetaData* f, int level)
+      LOCKS_EXCLUDED(mutex_);
+
+  // Return the last sequence number published to readers.
+  SequenceNumber LastSequence() const NO_THREAD_SAFETY_ANALYSIS;
 
   Status NewDB();
 
@@ -121,23 +179,84 @@ class DBImpl : public DB {
   // Compact the in-memory write buffer to disk.  Switches to a new
   // log-file/memtable and writes a new descriptor iff successful.
   // Errors are recorded in bg_error_.
+  // REQUIRES: no other thread is running CompactMemTable()
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
-                        VersionEdit* edit, SequenceNumber* max_sequence)
+                        RecoveryState* recovery, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Write *mem, filled by the replay of the logs, to a level-0 table and
+  // unref it.  With options_.enable_pipelined_recovery, *mem is handed to
+  // a thread of its own instead, and the error of an earlier flush, if
+  // any, is returned.
+  Status FlushRecoveredMemTable(MemTable* mem, RecoveryState* recovery)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGRecoveryFlush(void* arg);
+
+  // Write the contents of *mem to a new table and record it in *edit.  The
+  // table is left in pending_outputs_ under the number stored in
+  // *file_number; the caller must remove it from there once *edit has been
+  // applied.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* file_number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+
+  // Create the log file numbered "log_number", reusing one of
+  // log_recycle_files_ if there is any, and a writer for it.
+  Status NewLogFile(uint64_t log_number, WritableFile** file,
+                    log::Writer** writer) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Write() for options_.enable_pipelined_write.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+
+  // Apply the batches of a logged write group to *mem, starting at
+  // "sequence", with every writer inserting its own batch in parallel.
+  // group[0] must be the calling thread.  Waits for all followers.
+  Status InsertGroupConcurrently(const std::vector<Writer*>& group,
+                                 MemTable* mem, SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Follower side of InsertGroupConcurrently(): insert w->batch and wait
+  // until the leader marks *w done.
+  void InsertFollowerBatch(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* scratch)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Wait up to options_.wal_group_commit_micros for more writers to join
+  // *w, the leader of a group of sync writes.
+  void AwaitGroupCommit(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Reserve the log for the calling writer, which appends to it without
+  // holding mutex_, once the WAL-sync thread is not syncing it.
+  void BeginLogAppend() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // End BeginLogAppend() after "bytes" bytes of updates up to
+  // "last_sequence" were appended.  If "sync", ask the WAL-sync thread to
+  // sync the log.
+  void EndLogAppend(bool sync, SequenceNumber last_sequence, size_t bytes)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Wait until the WAL-sync thread synced the updates up to "sequence".
+  Status AwaitLogSync(SequenceNumber sequence)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGLogSync(void* db);
+  void LogSyncLoop();
+
+  // Body of the thread that drops the files of a kFIFOCompaction DB as
+  // they expire, even if no flush triggers a compaction check.
+  static void BGExpiry(void* db);
+  void ExpiryLoop();
 
   void RecordBackgroundError(const Status& s);
 
+  // Apply *edit to the current version, waiting for any other thread that
+  // is in the middle of writing the descriptor.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns true iff a background compaction could pick work right now.
+  bool HasCompactionToStart() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlushWork(void* db);
+  void BackgroundFlushCall();
   static void BGWork(void* db);
   void BackgroundCall();
   void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -145,9 +264,24 @@ class DBImpl : public DB {
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the inputs of compact->compaction that fall in the range of
+  // *compact and record the result in compact->status.  If imm_micros is
+  // non-null, also flushes the immutable memtable when one is waiting and
+  // adds the time spent doing so to *imm_micros.
+  void DoSubcompactionWork(CompactionState* compact, int64_t* imm_micros)
+      LOCKS_EXCLUDED(mutex_);
+  static void BGSubcompaction(void* arg);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Finish the current output of *compact, which covers the user keys
+  // before *upper (null: the end of the compaction range).
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* upper);
+  // Store in *fragments the range tombstones of *compact that the
+  // compaction has to write for the user keys before *upper.
+  void CollectOutputTombstones(
+      CompactionState* compact, const Slice* upper,
+      std::vector<RangeTombstoneList::Fragment>* fragments);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -180,20 +314,75 @@ class DBImpl : public DB {
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
-  uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
+  std::atomic<uint32_t> seed_;  // For sampling.
+
+  // Readers use the installed super version (see InstallSuperVersion())
+  // instead of mem_, imm_ and the current version, without taking mutex_.
+  // Each thread caches a reference to it in one of super_version_slots_.
+  port::Mutex super_version_mutex_ ACQUIRED_AFTER(mutex_);
+  SuperVersion* super_version_ GUARDED_BY(super_version_mutex_);
+  uint64_t last_super_version_number_ GUARDED_BY(mutex_);
+  std::atomic<uint64_t> super_version_number_;  // Of super_version_
+  SuperVersionSlot* const super_version_slots_;
+
+  // Obsolete log files kept to be reused by NewLogFile(), oldest first
+  // (options_.recycle_log_file_num).  Only the logs numbered at least
+  // first_recyclable_log_ are written in the recyclable format, and can be
+  // reused.
+  std::deque<uint64_t> log_recycle_files_ GUARDED_BY(mutex_);
+  uint64_t first_recyclable_log_ GUARDED_BY(mutex_);
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Leader of a group of sync writes that waits for more writers to join
+  // it, or nullptr (see AwaitGroupCommit()).
+  Writer* group_commit_leader_ GUARDED_BY(mutex_);
+
+  // State shared with the WAL-sync thread (options_.enable_wal_sync_thread).
+  // The thread does not sync the log while a writer appends to it, and
+  // writers do not append to it while the thread syncs it.
+  bool wal_sync_thread_running_ GUARDED_BY(mutex_);
+  bool log_appending_ GUARDED_BY(mutex_);
+  bool log_syncing_ GUARDED_BY(mutex_);
+  SequenceNumber log_sync_requested_ GUARDED_BY(mutex_);  // Sync up to here
+  SequenceNumber log_synced_ GUARDED_BY(mutex_);          // Synced up to here
+  size_t log_sync_pending_bytes_ GUARDED_BY(mutex_);  // Appended since sync
+  // Last sequence number handed out to a group that waits for the WAL-sync
+  // thread before it publishes its updates (see Write()).  Groups hand out
+  // sequence numbers after it even if it is not published yet.
+  SequenceNumber unpublished_sequence_ GUARDED_BY(mutex_);
+  port::CondVar log_sync_requested_signal_ GUARDED_BY(mutex_);
+  port::CondVar log_sync_state_signal_ GUARDED_BY(mutex_);
+
+  // State of the expiry thread (see ExpiryLoop()).
+  bool expiry_thread_running_ GUARDED_BY(mutex_);
+  port::CondVar expiry_signal_ GUARDED_BY(mutex_);
+
+  // Queue of logged write groups waiting to be applied to the memtable
+  // (pipelined writes only).
+  std::deque<MemTableWriteGroup*> memtable_write_groups_ GUARDED_BY(mutex_);
+  port::CondVar memtable_write_finished_signal_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Has a background memtable flush been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Is some thread running CompactMemTable()?
+  bool flushing_memtable_ GUARDED_BY(mutex_);
+
+  // Number of background compactions scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Is some thread writing to the descriptor in LogAndApply()?
+  bool writing_manifest_ GUARDED_BY(mutex_);
+  port::CondVar manifest_write_finished_signal_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -203,6 +392,13 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Number of subcompactions run by compactions that were split into
+  // several key ranges.
+  int64_t split_subcompactions_ GUARDED_BY(mutex_);
+
+  // Number of times readers took mutex_ in PickSeekCompaction().
+  int64_t seek_compaction_locks_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
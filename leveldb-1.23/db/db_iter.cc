@@ -7,6 +7,7 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -45,11 +46,13 @@ class DBIter : public Iterator {
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter,
+         const std::vector<const RangeTombstoneList*>& tombstones,
+         SequenceNumber s, uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
+        tombstones_(tombstones),
         sequence_(s),
         direction_(kForward),
         valid_(false),
@@ -88,6 +91,21 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns true iff "ikey" is a value deleted by a range tombstone that
+  // is visible at sequence_.
+  bool IsCovered(const ParsedInternalKey& ikey) const {
+    if (ikey.type != kTypeValue) {
+      return false;
+    }
+    for (size_t i = 0; i < tombstones_.size(); i++) {
+      if (tombstones_[i]->MaxCoveringSequence(ikey.user_key, sequence_) >
+          ikey.sequence) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -109,6 +127,7 @@ class DBIter : public Iterator {
   DBImpl* db_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
+  const std::vector<const RangeTombstoneList*> tombstones_;
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
@@ -181,8 +200,13 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (IsCovered(ikey)) {
+        // The range tombstone hides the older entries for this key too.
+        ikey.type = kTypeDeletion;
+      }
       switch (ikey.type) {
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
@@ -246,7 +270,7 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        value_type = IsCovered(ikey) ? kTypeDeletion : ikey.type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
@@ -307,12 +331,88 @@ void DBIter::SeekToLast() {
   FindPrevUserEntry();
 }
 
+// Bounds an internal iterator to the entries whose user key starts with
+// prefix_.  Valid() is false once the wrapped iterator leaves the prefix.
+class PrefixBoundedIterator : public Iterator {
+ public:
+  PrefixBoundedIterator(Iterator* iter, const Comparator* cmp,
+                        const Slice& prefix)
+      : iter_(iter), user_comparator_(cmp), prefix_(prefix.ToString()) {}
+
+  PrefixBoundedIterator(const PrefixBoundedIterator&) = delete;
+  PrefixBoundedIterator& operator=(const PrefixBoundedIterator&) = delete;
+
+  ~PrefixBoundedIterator() override { delete iter_; }
+
+  bool Valid() const override {
+    return iter_->Valid() && ExtractUserKey(iter_->key()).starts_with(prefix_);
+  }
+  Slice key() const override { return iter_->key(); }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+
+  void Seek(const Slice& target) override {
+    if (user_comparator_->Compare(ExtractUserKey(target), prefix_) < 0) {
+      SeekToFirst();
+    } else {
+      iter_->Seek(target);
+    }
+  }
+
+  void SeekToFirst() override { SeekToUserKey(prefix_); }
+
+  void SeekToLast() override {
+    // Find the first key past the prefix: the prefix with its last byte
+    // that is not 0xff incremented, and the bytes after it dropped.
+    std::string limit = prefix_;
+    while (!limit.empty() && static_cast<uint8_t>(limit.back()) == 0xff) {
+      limit.pop_back();
+    }
+    if (limit.empty()) {
+      iter_->SeekToLast();
+      return;
+    }
+    limit.back() = static_cast<char>(static_cast<uint8_t>(limit.back()) + 1);
+    SeekToUserKey(limit);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  }
+
+ private:
+  // Positions iter_ at the first entry with a user key >= "user_key".
+  void SeekToUserKey(const Slice& user_key) {
+    std::string ikey;
+    AppendInternalKey(
+        &ikey, ParsedInternalKey(user_key, kMaxSequenceNumber,
+                                 kValueTypeForSeek));
+    iter_->Seek(ikey);
+  }
+
+  Iterator* const iter_;
+  const Comparator* const user_comparator_;
+  const std::string prefix_;
+};
+
 }  // anonymous namespace
 
-Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+Iterator* NewDBIterator(
+    DBImpl* db, const Comparator* user_key_comparator, Iterator* internal_iter,
+    const std::vector<const RangeTombstoneList*>& tombstones,
+    SequenceNumber sequence, uint32_t seed) {
+  return new DBIter(db, user_key_comparator, internal_iter, tombstones,
+                    sequence, seed);
+}
+
+Iterator* NewPrefixBoundedIterator(Iterator* internal_iter,
+                                   const Comparator* user_key_comparator,
+                                   const Slice& prefix) {
+  return new PrefixBoundedIterator(internal_iter, user_key_comparator, prefix);
 }
 
 }  // namespace leveldb
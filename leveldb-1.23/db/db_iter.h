@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_DB_ITER_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/db.h"
@@ -13,13 +14,26 @@
 namespace leveldb {
 
 class DBImpl;
+class RangeTombstoneList;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
-Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+// into appropriate user keys.  The entries deleted by the range tombstones
+// of the lists in "tombstones" are skipped.  Finish() must have been called
+// on the lists, which must outlive the returned iterator.
+Iterator* NewDBIterator(
+    DBImpl* db, const Comparator* user_key_comparator, Iterator* internal_iter,
+    const std::vector<const RangeTombstoneList*>& tombstones,
+    SequenceNumber sequence, uint32_t seed);
+
+// Return a new iterator over the entries of "*internal_iter" whose user
+// key starts with "prefix", which it positions as if there were no other
+// entries.  Assumes that the user comparator keeps the keys sharing a
+// prefix together, placing the prefixes in bytewise order.  Takes
+// ownership of "internal_iter".
+Iterator* NewPrefixBoundedIterator(Iterator* internal_iter,
+                                   const Comparator* user_key_comparator,
+                                   const Slice& prefix);
 
 }  // namespace leveldb
 
@@ -6,6 +6,7 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <map>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -17,6 +18,9 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -122,6 +126,21 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Number of sstable/log Sync() calls.
+  AtomicCounter data_sync_counter_;
+
+  // Number of files opened through NewRandomAccessFileWithMmap(), and how
+  // many of those were memory-mapped.
+  AtomicCounter mmap_choice_counter_;
+  AtomicCounter mmap_file_counter_;
+
+  // Number of files opened for direct I/O.
+  AtomicCounter direct_read_file_counter_;
+  AtomicCounter direct_write_file_counter_;
+
+  // Added to the time returned by NowMicros().
+  std::atomic<uint64_t> clock_offset_micros_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -130,7 +149,12 @@ class SpecialEnv : public EnvWrapper {
         non_writable_(false),
         manifest_sync_error_(false),
         manifest_write_error_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        clock_offset_micros_(0) {}
+
+  uint64_t NowMicros() override {
+    return target()->NowMicros() + clock_offset_micros_.load();
+  }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -152,6 +176,7 @@ class SpecialEnv : public EnvWrapper {
       Status Close() { return base_->Close(); }
       Status Flush() { return base_->Flush(); }
       Status Sync() {
+        env_->data_sync_counter_.Increment();
         if (env_->data_sync_error_.load(std::memory_order_acquire)) {
           return Status::IOError("simulated data sync error");
         }
@@ -226,6 +251,26 @@ class SpecialEnv : public EnvWrapper {
     }
     return s;
   }
+
+  Status NewRandomAccessFileWithMmap(const std::string& f, bool use_mmap,
+                                     RandomAccessFile** r) {
+    mmap_choice_counter_.Increment();
+    if (use_mmap) {
+      mmap_file_counter_.Increment();
+    }
+    return target()->NewRandomAccessFileWithMmap(f, use_mmap, r);
+  }
+
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) {
+    direct_read_file_counter_.Increment();
+    return target()->NewDirectRandomAccessFile(f, r);
+  }
+
+  Status NewDirectWritableFile(const std::string& f, WritableFile** r) {
+    direct_write_file_counter_.Increment();
+    return target()->NewDirectWritableFile(f, r);
+  }
 };
 
 class DBTest : public testing::Test {
@@ -277,6 +322,30 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kSubcompactions:
+        options.max_subcompactions = 4;
+        break;
+      case kBackgroundCompactions:
+        options.max_background_compactions = 4;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kPartitionedIndexAndFilters:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 256;
+        break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kWalSyncThread:
+        options.enable_wal_sync_thread = true;
+        options.wal_group_commit_micros = 100;
+        break;
       default:
         break;
     }
@@ -335,6 +404,27 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // MultiGet() "keys" and format each result like Get() does.
+  std::vector<std::string> MultiGet(const std::vector<std::string>& keys,
+                                    const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    EXPECT_EQ(keys.size(), values.size());
+    EXPECT_EQ(keys.size(), statuses.size());
+    for (size_t i = 0; i < statuses.size(); i++) {
+      if (statuses[i].IsNotFound()) {
+        values[i] = "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        values[i] = statuses[i].ToString();
+      }
+    }
+    return values;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -442,6 +532,20 @@ class DBTest : public testing::Test {
     return static_cast<int>(files.size());
   }
 
+  int CountLogFiles() {
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    int count = 0;
+    uint64_t number;
+    FileType type;
+    for (const std::string& file : files) {
+      if (ParseFileName(file, &number, &type) && type == kLogFile) {
+        count++;
+      }
+    }
+    return count;
+  }
+
   uint64_t Size(const Slice& start, const Slice& limit) {
     Range r(start, limit);
     uint64_t size;
@@ -533,7 +637,20 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kSubcompactions,
+    kBackgroundCompactions,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kPartitionedIndexAndFilters,
+    kDataBlockHashIndex,
+    kWalSyncThread,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -627,6 +744,12 @@ TEST_F(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetBlockCacheStats) {
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.block-cache-stats", &val));
+  ASSERT_NE(std::string::npos, val.find("Total")) << val;
+}
+
 TEST_F(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -774,6 +897,28 @@ TEST_F(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, ReadsOfSeekExhaustedFile) {
+  // Seek compactions never run with kFIFOCompaction, so the file that
+  // every lookup below is charged to stays in place.
+  Options options = CurrentOptions();
+  options.compaction_style = kFIFOCompaction;
+  Reopen(&options);
+  for (int i = 0; i < 2; i++) {
+    ASSERT_LEVELDB_OK(Put("a", "begin"));
+    ASSERT_LEVELDB_OK(Put("z", "end"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(2, NumTableFilesAtLevel(0));
+
+  // The newer file is charged a seek per lookup and allows at least 100.
+  // Only the lookup that uses them up takes the DB mutex.
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ("NOT_FOUND", Get("missing"));
+  }
+  ASSERT_EQ(2, NumTableFilesAtLevel(0));
+  ASSERT_EQ(1, dbfull()->TEST_NumSeekCompactionLocks());
+}
+
 TEST_F(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -948,6 +1093,151 @@ TEST_F(DBTest, IterSmallAndLargeMix) {
   delete iter;
 }
 
+TEST_F(DBTest, PrefixIterator) {
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(2);
+  do {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.prefix_extractor = prefix_extractor;
+    DestroyAndReopen(&options);
+    ASSERT_LEVELDB_OK(Put("a1x", "va1x"));
+    ASSERT_LEVELDB_OK(Put("b0z", "vb0z"));
+    ASSERT_LEVELDB_OK(Put("b1a", "vb1a"));
+    ASSERT_LEVELDB_OK(Put("b1c", "vb1c"));
+    ASSERT_LEVELDB_OK(Put("b\xff" "1", "vff1"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("b1", "vb1"));
+    ASSERT_LEVELDB_OK(Put("b1b", "vb1b"));
+    ASSERT_LEVELDB_OK(Put("b2a", "vb2a"));
+    ASSERT_LEVELDB_OK(Put("b\xff" "2", "vff2"));
+    ASSERT_LEVELDB_OK(Put("c1", "vc1"));
+    ASSERT_LEVELDB_OK(Delete("b1c"));
+
+    ReadOptions read_options;
+    read_options.prefix = "b1";
+    Iterator* iter = db_->NewIterator(read_options);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "b1->vb1");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "b1a->vb1a");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "b1b->vb1b");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "b1b->vb1b");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b1a->vb1a");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b1->vb1");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->Seek("a");
+    ASSERT_EQ(IterStatus(iter), "b1->vb1");
+    iter->Seek("b1a0");
+    ASSERT_EQ(IterStatus(iter), "b1b->vb1b");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b1a->vb1a");
+    iter->Seek("b2");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+
+    // The end of a prefix ending in 0xff
+    read_options.prefix = "b\xff";
+    iter = db_->NewIterator(read_options);
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "b\xff" "2->vff2");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b\xff" "1->vff1");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+
+    read_options.prefix = "b5";
+    iter = db_->NewIterator(read_options);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    delete iter;
+  } while (ChangeOptions());
+  delete prefix_extractor;
+}
+
+TEST_F(DBTest, PrefixFilterSkipsTables) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBlockedBloomFilterPolicy(10);
+  options.full_filter = true;
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Two tables with overlapping key ranges: one with the even prefixes and
+  // one with the odd prefixes, except for "p004".
+  for (int t = 0; t < 2; t++) {
+    for (int p = t; p < 10; p += 2) {
+      if (p == 4) continue;
+      for (int i = 0; i < 100; i++) {
+        char key[100];
+        std::snprintf(key, sizeof(key), "p%03d|%04d", p, i);
+        ASSERT_LEVELDB_OK(Put(key, key));
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // An unbounded scan over the keys of "p003" reads both tables.
+  env_->random_read_counter_.Reset();
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->Seek("p003|"); iter->Valid() && iter->key().starts_with("p003|");
+       iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(100, count);
+  const int unbounded_reads = env_->random_read_counter_.Read();
+
+  // A scan bounded to the prefix skips the table with the even prefixes.
+  ReadOptions read_options;
+  read_options.prefix = "p003|";
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(read_options);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(100, count);
+  const int bounded_reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d unbounded reads, %d bounded reads\n",
+               unbounded_reads, bounded_reads);
+  ASSERT_LT(bounded_reads, unbounded_reads);
+
+  // A prefix that no table holds reads nothing.
+  read_options.prefix = "p004|";
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(read_options);
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
 TEST_F(DBTest, IterMultiWithDelete) {
   do {
     ASSERT_LEVELDB_OK(Put("a", "va"));
@@ -1050,6 +1340,116 @@ static std::string Key(int i) {
   return std::string(buf);
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread the keys over several files in a non-level-0 level, over
+    // level-0 and over the memtable.
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "base" + std::to_string(i)));
+      if (i % 25 == 24) {
+        Compact(Key(i - 24), Key(i));
+      }
+    }
+    for (int i = 0; i < 100; i += 3) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "l0-" + std::to_string(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < 100; i += 5) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+    for (int i = 0; i < 100; i += 7) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "mem" + std::to_string(i)));
+    }
+
+    // Unsorted, with duplicates and missing keys.
+    std::vector<std::string> keys;
+    for (int i = 104; i >= 0; i -= 2) {
+      keys.push_back(Key(i));
+    }
+    for (int i = 1; i < 105; i += 2) {
+      keys.push_back(Key(i));
+    }
+    keys.push_back(Key(42));
+    keys.push_back("");
+
+    std::vector<std::string> values = MultiGet(keys);
+    ASSERT_EQ(keys.size(), values.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(Get(keys[i]), values[i]) << keys[i];
+    }
+    values = MultiGet(keys, snapshot);
+    ASSERT_EQ(keys.size(), values.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(Get(keys[i], snapshot), values[i]) << keys[i];
+    }
+    db_->ReleaseSnapshot(snapshot);
+
+    ASSERT_TRUE(MultiGet(std::vector<std::string>()).empty());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, GetPinnable) {
+  do {
+    PinnableSlice value;
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value));
+    ASSERT_EQ("v1", value.ToString());
+    ASSERT_FALSE(value.IsPinned());  // Copied out of the memtable
+
+    const std::string big(100000, 'x');
+    ASSERT_LEVELDB_OK(Put("bar", big));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "bar", &value));
+    ASSERT_TRUE(value.IsPinned());
+    ASSERT_EQ(big, value.ToString());
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "foo", &value));
+    ASSERT_TRUE(value.IsPinned());
+    ASSERT_EQ("v1", value.ToString());
+
+    // A pinned value outlives the removal of its table.
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "bar", &value));
+    ASSERT_LEVELDB_OK(Delete("bar"));
+    db_->CompactRange(nullptr, nullptr);
+    ASSERT_EQ(big, value.ToString());
+    ASSERT_EQ("NOT_FOUND", Get("bar"));
+
+    ASSERT_TRUE(db_->Get(ReadOptions(), "bar", &value).IsNotFound());
+    ASSERT_FALSE(value.IsPinned());
+    ASSERT_TRUE(value.empty());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, MaxMmapFiles) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.max_mmap_files = 2;
+  Reopen(&options);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v" + std::to_string(i)));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(4, TotalTableFiles());
+
+  env_->mmap_choice_counter_.Reset();
+  env_->mmap_file_counter_.Reset();
+  Reopen(&options);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ("v" + std::to_string(i), Get(Key(i)));
+  }
+  ASSERT_EQ(4, env_->mmap_choice_counter_.Read());
+  ASSERT_EQ(2, env_->mmap_file_counter_.Read());
+
+  // The Env decides by default.
+  env_->mmap_choice_counter_.Reset();
+  options.max_mmap_files = -1;
+  Reopen(&options);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ("v" + std::to_string(i), Get(Key(i)));
+  }
+  ASSERT_EQ(0, env_->mmap_choice_counter_.Read());
+}
+
 TEST_F(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1099,6 +1499,32 @@ TEST_F(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST_F(DBTest, PipelinedRecovery) {
+  for (int pipelined = 0; pipelined < 2; pipelined++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+    // Overwrite every key, so that level-0 tables written out of order
+    // would return stale values.
+    for (int round = 0; round < 3; round++) {
+      for (int i = 0; i < 1000; i++) {
+        ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + round)));
+      }
+    }
+    ASSERT_LEVELDB_OK(Delete(Key(0)));
+    ASSERT_EQ(0, TotalTableFiles());
+
+    // Replay the 3MB log through many memtables.
+    options.write_buffer_size = 100000;
+    options.enable_pipelined_recovery = (pipelined != 0);
+    Reopen(&options);
+    ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+    for (int i = 1; i < 1000; i++) {
+      ASSERT_EQ(std::string(1000, 'c'), Get(Key(i)));
+    }
+  }
+}
+
 TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;  // Large write buffer
@@ -1125,6 +1551,133 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, CompressionPerLevel) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.compression_per_level = {kLZ4Compression, kLZ4Compression,
+                                   kZstdCompression};
+  options.zstd_max_dict_bytes = 4096;
+  options.zstd_max_train_bytes = 64 * 1024;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::string tmp;
+  std::vector<std::string> values;
+  for (int i = 0; i < 200; i++) {
+    test::CompressibleString(&rnd, 0.25, 10000, &tmp);
+    values.push_back(tmp);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_GT(NumTableFilesAtLevel(2), 0);
+
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;  // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+
+  // Push several files to the bottom of the tree, then add overlapping
+  // files with overwrites and deletions on top of them so that compacting
+  // everything again is split into multiple ranges.
+  std::map<std::string, std::string> expected;
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 200; i++) {
+      std::string value = RandomString(&rnd, 20000);
+      ASSERT_LEVELDB_OK(Put(Key(i), value));
+      expected[Key(i)] = value;
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_GT(NumTableFilesAtLevel(config::kMaxMemCompactLevel), 1);
+
+  for (int file = 0; file < 4; file++) {
+    for (int i = file; i < 200; i += 2) {
+      std::string value = RandomString(&rnd, 10000);
+      ASSERT_LEVELDB_OK(Put(Key(i), value));
+      expected[Key(i)] = value;
+    }
+    for (int i = file; i < 200; i += 7) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+      expected.erase(Key(i));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_EQ(NumTableFilesAtLevel(1), 0);
+  ASSERT_GT(dbfull()->TEST_NumSplitSubcompactions(), 1);
+
+  for (int i = 0; i < 200; i++) {
+    std::map<std::string, std::string>::iterator it = expected.find(Key(i));
+    ASSERT_EQ(Get(Key(i)), it == expected.end() ? "NOT_FOUND" : it->second);
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::map<std::string, std::string>::iterator expected_iter =
+      expected.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(expected_iter != expected.end());
+    ASSERT_EQ(iter->key().ToString(), expected_iter->first);
+    ++expected_iter;
+  }
+  ASSERT_TRUE(expected_iter == expected.end());
+  delete iter;
+}
+
+TEST_F(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Keep flushes and compactions of several levels busy at the same time.
+  Random rnd(301);
+  std::map<std::string, std::string> expected;
+  for (int i = 0; i < 20000; i++) {
+    const std::string key = Key(rnd.Uniform(5000));
+    if (rnd.OneIn(10)) {
+      ASSERT_LEVELDB_OK(Delete(key));
+      expected.erase(key);
+    } else {
+      std::string value = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      expected[key] = value;
+    }
+  }
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    std::map<std::string, std::string>::iterator expected_iter =
+        expected.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_TRUE(expected_iter != expected.end());
+      ASSERT_EQ(iter->key().ToString(), expected_iter->first);
+      ASSERT_EQ(iter->value().ToString(), expected_iter->second);
+      ++expected_iter;
+    }
+    ASSERT_TRUE(expected_iter == expected.end());
+    delete iter;
+
+    // Check again once all data is compacted and the DB is reopened.
+    db_->CompactRange(nullptr, nullptr);
+    Reopen(&options);
+  }
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1434,37 +1987,284 @@ TEST_F(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
-TEST_F(DBTest, OverlapInLevel0) {
+TEST_F(DBTest, DeleteRange) {
   do {
-    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
-
-    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
-    // 0.
-    ASSERT_LEVELDB_OK(Put("100", "v100"));
-    ASSERT_LEVELDB_OK(Put("999", "v999"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_LEVELDB_OK(Delete("100"));
-    ASSERT_LEVELDB_OK(Delete("999"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("0,1,1", FilesPerLevel());
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "x", "x"));  // Empty
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("vd", Get("d"));
+      ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+      ASSERT_EQ("vb", Get("b", snapshot));
+
+      std::vector<std::string> keys;
+      keys.push_back("b");
+      keys.push_back("c");
+      std::vector<std::string> values = MultiGet(keys);
+      ASSERT_EQ("NOT_FOUND", values[0]);
+      ASSERT_EQ("vc2", values[1]);
+      values = MultiGet(keys, snapshot);
+      ASSERT_EQ("vb", values[0]);
+      ASSERT_EQ("vc", values[1]);
+
+      if (i == 0) {
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+      } else if (i == 1) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+    }
+    db_->ReleaseSnapshot(snapshot);
 
-    // Make files spanning the following ranges in level-0:
-    //  files[0]  200 .. 900
-    //  files[1]  300 .. 500
-    // Note that files are sorted by smallest key.
-    ASSERT_LEVELDB_OK(Put("300", "v300"));
-    ASSERT_LEVELDB_OK(Put("500", "v500"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_LEVELDB_OK(Put("200", "v200"));
-    ASSERT_LEVELDB_OK(Put("600", "v600"));
-    ASSERT_LEVELDB_OK(Put("900", "v900"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("2,1,1", FilesPerLevel());
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
 
-    // Compact away the placeholder files we created initially
-    dbfull()->TEST_CompactRange(1, nullptr, nullptr);
-    dbfull()->TEST_CompactRange(2, nullptr, nullptr);
-    ASSERT_EQ("2", FilesPerLevel());
+TEST_F(DBTest, DeleteRangeAfterReads) {
+  // Reads see the tombstones added after earlier reads, while iterators
+  // keep seeing the ones that were there when they were created.
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "b"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("vb", Get("b"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "c"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_LEVELDB_OK(Put("a", "va2"));
+  ASSERT_EQ("va2", Get("a"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "z"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+
+  iter->SeekToFirst();
+  ASSERT_EQ("b->vb", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  delete iter;
+
+  iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  delete iter;
+}
+
+TEST_F(DBTest, DeleteRangeAcrossLevels) {
+  // Tombstones in newer levels hide the entries of older levels.
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("m", "v1"));
+  ASSERT_LEVELDB_OK(Put("z", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "y"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("NOT_FOUND", Get("m"));
+  ASSERT_EQ("(a->v1)(z->v1)", Contents());
+
+  // Compacting the tombstone into the older level drops both it and "m".
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get("m"));
+  ASSERT_EQ("[ ]", AllEntriesFor("m"));
+  ASSERT_EQ("(a->v1)(z->v1)", Contents());
+  Reopen();
+  ASSERT_EQ("(a->v1)(z->v1)", Contents());
+}
+
+TEST_F(DBTest, DeleteRangeDropsCoveredFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  const int files = TotalTableFiles();
+  ASSERT_GT(files, 3);
+
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(100), Key(900)));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_LT(TotalTableFiles(), files);
+  ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(899)));
+  ASSERT_NE("NOT_FOUND", Get(Key(99)));
+  ASSERT_NE("NOT_FOUND", Get(Key(900)));
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(500)));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(200, count);
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  const std::string fname = testing::TempDir() + "db_test_external.sst";
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LEVELDB_OK(Put("d", "vd"));  // In the memtable
+    const Snapshot* snapshot = db_->GetSnapshot();
+
+    SstFileWriter writer(CurrentOptions());
+    ASSERT_LEVELDB_OK(writer.Open(fname));
+    ASSERT_LEVELDB_OK(writer.Put("b", "vb"));
+    ASSERT_LEVELDB_OK(writer.Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(writer.Delete("d"));
+    ASSERT_LEVELDB_OK(writer.Finish());
+    ASSERT_GT(writer.FileSize(), 0);
+    ASSERT_LEVELDB_OK(
+        db_->IngestExternalFile(IngestExternalFileOptions(), fname));
+    ASSERT_TRUE(env_->FileExists(fname));  // Copied
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("vb", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("NOT_FOUND", Get("d"));
+      ASSERT_EQ("(a->va)(b->vb)(c->vc2)(e->ve)", Contents());
+
+      // The snapshot predates the file.
+      ASSERT_EQ("NOT_FOUND", Get("b", snapshot));
+      ASSERT_EQ("vc1", Get("c", snapshot));
+      ASSERT_EQ("vd", Get("d", snapshot));
+
+      std::vector<std::string> keys;
+      keys.push_back("c");
+      keys.push_back("d");
+      std::vector<std::string> values = MultiGet(keys);
+      ASSERT_EQ("vc2", values[0]);
+      ASSERT_EQ("NOT_FOUND", values[1]);
+      values = MultiGet(keys, snapshot);
+      ASSERT_EQ("vc1", values[0]);
+      ASSERT_EQ("vd", values[1]);
+
+      if (i == 0) {
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+      } else if (i == 1) {
+        db_->CompactRange(nullptr, nullptr);
+      }
+    }
+    db_->ReleaseSnapshot(snapshot);
+
+    Reopen();
+    ASSERT_EQ("(a->va)(b->vb)(c->vc2)(e->ve)", Contents());
+    ASSERT_LEVELDB_OK(Put("c", "vc3"));  // Newer than the file
+    ASSERT_EQ("vc3", Get("c"));
+    ASSERT_LEVELDB_OK(env_->RemoveFile(fname));
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, IngestExternalFileLevel) {
+  const std::string fname = testing::TempDir() + "db_test_external.sst";
+  SstFileWriter writer(CurrentOptions());
+  IngestExternalFileOptions ingest_options;
+  ingest_options.move_files = true;
+
+  // Nothing overlaps the file: it goes to the last level.
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(writer.Put(Key(i), Key(i)));
+  }
+  ASSERT_LEVELDB_OK(writer.Finish());
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(ingest_options, fname));
+  ASSERT_FALSE(env_->FileExists(fname));  // Moved
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+  ASSERT_EQ(Key(42), Get(Key(42)));
+
+  // Files that overlap the newer ones stop above them.
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  ASSERT_LEVELDB_OK(writer.Put(Key(42), "v2"));
+  ASSERT_LEVELDB_OK(writer.Finish());
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(ingest_options, fname));
+  ASSERT_EQ("0,0,0,0,0,1,1", FilesPerLevel());
+  ASSERT_LEVELDB_OK(Put(Key(42), "v3"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  ASSERT_LEVELDB_OK(writer.Put(Key(42), "v4"));
+  ASSERT_LEVELDB_OK(writer.Finish());
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(ingest_options, fname));
+  ASSERT_EQ("v4", Get(Key(42)));
+  ASSERT_EQ("[ v4, v3, v2, " + Key(42) + " ]", AllEntriesFor(Key(42)));
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("v4", Get(Key(42)));
+  ASSERT_EQ(Key(41), Get(Key(41)));
+  ASSERT_EQ("[ v4 ]", AllEntriesFor(Key(42)));
+}
+
+TEST_F(DBTest, IngestExternalFileErrors) {
+  const std::string fname = testing::TempDir() + "db_test_external.sst";
+  SstFileWriter writer(CurrentOptions());
+  ASSERT_TRUE(writer.Put("a", "va").IsInvalidArgument());  // Not open
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  ASSERT_TRUE(writer.Finish().IsInvalidArgument());  // No entries
+
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  ASSERT_LEVELDB_OK(writer.Put("b", "vb"));
+  ASSERT_TRUE(writer.Put("a", "va").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("b", "vb").IsInvalidArgument());
+  ASSERT_LEVELDB_OK(writer.Finish());
+
+  ASSERT_FALSE(db_->IngestExternalFile(IngestExternalFileOptions(),
+                                       fname + ".missing")
+                   .ok());
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "not a table", fname));
+  ASSERT_FALSE(
+      db_->IngestExternalFile(IngestExternalFileOptions(), fname).ok());
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_LEVELDB_OK(env_->RemoveFile(fname));
+}
+
+TEST_F(DBTest, OverlapInLevel0) {
+  do {
+    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
+
+    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
+    // 0.
+    ASSERT_LEVELDB_OK(Put("100", "v100"));
+    ASSERT_LEVELDB_OK(Put("999", "v999"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Delete("100"));
+    ASSERT_LEVELDB_OK(Delete("999"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("0,1,1", FilesPerLevel());
+
+    // Make files spanning the following ranges in level-0:
+    //  files[0]  200 .. 900
+    //  files[1]  300 .. 500
+    // Note that files are sorted by smallest key.
+    ASSERT_LEVELDB_OK(Put("300", "v300"));
+    ASSERT_LEVELDB_OK(Put("500", "v500"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("200", "v200"));
+    ASSERT_LEVELDB_OK(Put("600", "v600"));
+    ASSERT_LEVELDB_OK(Put("900", "v900"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("2,1,1", FilesPerLevel());
+
+    // Compact away the placeholder files we created initially
+    dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+    dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+    ASSERT_EQ("2", FilesPerLevel());
 
     // Do a memtable compaction.  Before bug-fix, the compaction would
     // not detect the overlap with level-0 files and would incorrectly place
@@ -1607,6 +2407,188 @@ TEST_F(DBTest, CustomComparator) {
   }
 }
 
+TEST_F(DBTest, DirectIOCompaction) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Several level-0 files
+  options.use_direct_io_for_compaction = true;
+  Reopen(&options);
+
+  // Overwrite every key once so that the files overlap and are merged.
+  Random rnd(301);
+  std::vector<std::string> values(200);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 200; i++) {
+      values[i] = RandomString(&rnd, 5000);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+  }
+  env_->direct_read_file_counter_.Reset();
+  env_->direct_write_file_counter_.Reset();
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_GT(env_->direct_read_file_counter_.Read(), 0);
+  ASSERT_GT(env_->direct_write_file_counter_.Read(), 0);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+namespace {
+// Records the requests without limiting anything.
+class CountingRateLimiter : public RateLimiter {
+ public:
+  CountingRateLimiter() : low_bytes(0), high_bytes(0) {}
+
+  void Request(size_t bytes, IOPriority priority) override {
+    (priority == kHigh ? high_bytes : low_bytes).fetch_add(bytes);
+  }
+  void SetBytesPerSecond(int64_t bytes_per_second) override {}
+  int64_t GetBytesPerSecond() const override { return 0; }
+
+  std::atomic<size_t> low_bytes;
+  std::atomic<size_t> high_bytes;
+};
+}  // namespace
+
+TEST_F(DBTest, RateLimiter) {
+  CountingRateLimiter limiter;
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Several level-0 files
+  options.rate_limiter = &limiter;
+  Reopen(&options);
+
+  // Overwrite every key once so that the files overlap and are merged.
+  Random rnd(301);
+  std::vector<std::string> values(200);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 200; i++) {
+      values[i] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+  }
+  db_->CompactRange(nullptr, nullptr);
+
+  // Every entry was flushed, and the latest ones were compacted at least
+  // once.
+  ASSERT_GE(limiter.high_bytes.load(), 400 * 1000);
+  ASSERT_GE(limiter.low_bytes.load(), 200 * 1000);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, UniversalCompaction) {
+  size_t compaction_bytes[2];
+  for (int i = 0; i < 2; i++) {
+    const CompactionStyle style =
+        (i == 0 ? kLevelCompaction : kUniversalCompaction);
+    CountingRateLimiter limiter;
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.write_buffer_size = 100000;  // Small write buffer
+    options.compaction_style = style;
+    options.rate_limiter = &limiter;
+    DestroyAndReopen(&options);
+
+    Random rnd(301);
+    std::map<std::string, std::string> expected;
+    for (int j = 0; j < 50000; j++) {
+      const std::string key = Key(rnd.Uniform(100000));
+      if (rnd.OneIn(10)) {
+        ASSERT_LEVELDB_OK(Delete(key));
+        expected.erase(key);
+      } else {
+        std::string value = RandomString(&rnd, 100);
+        ASSERT_LEVELDB_OK(Put(key, value));
+        expected[key] = value;
+      }
+    }
+    compaction_bytes[i] = limiter.low_bytes.load();
+
+    for (int pass = 0; pass < 2; pass++) {
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      std::map<std::string, std::string>::iterator expected_iter =
+          expected.begin();
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ASSERT_TRUE(expected_iter != expected.end());
+        ASSERT_EQ(iter->key().ToString(), expected_iter->first);
+        ASSERT_EQ(iter->value().ToString(), expected_iter->second);
+        ++expected_iter;
+      }
+      ASSERT_TRUE(expected_iter == expected.end());
+      delete iter;
+      Reopen(&options);
+    }
+    Close();
+  }
+
+  // Merging runs of similar size rewrites data fewer times than merging
+  // every level into the next.
+  ASSERT_LT(compaction_bytes[1], compaction_bytes[0]);
+}
+
+TEST_F(DBTest, FIFOCompaction) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.compaction_style = kFIFOCompaction;
+  options.ttl_seconds = 3600;
+  Reopen(&options);
+
+  // More level-0 files than would stop writes with other styles.
+  Random rnd(301);
+  for (int i = 0; i < 1500; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(NumTableFilesAtLevel(0), config::kL0_StopWritesTrigger);
+  ASSERT_EQ(NumTableFilesAtLevel(0), TotalTableFiles());
+
+  // Two hours later, the next flush drops all the older files.
+  env_->clock_offset_micros_.store(2 * 3600 * 1000000ull);
+  std::vector<std::string> values(50);
+  for (int i = 0; i < 50; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(1500 + i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 1000 && TotalTableFiles() > 1; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ(1, TotalTableFiles());
+
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(1499)));
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(values[i], Get(Key(1500 + i)));
+  }
+}
+
+TEST_F(DBTest, FIFOCompactionOfIdleDB) {
+  Options options = CurrentOptions();
+  options.compaction_style = kFIFOCompaction;
+  options.ttl_seconds = 1;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, TotalTableFiles());
+
+  // With no further writes or reads, the file is dropped once it expires.
+  for (int i = 0; i < 500 && TotalTableFiles() > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+}
+
 TEST_F(DBTest, ManualCompaction) {
   ASSERT_EQ(config::kMaxMemCompactLevel, 2)
       << "Need to update this test to match kMaxMemCompactLevel";
@@ -1811,6 +2793,155 @@ TEST_F(DBTest, WriteSyncError) {
   ASSERT_EQ("NOT_FOUND", Get("k3"));
 }
 
+TEST_F(DBTest, WalSyncThreadError) {
+  for (int pipelined = 0; pipelined < 2; pipelined++) {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.enable_wal_sync_thread = true;
+    options.enable_pipelined_write = (pipelined != 0);
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+    env_->data_sync_error_.store(true, std::memory_order_release);
+
+    WriteOptions w;
+    ASSERT_LEVELDB_OK(db_->Put(w, "k1", "v1"));
+    ASSERT_EQ("v1", Get("k1"));
+
+    // A write whose sync failed does not become visible.
+    w.sync = true;
+    ASSERT_TRUE(!db_->Put(w, "k2", "v2").ok());
+    ASSERT_EQ("v1", Get("k1"));
+    ASSERT_EQ("NOT_FOUND", Get("k2"));
+    env_->data_sync_error_.store(false, std::memory_order_release);
+
+    // The sync error disallows future writes.
+    w.sync = false;
+    ASSERT_TRUE(!db_->Put(w, "k3", "v3").ok());
+    ASSERT_EQ("v1", Get("k1"));
+    ASSERT_EQ("NOT_FOUND", Get("k2"));
+    ASSERT_EQ("NOT_FOUND", Get("k3"));
+  }
+}
+
+namespace {
+
+static const int kGroupCommitThreads = 8;
+static const int kGroupCommitWrites = 20;
+
+struct GroupCommitThread {
+  DB* db;
+  int id;
+  std::atomic<bool> done;
+};
+
+static void GroupCommitThreadBody(void* arg) {
+  GroupCommitThread* t = reinterpret_cast<GroupCommitThread*>(arg);
+  WriteOptions options;
+  options.sync = true;
+  for (int i = 0; i < kGroupCommitWrites; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "%d.%d", t->id, i);
+    ASSERT_LEVELDB_OK(t->db->Put(options, key, key));
+  }
+  t->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, WalGroupCommit) {
+  // Sync writes that wait for each other share their syncs, whether the
+  // leader of each group or the WAL-sync thread syncs the log.
+  for (int use_thread = 0; use_thread < 2; use_thread++) {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.create_if_missing = true;
+    options.wal_group_commit_micros = 20000;
+    options.enable_wal_sync_thread = (use_thread != 0);
+    DestroyAndReopen(&options);
+    env_->data_sync_counter_.Reset();
+
+    GroupCommitThread thread[kGroupCommitThreads];
+    for (int id = 0; id < kGroupCommitThreads; id++) {
+      thread[id].db = db_;
+      thread[id].id = id;
+      thread[id].done.store(false, std::memory_order_release);
+      env_->StartThread(GroupCommitThreadBody, &thread[id]);
+    }
+    for (int id = 0; id < kGroupCommitThreads; id++) {
+      while (!thread[id].done.load(std::memory_order_acquire)) {
+        DelayMilliseconds(10);
+      }
+    }
+    const int writes = kGroupCommitThreads * kGroupCommitWrites;
+    ASSERT_LT(env_->data_sync_counter_.Read(), writes / 2);
+
+    Reopen(&options);
+    for (int id = 0; id < kGroupCommitThreads; id++) {
+      for (int i = 0; i < kGroupCommitWrites; i++) {
+        char key[20];
+        std::snprintf(key, sizeof(key), "%d.%d", id, i);
+        ASSERT_EQ(key, Get(key));
+      }
+    }
+  }
+}
+
+TEST_F(DBTest, WalGroupCommitBytes) {
+  // The wait for more writers ends once enough bytes are waiting.
+  for (int use_thread = 0; use_thread < 2; use_thread++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.wal_group_commit_micros = 100 * 1000 * 1000;
+    options.wal_group_commit_bytes = 1;
+    options.enable_wal_sync_thread = (use_thread != 0);
+    DestroyAndReopen(&options);
+    WriteOptions w;
+    w.sync = true;
+    const uint64_t start_micros = env_->NowMicros();
+    ASSERT_LEVELDB_OK(db_->Put(w, "foo", "v1"));
+    ASSERT_LT(env_->NowMicros() - start_micros, 10 * 1000 * 1000);
+    ASSERT_EQ("v1", Get("foo"));
+  }
+}
+
+TEST_F(DBTest, RecycleLogFiles) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.recycle_log_file_num = 1;
+  options.preallocate_log_files = true;
+  options.reuse_logs = true;
+  DestroyAndReopen(&options);
+
+  // Write "foo" at the end of the first log, past what the last writes
+  // below overwrite once the log is recycled.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'x')));
+  }
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Delete("foo"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Reuses first log
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("[ ]", AllEntriesFor("foo"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Reuses it again
+  ASSERT_EQ(2, CountLogFiles());  // The current log and a recyclable one
+  // These records end where a record of the first log starts.
+  for (int i = 0; i < 50; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'y')));
+  }
+
+  // The records left over from the first log must not be replayed, nor
+  // be followed by new records.
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ(std::string(100, 'y'), Get(Key(49)));
+  ASSERT_EQ(std::string(100, 'x'), Get(Key(50)));
+}
+
 TEST_F(DBTest, ManifestWriteError) {
   // Test for the following problem:
   // (a) Compaction produces file F
@@ -1942,6 +3073,103 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, FullBlockedBloomFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBlockedBloomFilterPolicy(10);
+  options.full_filter = true;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Lookup present keys.  Should rarely read from small sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  // Lookup missing keys.  Should rarely read from either sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  // Tables written with a full filter stay readable with full_filter off.
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  options.full_filter = false;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 10) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PartitionedBloomFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  Reopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // The first lookups bring the filter partitions into the block cache.
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+
+  // Lookup missing keys.  The filter partitions should rule out most of
+  // them without reading the index partitions or data blocks.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".other"));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.filter_policy;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2039,6 +3267,81 @@ TEST_F(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+static const int kNumReaderThreads = 3;
+static const int kNumReadKeys = 100;
+
+struct ReadState {
+  DB* db;
+  std::atomic<int> last_written;  // Value of the last completed write
+  std::atomic<bool> stop;
+  std::atomic<int> readers_done;
+};
+
+// Reads the key of the last completed write, alternating between Get()
+// and iterators, and checks that the write is visible.
+static void ReaderThreadBody(void* arg) {
+  ReadState* state = reinterpret_cast<ReadState*>(arg);
+  std::string value;
+  int reads = 0;
+  while (!state->stop.load(std::memory_order_acquire)) {
+    const int w = state->last_written.load(std::memory_order_acquire);
+    if (w < 0) continue;
+    char keybuf[20];
+    std::snprintf(keybuf, sizeof(keybuf), "%016d", w % kNumReadKeys);
+    value.clear();
+    if (reads++ % 2 == 0) {
+      EXPECT_LEVELDB_OK(state->db->Get(ReadOptions(), keybuf, &value));
+    } else {
+      Iterator* iter = state->db->NewIterator(ReadOptions());
+      iter->Seek(keybuf);
+      if (iter->Valid() && iter->key() == keybuf) {
+        value = iter->value().ToString();
+      }
+      delete iter;
+    }
+    // Expect-style checks, so that the thread always reports being done.
+    EXPECT_GE(std::atoi(value.c_str()), w) << keybuf;
+  }
+  state->readers_done.fetch_add(1, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, ReadsDuringMemTableSwitches) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;  // Switch memtables often
+  Reopen(&options);
+
+  ReadState state;
+  state.db = db_;
+  state.last_written.store(-1, std::memory_order_release);
+  state.stop.store(false, std::memory_order_release);
+  state.readers_done.store(0, std::memory_order_release);
+  for (int id = 0; id < kNumReaderThreads; id++) {
+    env_->StartThread(ReaderThreadBody, &state);
+  }
+
+  // Every write goes to a key that readers may look up right after, so
+  // readers that miss a new memtable or version fail.
+  char valbuf[200];
+  for (int i = 0; i < 20000; i++) {
+    char keybuf[20];
+    std::snprintf(keybuf, sizeof(keybuf), "%016d", i % kNumReadKeys);
+    std::snprintf(valbuf, sizeof(valbuf), "%-199d", i);
+    ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), keybuf, valbuf));
+    state.last_written.store(i, std::memory_order_release);
+  }
+
+  state.stop.store(true, std::memory_order_release);
+  while (state.readers_done.load(std::memory_order_acquire) <
+         kNumReaderThreads) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_GT(TotalTableFiles(), 0);
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -2091,6 +3394,12 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin, const Slice& end) override {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2295,6 +3604,57 @@ TEST_F(DBTest, Randomized) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, RandomizedDeleteRange) {
+  Random rnd(test::RandomSeed());
+  do {
+    Options options = CurrentOptions();
+    options.write_buffer_size = 20000;  // Flush tombstones often
+    Reopen(&options);
+    ModelDB model(options);
+    const int N = 5000;
+    const Snapshot* model_snap = nullptr;
+    const Snapshot* db_snap = nullptr;
+    for (int step = 0; step < N; step++) {
+      const int p = rnd.Uniform(100);
+      std::string k = RandomKey(&rnd);
+      if (p < 60) {  // Put
+        const std::string v = RandomString(&rnd, rnd.Uniform(200));
+        ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
+        ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
+      } else if (p < 80) {  // Delete
+        ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
+        ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
+      } else {  // DeleteRange
+        std::string limit = RandomKey(&rnd);
+        if (limit < k) {
+          std::swap(k, limit);
+        }
+        ASSERT_LEVELDB_OK(model.DeleteRange(WriteOptions(), k, limit));
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), k, limit));
+      }
+
+      if ((step % 500) == 0) {
+        ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+        ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+        if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+        if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+
+        if ((step % 1000) == 0) {
+          db_->CompactRange(nullptr, nullptr);
+        } else {
+          Reopen(&options);
+        }
+        ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
+
+        model_snap = model.GetSnapshot();
+        db_snap = db_->GetSnapshot();
+      }
+    }
+    if (model_snap != nullptr) model.ReleaseSnapshot(model_snap);
+    if (db_snap != nullptr) db_->ReleaseSnapshot(db_snap);
+  } while (ChangeOptions());
+}
+
 std::string MakeKey(unsigned int num) {
   char buf[30];
   std::snprintf(buf, sizeof(buf), "%016u", num);
@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <sstream>
+#include <vector>
 
 #include "port/port.h"
 #include "util/coding.h"
@@ -96,10 +97,46 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
-const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor)
+    : user_policy_(p), prefix_extractor_(prefix_extractor) {
+  if (user_policy_ != nullptr && prefix_extractor_ != nullptr) {
+    name_ = user_policy_->Name();
+    name_.append("+");
+    name_.append(prefix_extractor_->Name());
+  }
+}
+
+const char* InternalFilterPolicy::Name() const {
+  return (prefix_extractor_ != nullptr) ? name_.c_str() : user_policy_->Name();
+}
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
+  if (prefix_extractor_ != nullptr) {
+    // Add the prefix after each user key.  Since keys are sorted, repeated
+    // prefixes are adjacent and only added once.
+    std::vector<Slice> filter_keys;
+    filter_keys.reserve(2 * n);
+    Slice last_prefix;
+    bool has_prefix = false;
+    for (int i = 0; i < n; i++) {
+      const Slice user_key = ExtractUserKey(keys[i]);
+      filter_keys.push_back(user_key);
+      if (prefix_extractor_->InDomain(user_key)) {
+        const Slice prefix = prefix_extractor_->Transform(user_key);
+        if (!has_prefix || prefix != last_prefix) {
+          filter_keys.push_back(prefix);
+          last_prefix = prefix;
+          has_prefix = true;
+        }
+      }
+    }
+    user_policy_->CreateFilter(filter_keys.data(),
+                               static_cast<int>(filter_keys.size()), dst);
+    return;
+  }
+
   // We rely on the fact that the code in table.cc does not mind us
   // adjusting keys[].
   Slice* mkey = const_cast<Slice*>(keys);
@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -51,14 +52,23 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+//
+// kTypeRangeDeletion marks the range tombstones written by
+// WriteBatch::DeleteRange().  They are kept apart from the other entries:
+// in a skiplist of their own in memtables and in a meta block of their own
+// in tables (see RangeTombstoneList).
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
 
 typedef uint64_t SequenceNumber;
 
@@ -117,12 +127,20 @@ class InternalKeyComparator : public Comparator {
 };
 
 // Filter policy wrapper that converts from internal keys to user keys
+// If a prefix extractor is given, the filters also hold the prefix of
+// every user key, and the name of the extractor becomes part of the name
+// of the policy so that filters built without (or with other) prefixes
+// are not used.
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const SliceTransform* const prefix_extractor_;
+  std::string name_;  // Used if prefix_extractor_ != nullptr
 
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) {}
+  explicit InternalFilterPolicy(const FilterPolicy* p,
+                                const SliceTransform* prefix_extractor =
+                                    nullptr);
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
@@ -177,7 +195,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeRangeDeletion));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -201,6 +219,9 @@ class LookupKey {
   // Return the user key
   Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
 
+  // Return the sequence number of the snapshot
+  SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
  private:
   // We construct a char array of the form:
   //    klength  varint32               <-- start_
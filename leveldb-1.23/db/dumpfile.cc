@@ -88,6 +88,14 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    std::string r = "  delrange '";
+    AppendEscapedStringTo(&r, begin);
+    r += "' '";
+    AppendEscapedStringTo(&r, end);
+    r += "'\n";
+    dst_->Append(r);
+  }
 
   WritableFile* dst_;
 };
@@ -20,15 +20,28 @@ enum RecordType {
   // For fragments
   kFirstType = 2,
   kMiddleType = 3,
-  kLastType = 4
+  kLastType = 4,
+
+  // Same as the above, for records whose header also holds the number of
+  // the log file they were written to.  Used by log files that may be
+  // recycled, so that the records left over from the previous use of the
+  // file can be told apart from the new ones.
+  kRecyclableFullType = 5,
+  kRecyclableFirstType = 6,
+  kRecyclableMiddleType = 7,
+  kRecyclableLastType = 8
 };
-static const int kMaxRecordType = kLastType;
+static const int kMaxRecordType = kRecyclableLastType;
 
 static const int kBlockSize = 32768;
 
 // Header is checksum (4 bytes), length (2 bytes), type (1 byte).
 static const int kHeaderSize = 4 + 2 + 1;
 
+// Recyclable header is checksum (4 bytes), length (2 bytes), type (1 byte),
+// log number (4 bytes).
+static const int kRecyclableHeaderSize = 4 + 2 + 1 + 4;
+
 }  // namespace log
 }  // namespace leveldb
 
@@ -26,7 +26,17 @@ Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
       last_record_offset_(0),
       end_of_buffer_offset_(0),
       initial_offset_(initial_offset),
-      resyncing_(initial_offset > 0) {}
+      resyncing_(initial_offset > 0),
+      log_number_known_(false),
+      log_number_(0),
+      recyclable_(false) {}
+
+Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
+               uint64_t initial_offset, uint64_t log_number)
+    : Reader(file, reporter, checksum, initial_offset) {
+  log_number_known_ = true;
+  log_number_ = static_cast<uint32_t>(log_number);
+}
 
 Reader::~Reader() { delete[] backing_store_; }
 
@@ -69,13 +79,20 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
 
   Slice fragment;
   while (true) {
-    const unsigned int record_type = ReadPhysicalRecord(&fragment);
+    unsigned int record_type = ReadPhysicalRecord(&fragment);
+    int header_size = kHeaderSize;
+    if (record_type >= kRecyclableFullType &&
+        record_type <= kRecyclableLastType) {
+      // The fragments of recyclable records are handled like the others.
+      header_size = kRecyclableHeaderSize;
+      record_type -= kRecyclableFullType - kFullType;
+    }
 
     // ReadPhysicalRecord may have only had an empty trailer remaining in its
     // internal buffer. Calculate the offset of the next physical record now
     // that it has returned, properly accounting for its header size.
     uint64_t physical_record_offset =
-        end_of_buffer_offset_ - buffer_.size() - kHeaderSize - fragment.size();
+        end_of_buffer_offset_ - buffer_.size() - header_size - fragment.size();
 
     if (resyncing_) {
       if (record_type == kMiddleType) {
@@ -219,9 +236,18 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
     const unsigned int type = header[6];
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    const bool recyclable_type =
+        (type >= kRecyclableFullType && type <= kRecyclableLastType);
+    const int header_size =
+        recyclable_type ? kRecyclableHeaderSize : kHeaderSize;
+    if (header_size + length > buffer_.size()) {
       size_t drop_size = buffer_.size();
       buffer_.clear();
+      if (recyclable_) {
+        // Leftover data from the previous use of a recycled file.
+        eof_ = true;
+        return kEof;
+      }
       if (!eof_) {
         ReportCorruption(drop_size, "bad record length");
         return kBadRecord;
@@ -243,7 +269,8 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     // Check crc
     if (checksum_) {
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc =
+          crc32c::Value(header + 6, header_size - 6 + length);
       if (actual_crc != expected_crc) {
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
@@ -251,21 +278,40 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
         // like a valid log record.
         size_t drop_size = buffer_.size();
         buffer_.clear();
+        if (recyclable_) {
+          // Leftover data from the previous use of a recycled file.
+          eof_ = true;
+          return kEof;
+        }
         ReportCorruption(drop_size, "checksum mismatch");
         return kBadRecord;
       }
     }
 
-    buffer_.remove_prefix(kHeaderSize + length);
+    if (recyclable_type) {
+      const uint32_t log_number = DecodeFixed32(header + kHeaderSize);
+      if (!log_number_known_) {
+        log_number_known_ = true;
+        log_number_ = log_number;
+      } else if (log_number != log_number_) {
+        // A record of the log that used this file before it was recycled.
+        buffer_.clear();
+        eof_ = true;
+        return kEof;
+      }
+      recyclable_ = true;
+    }
+
+    buffer_.remove_prefix(header_size + length);
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + header_size, length);
     return type;
   }
 }
@@ -43,6 +43,14 @@ class Reader {
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
          uint64_t initial_offset);
 
+  // Like the above, for reading the log file numbered "log_number".  Records
+  // in the recyclable format (see log_format.h) that are tagged with another
+  // log number are left over from an older log file that was recycled, and
+  // mark the end of the log.  The constructor above takes the log number
+  // of the first recyclable record it reads instead.
+  Reader(SequentialFile* file, Reporter* reporter, bool checksum,
+         uint64_t initial_offset, uint64_t log_number);
+
   Reader(const Reader&) = delete;
   Reader& operator=(const Reader&) = delete;
 
@@ -60,6 +68,11 @@ class Reader {
   // Undefined before the first call to ReadRecord.
   uint64_t LastRecordOffset();
 
+  // Returns true if the records read so far are in the recyclable format.
+  // Past its last record, such a log file may hold leftover data from its
+  // previous use, so it must not be appended to.
+  bool recyclable() const { return recyclable_; }
+
  private:
   // Extend record types with the following special values
   enum {
@@ -104,6 +117,15 @@ class Reader {
   // particular, a run of kMiddleType and kLastType records can be silently
   // skipped in this mode
   bool resyncing_;
+
+  // Number of the log file (only its low 32 bits are stored in records)
+  bool log_number_known_;
+  uint32_t log_number_;
+
+  // True once a valid record in the recyclable format has been read.  The
+  // first invalid record of such a log is taken to be its end, since it
+  // may be leftover data from the previous use of a recycled file.
+  bool recyclable_;
 };
 
 }  // namespace log
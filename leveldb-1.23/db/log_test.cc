@@ -54,6 +54,19 @@ class LogTest : public testing::Test {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  // Write the following records in the recyclable format for log
+  // "log_number", over what has been written so far, as if the file was
+  // recycled.
+  void RecycleLog(uint64_t log_number) {
+    delete writer_;
+    delete reader_;
+    recycled_contents_.swap(dest_.contents_);
+    dest_.contents_.clear();
+    writer_ = new Writer(&dest_, 0, log_number);
+    reader_ = new Reader(&source_, &report_, true /*checksum*/,
+                         0 /*initial_offset*/, log_number);
+  }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
@@ -64,6 +77,11 @@ class LogTest : public testing::Test {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (dest_.contents_.size() < recycled_contents_.size()) {
+        // The rest of the recycled file is left as it was.
+        dest_.contents_.append(recycled_contents_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
@@ -228,6 +246,7 @@ class LogTest : public testing::Test {
   static int num_initial_offset_records_;
 
   StringDest dest_;
+  std::string recycled_contents_;
   StringSource source_;
   ReportCollector report_;
   bool reading_;
@@ -514,6 +533,64 @@ TEST_F(LogTest, ErrorJoinsRecords) {
   ASSERT_GE(dropped, 2 * kBlockSize);
 }
 
+TEST_F(LogTest, RecyclableReadWrite) {
+  RecycleLog(1);
+  Write("foo");
+  Write("");
+  Write(BigString("bar", 100000));
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(BigString("bar", 100000), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, RecyclableTrailer) {
+  // Leave fewer bytes than a recyclable header, but as many as a
+  // legacy one, at the end of the block.
+  RecycleLog(1);
+  const int n = kBlockSize - 2 * kRecyclableHeaderSize + 4;
+  Write(BigString("foo", n));
+  ASSERT_EQ(kBlockSize - kRecyclableHeaderSize + 4, WrittenBytes());
+  Write("bar");
+  ASSERT_EQ(BigString("foo", n), Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, RecycledTailIsIgnored) {
+  RecycleLog(1);
+  for (int i = 0; i < 100; i++) {
+    Write(NumberString(i));
+  }
+  Write(BigString("old", 3 * kBlockSize));
+  RecycleLog(2);
+  Write("foo");
+  Write(BigString("bar", kBlockSize));
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", kBlockSize), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST_F(LogTest, RecycledTornRecordIsIgnored) {
+  RecycleLog(1);
+  Write(BigString("old", 3 * kBlockSize));
+  RecycleLog(2);
+  Write("foo");
+  Write(BigString("bar", 1000));
+  // The writer died in the middle of the last record: what follows it is
+  // left over from the previous use of the file.
+  ShrinkSize(100);
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+  ASSERT_EQ("", ReportMessage());
+}
+
 TEST_F(LogTest, ReadStart) { CheckInitialOffsetRecord(0, 0); }
 
 TEST_F(LogTest, ReadSecondOneOff) { CheckInitialOffsetRecord(1, 1); }
@@ -20,12 +20,24 @@ static void InitTypeCrc(uint32_t* type_crc) {
   }
 }
 
-Writer::Writer(WritableFile* dest) : dest_(dest), block_offset_(0) {
+Writer::Writer(WritableFile* dest)
+    : dest_(dest), block_offset_(0), recyclable_(false), log_number_(0) {
   InitTypeCrc(type_crc_);
 }
 
 Writer::Writer(WritableFile* dest, uint64_t dest_length)
-    : dest_(dest), block_offset_(dest_length % kBlockSize) {
+    : dest_(dest),
+      block_offset_(dest_length % kBlockSize),
+      recyclable_(false),
+      log_number_(0) {
+  InitTypeCrc(type_crc_);
+}
+
+Writer::Writer(WritableFile* dest, uint64_t dest_length, uint64_t log_number)
+    : dest_(dest),
+      block_offset_(dest_length % kBlockSize),
+      recyclable_(true),
+      log_number_(static_cast<uint32_t>(log_number)) {
   InitTypeCrc(type_crc_);
 }
 
@@ -40,23 +52,26 @@ Status Writer::AddRecord(const Slice& slice) {
   // zero-length record
   Status s;
   bool begin = true;
+  const int header_size = recyclable_ ? kRecyclableHeaderSize : kHeaderSize;
   do {
     const int leftover = kBlockSize - block_offset_;
     assert(leftover >= 0);
-    if (leftover < kHeaderSize) {
+    if (leftover < header_size) {
       // Switch to a new block
       if (leftover > 0) {
-        // Fill the trailer (literal below relies on kHeaderSize being 7)
-        static_assert(kHeaderSize == 7, "");
-        dest_->Append(Slice("\x00\x00\x00\x00\x00\x00", leftover));
+        // Fill the trailer (literal below relies on kRecyclableHeaderSize
+        // being 11)
+        static_assert(kRecyclableHeaderSize == 11, "");
+        dest_->Append(
+            Slice("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", leftover));
       }
       block_offset_ = 0;
     }
 
-    // Invariant: we never leave < kHeaderSize bytes in a block.
-    assert(kBlockSize - block_offset_ - kHeaderSize >= 0);
+    // Invariant: we never leave < header_size bytes in a block.
+    assert(kBlockSize - block_offset_ - header_size >= 0);
 
-    const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+    const size_t avail = kBlockSize - block_offset_ - header_size;
     const size_t fragment_length = (left < avail) ? left : avail;
 
     RecordType type;
@@ -70,6 +85,9 @@ Status Writer::AddRecord(const Slice& slice) {
     } else {
       type = kMiddleType;
     }
+    if (recyclable_) {
+      type = static_cast<RecordType>(type + kRecyclableFullType - kFullType);
+    }
 
     s = EmitPhysicalRecord(type, ptr, fragment_length);
     ptr += fragment_length;
@@ -81,29 +99,36 @@ Status Writer::AddRecord(const Slice& slice) {
 
 Status Writer::EmitPhysicalRecord(RecordType t, const char* ptr,
                                   size_t length) {
+  const int header_size = recyclable_ ? kRecyclableHeaderSize : kHeaderSize;
   assert(length <= 0xffff);  // Must fit in two bytes
-  assert(block_offset_ + kHeaderSize + length <= kBlockSize);
+  assert(block_offset_ + header_size + length <= kBlockSize);
 
   // Format the header
-  char buf[kHeaderSize];
+  char buf[kRecyclableHeaderSize];
   buf[4] = static_cast<char>(length & 0xff);
   buf[5] = static_cast<char>(length >> 8);
   buf[6] = static_cast<char>(t);
 
-  // Compute the crc of the record type and the payload.
-  uint32_t crc = crc32c::Extend(type_crc_[t], ptr, length);
+  // Compute the crc of the record type, the log number (if any) and the
+  // payload.
+  uint32_t crc = type_crc_[t];
+  if (recyclable_) {
+    EncodeFixed32(buf + kHeaderSize, log_number_);
+    crc = crc32c::Extend(crc, buf + kHeaderSize, header_size - kHeaderSize);
+  }
+  crc = crc32c::Extend(crc, ptr, length);
   crc = crc32c::Mask(crc);  // Adjust for storage
   EncodeFixed32(buf, crc);
 
   // Write the header and the payload
-  Status s = dest_->Append(Slice(buf, kHeaderSize));
+  Status s = dest_->Append(Slice(buf, header_size));
   if (s.ok()) {
     s = dest_->Append(Slice(ptr, length));
     if (s.ok()) {
       s = dest_->Flush();
     }
   }
-  block_offset_ += kHeaderSize + length;
+  block_offset_ += header_size + length;
   return s;
 }
 
@@ -29,6 +29,13 @@ class Writer {
   // "*dest" must remain live while this Writer is in use.
   Writer(WritableFile* dest, uint64_t dest_length);
 
+  // Create a writer that will write records in the recyclable format,
+  // tagged with "log_number", to "*dest".  "*dest" must have initial
+  // length "dest_length", but may hold leftover data from an older log
+  // file past that offset, which readers of this log will ignore.
+  // "*dest" must remain live while this Writer is in use.
+  Writer(WritableFile* dest, uint64_t dest_length, uint64_t log_number);
+
   Writer(const Writer&) = delete;
   Writer& operator=(const Writer&) = delete;
 
@@ -41,6 +48,8 @@ class Writer {
 
   WritableFile* dest_;
   int block_offset_;  // Current offset in block
+  const bool recyclable_;
+  const uint32_t log_number_;  // Only used by the recyclable format
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
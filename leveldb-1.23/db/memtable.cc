@@ -4,10 +4,12 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -19,9 +21,39 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      num_range_dels_(0),
+      fragmented_(nullptr),
+      fragmented_range_dels_(0) {}
 
-MemTable::~MemTable() { assert(refs_ == 0); }
+// A RangeTombstoneList shared by the memtable and the readers of its
+// tombstones, which the memtable replaces when tombstones are added.
+class MemTable::FragmentedTombstones : public RangeTombstoneList {
+ public:
+  explicit FragmentedTombstones(const Comparator* user_comparator)
+      : RangeTombstoneList(user_comparator), refs_(1) {}
+
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+
+  void Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+ private:
+  std::atomic<int> refs_;
+};
+
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  if (fragmented_ != nullptr) {
+    fragmented_->Unref();
+  }
+}
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
@@ -73,20 +105,26 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
-void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
-                   const Slice& value) {
-  // Format of an entry is concatenation of:
-  //  key_size     : varint32 of internal_key.size()
-  //  key bytes    : char[internal_key.size()]
-  //  value_size   : varint32 of value.size()
-  //  value bytes  : char[value.size()]
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
+// Format of an entry is concatenation of:
+//  key_size     : varint32 of internal_key.size()
+//  key bytes    : char[internal_key.size()]
+//  value_size   : varint32 of value.size()
+//  value bytes  : char[value.size()]
+static size_t EncodedEntryLength(const Slice& key, const Slice& value) {
+  size_t internal_key_size = key.size() + 8;
+  return VarintLength(internal_key_size) + internal_key_size +
+         VarintLength(value.size()) + value.size();
+}
+
+static void EncodeEntry(char* buf, size_t encoded_len, SequenceNumber s,
+                        ValueType type, const Slice& key, const Slice& value) {
   size_t key_size = key.size();
   size_t val_size = value.size();
   size_t internal_key_size = key_size + 8;
-  const size_t encoded_len = VarintLength(internal_key_size) +
-                             internal_key_size + VarintLength(val_size) +
-                             val_size;
-  char* buf = arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -95,10 +133,86 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value) {
+  if (type == kTypeRangeDeletion &&
+      comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+    return;
+  }
+  const size_t encoded_len = EncodedEntryLength(key, value);
+  char* buf = arena_.Allocate(encoded_len);
+  EncodeEntry(buf, encoded_len, s, type, key, value);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+    num_range_dels_.fetch_add(1, std::memory_order_release);
+  } else {
+    table_.Insert(buf);
+  }
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  if (type == kTypeRangeDeletion &&
+      comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+    return;
+  }
+  const size_t encoded_len = EncodedEntryLength(key, value);
+  char* buf = arena_.AllocateConcurrently(encoded_len);
+  EncodeEntry(buf, encoded_len, s, type, key, value);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.InsertConcurrently(buf);
+    num_range_dels_.fetch_add(1, std::memory_order_release);
+  } else {
+    table_.InsertConcurrently(buf);
+  }
+}
+
+const RangeTombstoneList* MemTable::RefRangeTombstones() {
+  // The tombstones counted here are all in range_del_table_.
+  const int num_range_dels = num_range_dels_.load(std::memory_order_acquire);
+  if (num_range_dels == 0) {
+    return nullptr;
+  }
+  MutexLock l(&fragmented_mutex_);
+  if (fragmented_range_dels_ < num_range_dels) {
+    FragmentedTombstones* list =
+        new FragmentedTombstones(comparator_.comparator.user_comparator());
+    Iterator* iter = NewRangeTombstoneIterator();
+    Status s = list->AddAll(iter);
+    assert(s.ok());  // The memtable only holds well-formed tombstones
+    (void)s;
+    delete iter;
+    list->Finish();
+    if (fragmented_ != nullptr) {
+      fragmented_->Unref();
+    }
+    fragmented_ = list;
+    fragmented_range_dels_ = num_range_dels;
+  }
+  fragmented_->Ref();
+  return fragmented_;
+}
+
+void MemTable::UnrefRangeTombstones(const RangeTombstoneList* list) {
+  const_cast<FragmentedTombstones*>(
+      static_cast<const FragmentedTombstones*>(list))
+      ->Unref();
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+
+  // Find the newest tombstone visible at the snapshot that covers key.
+  SequenceNumber max_covering_tombstone_seq = 0;
+  const RangeTombstoneList* tombstones = RefRangeTombstones();
+  if (tombstones != nullptr) {
+    max_covering_tombstone_seq =
+        tombstones->MaxCoveringSequence(key.user_key(), key.sequence());
+    UnrefRangeTombstones(tombstones);
+  }
+
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
@@ -115,10 +229,13 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
-    if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
+    if (ucmp->Compare(Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      if ((tag >> 8) < max_covering_tombstone_seq) {
+        *s = Status::NotFound(Slice());
+        return true;
+      }
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
           Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
@@ -126,11 +243,17 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
           return true;
         }
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           *s = Status::NotFound(Slice());
           return true;
       }
     }
   }
+  if (max_covering_tombstone_seq > 0) {
+    // Older memtables and tables only hold older entries for key.
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
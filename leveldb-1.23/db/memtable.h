@@ -5,17 +5,21 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
 
 #include "db/dbformat.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class RangeTombstoneList;
 
 class MemTable {
  public:
@@ -50,15 +54,43 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones of the memtable, which
+  // NewIterator() does not yield.  Its keys are the internal keys of the
+  // starts of the ranges and its values are the user keys at which the
+  // ranges end.
+  //
+  // The caller must ensure that the underlying MemTable remains live
+  // while the returned iterator is live.
+  Iterator* NewRangeTombstoneIterator();
+
+  // Return the range tombstones of the memtable, fragmented, or null if
+  // there are none.  The list is rebuilt only after tombstones have been
+  // added.  A non-null result must be released with
+  // UnrefRangeTombstones(), and holds the tombstones added before the
+  // call (it may hold newer ones as well).
+  const RangeTombstoneList* RefRangeTombstones();
+
+  // Release a list returned by RefRangeTombstones().  May be called after
+  // the memtable is deleted.
+  static void UnrefRangeTombstones(const RangeTombstoneList* list);
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
   // Typically value will be empty if type==kTypeDeletion.
+  // If type==kTypeRangeDeletion, the entry is the range tombstone
+  // [key,value); empty ranges are dropped.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called by several threads at the same time.
+  // REQUIRES: Add() is not running concurrently.
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone that
+  // covers key and is newer than the newest entry for key, store a
+  // NotFound() error in *status and return true.
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
 
@@ -66,6 +98,8 @@ class MemTable {
   friend class MemTableIterator;
   friend class MemTableBackwardIterator;
 
+  class FragmentedTombstones;
+
   struct KeyComparator {
     const InternalKeyComparator comparator;
     explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
@@ -80,6 +114,14 @@ class MemTable {
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;
+  std::atomic<int> num_range_dels_;  // Tombstones in range_del_table_
+
+  // Fragmented range_del_table_ as of its first fragmented_range_dels_
+  // tombstones, or null if it has not been built yet.
+  port::Mutex fragmented_mutex_;
+  FragmentedTombstones* fragmented_ GUARDED_BY(fragmented_mutex_);
+  int fragmented_range_dels_ GUARDED_BY(fragmented_mutex_);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,173 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+struct UserKeyEqual {
+  const Comparator* ucmp;
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) == 0;
+  }
+};
+}  // namespace
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : ucmp_(user_comparator) {}
+
+void RangeTombstoneList::Add(const Slice& start, const Slice& end,
+                             SequenceNumber seq) {
+  if (ucmp_->Compare(start, end) >= 0) {
+    return;
+  }
+  Tombstone t;
+  t.start = start.ToString();
+  t.end = end.ToString();
+  t.seq = seq;
+  tombstones_.push_back(t);
+}
+
+Status RangeTombstoneList::AddAll(Iterator* iter) {
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::AddList(const RangeTombstoneList& other) {
+  tombstones_.insert(tombstones_.end(), other.tombstones_.begin(),
+                     other.tombstones_.end());
+}
+
+void RangeTombstoneList::Finish() {
+  fragments_.clear();
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  // Every start and end of a tombstone starts a new fragment.
+  std::vector<std::string> boundaries;
+  boundaries.reserve(2 * tombstones_.size());
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    boundaries.push_back(tombstones_[i].start);
+    boundaries.push_back(tombstones_[i].end);
+  }
+  UserKeyLess less;
+  less.ucmp = ucmp_;
+  UserKeyEqual equal;
+  equal.ucmp = ucmp_;
+  std::sort(boundaries.begin(), boundaries.end(), less);
+  boundaries.erase(std::unique(boundaries.begin(), boundaries.end(), equal),
+                   boundaries.end());
+
+  // seqs[i] lists the tombstones covering [boundaries[i],boundaries[i+1]).
+  std::vector<std::vector<SequenceNumber>> seqs(boundaries.size() - 1);
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    const Tombstone& t = tombstones_[i];
+    size_t b = std::lower_bound(boundaries.begin(), boundaries.end(), t.start,
+                                less) -
+               boundaries.begin();
+    for (; ucmp_->Compare(boundaries[b], t.end) < 0; b++) {
+      seqs[b].push_back(t.seq);
+    }
+  }
+
+  for (size_t b = 0; b + 1 < boundaries.size(); b++) {
+    if (seqs[b].empty()) {
+      continue;  // A gap between tombstones
+    }
+    std::sort(seqs[b].begin(), seqs[b].end(), std::greater<SequenceNumber>());
+    seqs[b].erase(std::unique(seqs[b].begin(), seqs[b].end()), seqs[b].end());
+    Fragment f;
+    f.start = boundaries[b];
+    f.end = boundaries[b + 1];
+    f.seqs.swap(seqs[b]);
+    fragments_.push_back(f);
+  }
+}
+
+size_t RangeTombstoneList::FindFragment(const Slice& user_key) const {
+  // Find the last fragment that starts at or before user_key.
+  size_t left = 0;
+  size_t right = fragments_.size();
+  while (left < right) {
+    const size_t mid = (left + right) / 2;
+    if (ucmp_->Compare(fragments_[mid].start, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0 || ucmp_->Compare(user_key, fragments_[left - 1].end) >= 0) {
+    return fragments_.size();
+  }
+  return left - 1;
+}
+
+// Return the largest sequence number in "seqs" that is <= snapshot, or
+// zero if there is none.
+static SequenceNumber NewestVisible(const std::vector<SequenceNumber>& seqs,
+                                    SequenceNumber snapshot) {
+  for (size_t i = 0; i < seqs.size(); i++) {
+    if (seqs[i] <= snapshot) {
+      return seqs[i];
+    }
+  }
+  return 0;
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  const size_t index = FindFragment(user_key);
+  if (index == fragments_.size()) {
+    return 0;
+  }
+  return NewestVisible(fragments_[index].seqs, snapshot);
+}
+
+bool RangeTombstoneList::CoversRange(const Slice& smallest,
+                                     const Slice& largest,
+                                     SequenceNumber after,
+                                     SequenceNumber snapshot) const {
+  size_t index = FindFragment(smallest);
+  if (index == fragments_.size()) {
+    return false;
+  }
+  while (true) {
+    const Fragment& f = fragments_[index];
+    if (NewestVisible(f.seqs, snapshot) <= after) {
+      return false;
+    }
+    if (ucmp_->Compare(largest, f.end) < 0) {
+      return true;
+    }
+    index++;
+    if (index == fragments_.size() ||
+        ucmp_->Compare(fragments_[index].start, f.end) != 0) {
+      return false;  // There is a gap at f.end
+    }
+  }
+}
+
+}  // namespace leveldb
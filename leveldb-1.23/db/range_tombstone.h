@@ -0,0 +1,97 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RangeTombstoneList holds the range tombstones written by
+// WriteBatch::DeleteRange() to one or more memtables and tables.  A
+// tombstone [start,end)@seq deletes the entries for the user keys in
+// [start,end) that have sequence numbers smaller than seq.
+//
+// Once Finish() has been called, the tombstones are split at each other's
+// boundaries into fragments, each of which is covered by the same set of
+// tombstones, so that the tombstones covering a user key can be found
+// with a binary search.
+//
+// A RangeTombstoneList is not thread-safe while tombstones are being added.
+// Once Finish() has been called, its const methods may be called
+// concurrently.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+class RangeTombstoneList {
+ public:
+  // A maximal range of user keys that is covered by the same tombstones.
+  struct Fragment {
+    std::string start;
+    std::string end;  // Exclusive
+    std::vector<SequenceNumber> seqs;  // Of the tombstones, newest first
+  };
+
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  RangeTombstoneList(const RangeTombstoneList&) = delete;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  // Add the tombstone [start,end)@seq.  Empty ranges are ignored.
+  void Add(const Slice& start, const Slice& end, SequenceNumber seq);
+
+  // Add the tombstones yielded by "iter", whose keys are the internal keys
+  // (of type kTypeRangeDeletion) of the starts of the ranges and whose
+  // values are the user keys at which the ranges end.  Does not take
+  // ownership of "iter".
+  Status AddAll(Iterator* iter);
+
+  // Add the tombstones of "other".
+  void AddList(const RangeTombstoneList& other);
+
+  // Split the tombstones added so far into fragments.
+  void Finish();
+
+  bool empty() const { return tombstones_.empty(); }
+
+  // Return the largest sequence number <= snapshot of the tombstones that
+  // cover "user_key", or zero if there is none.
+  // REQUIRES: Finish() has been called since the last tombstone was added.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Returns true iff every user key in [smallest,largest] is covered by a
+  // tombstone whose sequence number is in (after,snapshot].
+  // REQUIRES: Finish() has been called since the last tombstone was added.
+  bool CoversRange(const Slice& smallest, const Slice& largest,
+                   SequenceNumber after, SequenceNumber snapshot) const;
+
+  // Return the non-empty fragments, in increasing key order.
+  // REQUIRES: Finish() has been called since the last tombstone was added.
+  const std::vector<Fragment>& fragments() const { return fragments_; }
+
+ private:
+  struct Tombstone {
+    std::string start;
+    std::string end;
+    SequenceNumber seq;
+  };
+
+  // Return the index of the fragment that holds "user_key", or
+  // fragments_.size() if there is none.
+  size_t FindFragment(const Slice& user_key) const;
+
+  const Comparator* const ucmp_;
+  std::vector<Tombstone> tombstones_;
+  std::vector<Fragment> fragments_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
@@ -0,0 +1,107 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+class RangeTombstoneTest : public testing::Test {
+ public:
+  RangeTombstoneTest() : list_(BytewiseComparator()) {}
+
+  SequenceNumber Covering(const char* key, SequenceNumber snapshot) {
+    return list_.MaxCoveringSequence(key, snapshot);
+  }
+
+  RangeTombstoneList list_;
+};
+
+TEST_F(RangeTombstoneTest, Empty) {
+  list_.Finish();
+  ASSERT_TRUE(list_.empty());
+  ASSERT_EQ(0, Covering("a", kMaxSequenceNumber));
+  ASSERT_FALSE(list_.CoversRange("a", "b", 0, kMaxSequenceNumber));
+}
+
+TEST_F(RangeTombstoneTest, EmptyRangeIgnored) {
+  list_.Add("c", "c", 5);
+  list_.Add("d", "a", 5);
+  list_.Finish();
+  ASSERT_TRUE(list_.empty());
+  ASSERT_EQ(0, Covering("c", kMaxSequenceNumber));
+}
+
+TEST_F(RangeTombstoneTest, Single) {
+  list_.Add("b", "d", 5);
+  list_.Finish();
+  ASSERT_EQ(0, Covering("a", kMaxSequenceNumber));
+  ASSERT_EQ(5, Covering("b", kMaxSequenceNumber));
+  ASSERT_EQ(5, Covering("c", kMaxSequenceNumber));
+  ASSERT_EQ(0, Covering("d", kMaxSequenceNumber));  // End is exclusive
+  ASSERT_EQ(0, Covering("c", 4));                   // Not visible
+  ASSERT_EQ(5, Covering("c", 5));
+}
+
+TEST_F(RangeTombstoneTest, Overlapping) {
+  list_.Add("a", "e", 3);
+  list_.Add("c", "g", 7);
+  list_.Add("x", "z", 9);
+  list_.Finish();
+
+  const std::vector<RangeTombstoneList::Fragment>& f = list_.fragments();
+  ASSERT_EQ(4, f.size());
+  ASSERT_EQ("a", f[0].start);
+  ASSERT_EQ("c", f[0].end);
+  ASSERT_EQ(1, f[0].seqs.size());
+  ASSERT_EQ("c", f[1].start);
+  ASSERT_EQ("e", f[1].end);
+  ASSERT_EQ(2, f[1].seqs.size());
+  ASSERT_EQ(7, f[1].seqs[0]);
+  ASSERT_EQ(3, f[1].seqs[1]);
+  ASSERT_EQ("e", f[2].start);
+  ASSERT_EQ("g", f[2].end);
+  ASSERT_EQ("x", f[3].start);  // The gap [g,x) has no fragment
+
+  ASSERT_EQ(3, Covering("b", kMaxSequenceNumber));
+  ASSERT_EQ(7, Covering("d", kMaxSequenceNumber));
+  ASSERT_EQ(3, Covering("d", 6));
+  ASSERT_EQ(7, Covering("f", kMaxSequenceNumber));
+  ASSERT_EQ(0, Covering("h", kMaxSequenceNumber));
+  ASSERT_EQ(9, Covering("y", kMaxSequenceNumber));
+}
+
+TEST_F(RangeTombstoneTest, CoversRange) {
+  list_.Add("a", "e", 3);
+  list_.Add("c", "g", 7);
+  list_.Add("x", "z", 9);
+  list_.Finish();
+
+  ASSERT_TRUE(list_.CoversRange("a", "f", 2, kMaxSequenceNumber));
+  ASSERT_FALSE(list_.CoversRange("a", "f", 3, kMaxSequenceNumber));
+  ASSERT_TRUE(list_.CoversRange("c", "f", 6, kMaxSequenceNumber));
+  ASSERT_FALSE(list_.CoversRange("c", "f", 6, 6));
+  ASSERT_FALSE(list_.CoversRange("a", "g", 2, kMaxSequenceNumber));
+  ASSERT_FALSE(list_.CoversRange("f", "y", 2, kMaxSequenceNumber));
+  ASSERT_TRUE(list_.CoversRange("x", "y", 8, kMaxSequenceNumber));
+}
+
+TEST_F(RangeTombstoneTest, AddList) {
+  RangeTombstoneList other(BytewiseComparator());
+  other.Add("m", "p", 4);
+  list_.Add("a", "c", 2);
+  list_.AddList(other);
+  list_.Finish();
+  ASSERT_EQ(2, list_.fragments().size());
+  ASSERT_EQ(4, Covering("n", kMaxSequenceNumber));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
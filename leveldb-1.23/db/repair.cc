@@ -28,6 +28,7 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
@@ -48,7 +49,7 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -171,7 +172,7 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false /*do not checksum*/,
-                       0 /*initial_offset*/);
+                       0 /*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
@@ -203,8 +204,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -281,6 +285,12 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+    if (status.ok()) {
+      RangeTombstoneList tombstones(icmp_.user_comparator());
+      status = table_cache_->AddRangeTombstones(t.meta.number,
+                                                t.meta.file_size, &tombstones);
+      AddRangeTombstoneBounds(&tombstones, &t, &empty);
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -291,6 +301,36 @@ class Repairer {
     }
   }
 
+  // Extend the bounds and the largest sequence number of t->meta to cover
+  // the range tombstones of its table, which are in *tombstones.  *empty
+  // is true iff the bounds of t->meta have not been set yet.
+  void AddRangeTombstoneBounds(RangeTombstoneList* tombstones, TableInfo* t,
+                               bool* empty) {
+    t->meta.has_range_deletions = !tombstones->empty();
+    if (tombstones->empty()) {
+      return;
+    }
+    tombstones->Finish();
+    const std::vector<RangeTombstoneList::Fragment>& fragments =
+        tombstones->fragments();
+    const InternalKey smallest(fragments.front().start, kMaxSequenceNumber,
+                               kValueTypeForSeek);
+    const InternalKey largest(fragments.back().end, kMaxSequenceNumber,
+                              kValueTypeForSeek);
+    if (*empty || icmp_.Compare(smallest, t->meta.smallest) < 0) {
+      t->meta.smallest = smallest;
+    }
+    if (*empty || icmp_.Compare(largest, t->meta.largest) > 0) {
+      t->meta.largest = largest;
+    }
+    *empty = false;
+    for (size_t i = 0; i < fragments.size(); i++) {
+      if (fragments[i].seqs[0] > t->max_sequence) {
+        t->max_sequence = fragments[i].seqs[0];
+      }
+    }
+  }
+
   void RepairTable(const std::string& src, TableInfo t) {
     // We will copy src contents to a new table and then rename the
     // new table over the source.
@@ -313,6 +353,23 @@ class Repairer {
     }
     delete iter;
 
+    // Copy the range tombstones, if they can be read.
+    RangeTombstoneList tombstones(icmp_.user_comparator());
+    table_cache_->AddRangeTombstones(t.meta.number, t.meta.file_size,
+                                     &tombstones);
+    bool empty = (counter == 0);
+    AddRangeTombstoneBounds(&tombstones, &t, &empty);
+    const std::vector<RangeTombstoneList::Fragment>& fragments =
+        tombstones.fragments();
+    for (size_t i = 0; i < fragments.size(); i++) {
+      for (size_t j = 0; j < fragments[i].seqs.size(); j++) {
+        const InternalKey start(fragments[i].start, fragments[i].seqs[j],
+                                kTypeRangeDeletion);
+        builder->AddRangeDeletion(start.Encode(), fragments[i].end);
+        counter++;
+      }
+    }
+
     ArchiveFile(src);
     if (counter == 0) {
       builder->Abandon();  // Nothing to save
@@ -368,8 +425,9 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+      FileMetaData meta = t.meta;
+      meta.largest_seq = t.max_sequence;
+      edit_.AddFile(0, meta);
     }
 
     // std::fprintf(stderr,
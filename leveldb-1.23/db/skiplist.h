@@ -8,7 +8,9 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Writes require external synchronization, most likely a mutex, with
+// one exception: InsertConcurrently() may be called by several threads
+// at the same time (but not concurrently with Insert()).
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -30,6 +32,8 @@
 #include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <functional>
+#include <thread>
 
 #include "util/arena.h"
 #include "util/random.h"
@@ -56,6 +60,13 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but safe to call from several threads at once.  Nodes
+  // are linked in with compare-and-swap, one level at a time from the
+  // bottom up.
+  // REQUIRES: nothing that compares equal to key is in the list or is
+  // being inserted by another thread.
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -106,7 +117,9 @@ class SkipList {
   }
 
   Node* NewNode(const Key& key, int height);
+  Node* NewNodeConcurrently(const Key& key, int height);
   int RandomHeight();
+  int RandomHeightConcurrently();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -119,6 +132,11 @@ class SkipList {
   // node at "level" for every level in [0..max_height_-1].
   Node* FindGreaterOrEqual(const Key& key, Node** prev) const;
 
+  // Advance *before along "level" to the last node with a key < key,
+  // and store its successor in *after.
+  void FindSpliceForLevel(const Key& key, int level, Node** before,
+                          Node** after) const;
+
   // Return the latest node with a key < key.
   // Return head_ if there is no such node.
   Node* FindLessThan(const Key& key) const;
@@ -133,8 +151,8 @@ class SkipList {
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
   std::atomic<int> max_height_;  // Height of the entire list
 
   // Read/written only by Insert().
@@ -173,6 +191,15 @@ struct SkipList<Key, Comparator>::Node {
     next_[n].store(x, std::memory_order_relaxed);
   }
 
+  // Set the link to x iff it currently equals expected.  Like SetNext(),
+  // publishes x with release semantics.
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   std::atomic<Node*> next_[1];
@@ -186,6 +213,14 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
   return new (node_memory) Node(key);
 }
 
+template <typename Key, class Comparator>
+typename SkipList<Key, Comparator>::Node*
+SkipList<Key, Comparator>::NewNodeConcurrently(const Key& key, int height) {
+  char* const node_memory = arena_->AllocateAlignedConcurrently(
+      sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
+  return new (node_memory) Node(key);
+}
+
 template <typename Key, class Comparator>
 inline SkipList<Key, Comparator>::Iterator::Iterator(const SkipList* list) {
   list_ = list;
@@ -251,6 +286,22 @@ int SkipList<Key, Comparator>::RandomHeight() {
   return height;
 }
 
+template <typename Key, class Comparator>
+int SkipList<Key, Comparator>::RandomHeightConcurrently() {
+  // rnd_ belongs to Insert(), so every inserting thread draws from a
+  // generator of its own.
+  static thread_local Random rnd(static_cast<uint32_t>(
+      std::hash<std::thread::id>()(std::this_thread::get_id())));
+  static const unsigned int kBranching = 4;
+  int height = 1;
+  while (height < kMaxHeight && ((rnd.Next() % kBranching) == 0)) {
+    height++;
+  }
+  assert(height > 0);
+  assert(height <= kMaxHeight);
+  return height;
+}
+
 template <typename Key, class Comparator>
 bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   // null n is considered infinite
@@ -280,6 +331,23 @@ SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key,
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(const Key& key, int level,
+                                                   Node** before,
+                                                   Node** after) const {
+  Node* x = *before;
+  while (true) {
+    Node* next = x->Next(level);
+    if (KeyIsAfterNode(key, next)) {
+      x = next;
+    } else {
+      *before = x;
+      *after = next;
+      return;
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node*
 SkipList<Key, Comparator>::FindLessThan(const Key& key) const {
@@ -367,6 +435,49 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(const Key& key) {
+  const int height = RandomHeightConcurrently();
+
+  // Raise max_height_ if needed.  The same reasoning as in Insert()
+  // applies to readers that observe the new height early.
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    if (max_height_.compare_exchange_weak(max_height, height,
+                                          std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  // Find the splice for every level from the top down, reusing the
+  // predecessor at one level as the starting point for the next.
+  Node* prev[kMaxHeight];
+  Node* next[kMaxHeight];
+  Node* before = head_;
+  for (int i = kMaxHeight - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, i, &before, &next[i]);
+    prev[i] = before;
+  }
+
+  // Our data structure does not allow duplicate insertion
+  assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+  // Link in level 0 first so that the node is reachable in key order
+  // before it shows up in any higher level.  If another thread linked a
+  // node into the same gap, recompute the splice from prev[i], which
+  // still precedes key since nodes are never removed.
+  Node* x = NewNodeConcurrently(key, height);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      FindSpliceForLevel(key, i, &prev[i], &next[i]);
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 bool SkipList<Key, Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, nullptr);
@@ -365,6 +365,71 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+namespace {
+
+struct ConcurrentInsertState {
+  SkipList<Key, Comparator>* list;
+  int num_threads;
+  int keys_per_thread;
+  std::atomic<int> next_id;
+  std::atomic<int> done;
+};
+
+void ConcurrentInserter(void* arg) {
+  ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+  const int id = state->next_id.fetch_add(1);
+  Random rnd(1000 + id);
+  for (int i = 0; i < state->keys_per_thread; i++) {
+    // Disjoint key sets, inserted in a different random order per thread.
+    Key k = static_cast<Key>(rnd.Uniform(1 << 30)) * state->num_threads + id;
+    if (!state->list->Contains(k)) {
+      state->list->InsertConcurrently(k);
+    }
+  }
+  state->done.fetch_add(1);
+}
+
+}  // namespace
+
+TEST(SkipTest, InsertConcurrently) {
+  const int kThreads = 4;
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+
+  ConcurrentInsertState state;
+  state.list = &list;
+  state.num_threads = kThreads;
+  state.keys_per_thread = 5000;
+  state.next_id = 0;
+  state.done = 0;
+  for (int i = 0; i < kThreads; i++) {
+    Env::Default()->StartThread(ConcurrentInserter, &state);
+  }
+  while (state.done.load() < kThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  // Replay the same key sequences to build the expected contents.
+  std::set<Key> keys;
+  for (int id = 0; id < kThreads; id++) {
+    Random rnd(1000 + id);
+    for (int i = 0; i < state.keys_per_thread; i++) {
+      keys.insert(static_cast<Key>(rnd.Uniform(1 << 30)) * kThreads + id);
+    }
+  }
+
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (std::set<Key>::iterator it = keys.begin(); it != keys.end(); ++it) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(*it, iter.key());
+    ASSERT_TRUE(list.Contains(*it));
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,119 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& raw_options)
+      : icmp(raw_options.comparator),
+        ipolicy(raw_options.filter_policy, raw_options.prefix_extractor),
+        options(raw_options),
+        file(nullptr),
+        builder(nullptr),
+        file_size(0) {
+    // Build the table like DBImpl builds its own (see SanitizeOptions()).
+    options.comparator = &icmp;
+    options.filter_policy =
+        (raw_options.filter_policy != nullptr) ? &ipolicy : nullptr;
+    if (options.block_size < (1 << 10)) options.block_size = 1 << 10;
+    if (options.block_size > (4 << 20)) options.block_size = 4 << 20;
+  }
+
+  const InternalKeyComparator icmp;
+  const InternalFilterPolicy ipolicy;
+  Options options;
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // User key of the last entry added
+  uint64_t file_size;
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr) {
+    rep_->builder->Abandon();
+    delete rep_->builder;
+    delete rep_->file;
+  }
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  if (rep_->builder != nullptr) {
+    return Status::InvalidArgument("file already open", fname);
+  }
+  Status s = rep_->options.env->NewWritableFile(fname, &rep_->file);
+  if (s.ok()) {
+    rep_->builder = new TableBuilder(rep_->options, rep_->file);
+    rep_->last_key.clear();
+    rep_->file_size = 0;
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  if (rep_->builder == nullptr) {
+    return Status::InvalidArgument("no open file");
+  }
+  if (rep_->builder->NumEntries() > 0 &&
+      rep_->icmp.user_comparator()->Compare(key, rep_->last_key) <= 0) {
+    return Status::InvalidArgument(
+        "keys must be added in strictly increasing order", key);
+  }
+  // The sequence number of the entries is replaced when the file is
+  // ingested (see DB::IngestExternalFile()).
+  const ValueType type = deletion ? kTypeDeletion : kTypeValue;
+  std::string ikey;
+  AppendInternalKey(&ikey, ParsedInternalKey(key, 0, type));
+  rep_->builder->Add(ikey, value);
+  rep_->last_key.assign(key.data(), key.size());
+  rep_->file_size = rep_->builder->FileSize();
+  return rep_->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  if (rep_->builder == nullptr) {
+    return Status::InvalidArgument("no open file");
+  }
+  Status s;
+  if (rep_->builder->NumEntries() == 0) {
+    rep_->builder->Abandon();
+    s = Status::InvalidArgument("cannot create a file with no entries");
+  } else {
+    s = rep_->builder->Finish();
+    rep_->file_size = rep_->builder->FileSize();
+  }
+  if (s.ok()) {
+    s = rep_->file->Sync();
+  }
+  if (s.ok()) {
+    s = rep_->file->Close();
+  }
+  delete rep_->builder;
+  delete rep_->file;
+  rep_->builder = nullptr;
+  rep_->file = nullptr;
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const { return rep_->file_size; }
+
+}  // namespace leveldb
@@ -5,6 +5,7 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
@@ -14,12 +15,18 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  std::atomic<int>* mmap_slots;  // Returned a slot on deletion if non-null
+  RangeTombstoneList* tombstones;  // Null if the table has none
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->tombstones;
   delete tf->table;
   delete tf->file;
+  if (tf->mmap_slots != nullptr) {
+    tf->mmap_slots->fetch_add(1, std::memory_order_relaxed);
+  }
   delete tf;
 }
 
@@ -29,15 +36,45 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+static void ReleasePinnedValue(void* arg1, void* arg2) {
+  reinterpret_cast<std::atomic<int>*>(arg1)->fetch_sub(
+      1, std::memory_order_relaxed);
+}
+
+static void DeleteDirectFile(void* arg1, void* arg2) {
+  delete reinterpret_cast<RandomAccessFile*>(arg1);
+}
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(NewLRUCache(entries)),
+      mmap_slots_(options.max_mmap_files),
+      pinned_values_(0) {}
 
 TableCache::~TableCache() { delete cache_; }
 
+Status TableCache::OpenFile(const std::string& fname, RandomAccessFile** file,
+                            bool* mmapped) {
+  *mmapped = false;
+  if (options_.max_mmap_files < 0) {
+    return env_->NewRandomAccessFile(fname, file);
+  }
+  if (mmap_slots_.fetch_sub(1, std::memory_order_relaxed) > 0) {
+    *mmapped = true;
+  } else {
+    mmap_slots_.fetch_add(1, std::memory_order_relaxed);
+  }
+  Status s = env_->NewRandomAccessFileWithMmap(fname, *mmapped, file);
+  if (!s.ok() && *mmapped) {
+    mmap_slots_.fetch_add(1, std::memory_order_relaxed);
+    *mmapped = false;
+  }
+  return s;
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
   Status s;
@@ -49,26 +86,40 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
+    bool mmapped = false;
+    s = OpenFile(fname, &file, &mmapped);
     if (!s.ok()) {
       std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
+      if (OpenFile(old_fname, &file, &mmapped).ok()) {
         s = Status::OK();
       }
     }
     if (s.ok()) {
       s = Table::Open(options_, file, file_size, &table);
     }
+    RangeTombstoneList* tombstones = nullptr;
+    if (s.ok()) {
+      s = ReadRangeTombstones(table, &tombstones);
+      if (!s.ok()) {
+        delete table;
+        table = nullptr;
+      }
+    }
 
     if (!s.ok()) {
       assert(table == nullptr);
       delete file;
+      if (mmapped) {
+        mmap_slots_.fetch_add(1, std::memory_order_relaxed);
+      }
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
     } else {
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->mmap_slots = mmapped ? &mmap_slots_ : nullptr;
+      tf->tombstones = tombstones;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -97,15 +148,142 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewDirectIterator(const ReadOptions& options,
+                                        uint64_t file_number,
+                                        uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  RandomAccessFile* file = nullptr;
+  s = env_->NewDirectRandomAccessFile(TableFileName(dbname_, file_number),
+                                      &file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    if (env_->NewDirectRandomAccessFile(old_fname, &file).ok()) {
+      s = Status::OK();
+    }
+  }
+  if (!s.ok()) {
+    cache_->Release(handle);
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewReadaheadIterator(options, file);
+  result->RegisterCleanup(&DeleteDirectFile, file, nullptr);
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       Iterator** pinned) {
+  if (pinned != nullptr) {
+    *pinned = nullptr;
+  }
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->InternalGet(options, k, arg, handle_result, pinned);
+    if (pinned != nullptr && *pinned != nullptr) {
+      // The pinned block may point into the table file, so keep the
+      // table open until the block is released.
+      (*pinned)->RegisterCleanup(&UnrefEntry, cache_, handle);
+      pinned_values_.fetch_add(1, std::memory_order_relaxed);
+      (*pinned)->RegisterCleanup(&ReleasePinnedValue, &pinned_values_,
+                                 nullptr);
+    } else {
+      cache_->Release(handle);
+    }
+  }
+  return s;
+}
+
+bool TableCache::KeyMayMatch(uint64_t file_number, uint64_t file_size,
+                             const Slice& k) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, &handle).ok()) {
+    return true;
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  const bool result = t->FullFilterMayMatch(k);
+  cache_->Release(handle);
+  return result;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, int n, const Slice* keys,
+                            void* const* args,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&),
+                            Status* statuses) {
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    t->InternalMultiGet(options, n, keys, args, handle_result, statuses);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::ReadRangeTombstones(Table* table,
+                                       RangeTombstoneList** list) {
+  *list = nullptr;
+  Iterator* iter = table->NewRangeTombstoneIterator();
+  if (iter == nullptr) {
+    return Status::OK();
+  }
+  // The tables of a DB are opened with its InternalKeyComparator.
+  *list = new RangeTombstoneList(
+      static_cast<const InternalKeyComparator*>(options_.comparator)
+          ->user_comparator());
+  Status s = (*list)->AddAll(iter);
+  delete iter;
+  if (s.ok()) {
+    (*list)->Finish();
+  } else {
+    delete *list;
+    *list = nullptr;
+  }
+  return s;
+}
+
+Status TableCache::AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                                      RangeTombstoneList* list) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* tombstones =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->tombstones;
+    if (tombstones != nullptr) {
+      list->AddList(*tombstones);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MaxCoveringTombstoneSequence(uint64_t file_number,
+                                                uint64_t file_size,
+                                                const Slice& user_key,
+                                                SequenceNumber snapshot,
+                                                SequenceNumber* seq) {
+  *seq = 0;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* tombstones =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->tombstones;
+    if (tombstones != nullptr) {
+      *seq = tombstones->MaxCoveringSequence(user_key, snapshot);
+    }
     cache_->Release(handle);
   }
   return s;
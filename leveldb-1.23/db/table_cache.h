@@ -7,6 +7,7 @@
 #ifndef STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 
@@ -18,6 +19,7 @@
 namespace leveldb {
 
 class Env;
+class RangeTombstoneList;
 
 class TableCache {
  public:
@@ -34,22 +36,82 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
                         uint64_t file_size, Table** tableptr = nullptr);
 
+  // Like NewIterator(), but the data blocks are read from a file of the
+  // iterator's own, opened with Env::NewDirectRandomAccessFile(), through a
+  // readahead window of options.readahead_size bytes.  The table itself
+  // (index and filter) is still found in or loaded into the cache.
+  Iterator* NewDirectIterator(const ReadOptions& options, uint64_t file_number,
+                              uint64_t file_size);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
+  //
+  // If "pinned" is non-null and an entry was found, *pinned is set to an
+  // iterator that keeps found_key and found_value (and the table) alive
+  // until the caller deletes it.  Otherwise *pinned is set to nullptr.
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             Iterator** pinned = nullptr);
+
+  // Get() for each of keys[0,n-1], which must be in increasing order,
+  // passing args[i] to handle_result for keys[i].  Stores the status of
+  // each lookup in statuses[i].  Returns a non-OK status (and leaves
+  // statuses untouched) if the table could not be opened.
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, int n, const Slice* keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&),
+                  Status* statuses);
+
+  // Returns false if the full filter of the specified file rules out that
+  // it holds internal key "k".  Returns true if the file cannot be opened,
+  // leaving the error to be reported by the readers of the file.
+  bool KeyMayMatch(uint64_t file_number, uint64_t file_size, const Slice& k);
+
+  // Add the range tombstones of the specified file to *list.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            RangeTombstoneList* list);
+
+  // Set *seq to the largest sequence number <= snapshot of the range
+  // tombstones of the specified file that cover "user_key", or to zero if
+  // there is none.
+  Status MaxCoveringTombstoneSequence(uint64_t file_number, uint64_t file_size,
+                                      const Slice& user_key,
+                                      SequenceNumber snapshot,
+                                      SequenceNumber* seq);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Number of iterators returned through the "pinned" argument of Get()
+  // that have not been deleted yet.
+  int NumPinnedValues() const {
+    return pinned_values_.load(std::memory_order_relaxed);
+  }
+
  private:
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
 
+  // Sets *list to the range tombstones of "table", or to nullptr if it has
+  // none.
+  Status ReadRangeTombstones(Table* table, RangeTombstoneList** list);
+
+  // Opens "fname", memory-mapping it if Options::max_mmap_files allows.
+  // Sets *mmapped to true iff a mapping slot was taken for the file.
+  Status OpenFile(const std::string& fname, RandomAccessFile** file,
+                  bool* mmapped);
+
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+
+  // Number of files that may still be memory-mapped if
+  // Options::max_mmap_files is non-negative.
+  std::atomic<int> mmap_slots_;
+
+  std::atomic<int> pinned_values_;
 };
 
 }  // namespace leveldb
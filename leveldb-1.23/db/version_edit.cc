@@ -20,9 +20,21 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  // A kNewFile entry followed by the newest write time of the file.  Only
+  // used for files whose write time is known, so that other descriptors
+  // stay readable by older releases.
+  kNewFileWithWriteTime = 10,
+  // A kNewFileWithWriteTime entry followed by the largest sequence number
+  // of the file and a varint32 of flags (see kFileHasRangeDeletions).
+  // Only used for files whose largest sequence number is known or that
+  // hold range tombstones.
+  kNewFileWithSequence = 11
 };
 
+// Flag of kNewFileWithSequence entries set for files with range tombstones.
+static const uint32_t kFileHasRangeDeletions = 1;
+
 void VersionEdit::Clear() {
   comparator_.clear();
   log_number_ = 0;
@@ -74,12 +86,26 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    const bool with_sequence = f.largest_seq != 0 || f.has_range_deletions;
+    Tag tag = kNewFile;
+    if (with_sequence) {
+      tag = kNewFileWithSequence;
+    } else if (f.newest_write_time != 0) {
+      tag = kNewFileWithWriteTime;
+    }
+    PutVarint32(dst, tag);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (tag != kNewFile) {
+      PutVarint64(dst, f.newest_write_time);
+    }
+    if (with_sequence) {
+      PutVarint64(dst, f.largest_seq);
+      PutVarint32(dst, f.has_range_deletions ? kFileHasRangeDeletions : 0);
+    }
   }
 }
 
@@ -112,6 +138,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   int level;
   uint64_t number;
   FileMetaData f;
+  uint32_t flags;
   Slice str;
   InternalKey key;
 
@@ -175,10 +202,21 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithWriteTime:
+      case kNewFileWithSequence:
+        f.newest_write_time = 0;
+        f.largest_seq = 0;
+        flags = 0;
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
-            GetInternalKey(&input, &f.largest)) {
+            GetInternalKey(&input, &f.largest) &&
+            (tag == kNewFile ||
+             GetVarint64(&input, &f.newest_write_time)) &&
+            (tag != kNewFileWithSequence ||
+             (GetVarint64(&input, &f.largest_seq) &&
+              GetVarint32(&input, &flags)))) {
+          f.has_range_deletions = (flags & kFileHasRangeDeletions) != 0;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -249,6 +287,17 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.newest_write_time != 0) {
+      r.append(" written ");
+      AppendNumberTo(&r, f.newest_write_time);
+    }
+    if (f.largest_seq != 0) {
+      r.append(" seq ");
+      AppendNumberTo(&r, f.largest_seq);
+    }
+    if (f.has_range_deletions) {
+      r.append(" with range deletions");
+    }
   }
   r.append("\n}\n");
   return r;
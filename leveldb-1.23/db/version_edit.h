@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 #define STORAGE_LEVELDB_DB_VERSION_EDIT_H_
 
+#include <atomic>
 #include <set>
 #include <utility>
 #include <vector>
@@ -16,14 +17,49 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        newest_write_time(0),
+        largest_seq(0),
+        has_range_deletions(false) {}
+
+  FileMetaData(const FileMetaData& f) { *this = f; }
+  FileMetaData& operator=(const FileMetaData& f) {
+    refs = f.refs;
+    allowed_seeks.store(f.allowed_seeks.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    number = f.number;
+    file_size = f.file_size;
+    smallest = f.smallest;
+    largest = f.largest;
+    newest_write_time = f.newest_write_time;
+    largest_seq = f.largest_seq;
+    has_range_deletions = f.has_range_deletions;
+    return *this;
+  }
 
   int refs;
-  int allowed_seeks;  // Seeks allowed until compaction
+  // Seeks allowed until compaction.  Charged by readers that do not hold
+  // the DB mutex.
+  std::atomic<int> allowed_seeks;
   uint64_t number;
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+
+  // Env::NowMicros() in seconds at or after the newest write to the
+  // table, or zero if unknown.
+  uint64_t newest_write_time;
+
+  // Largest sequence number of the entries and range tombstones of the
+  // table, or zero if unknown.
+  SequenceNumber largest_seq;
+
+  // True iff the table holds range tombstones.  If so, "smallest" and
+  // "largest" also bound the ranges they delete.
+  bool has_range_deletions;
 };
 
 class VersionEdit {
@@ -60,13 +96,22 @@ class VersionEdit {
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "newest_write_time" is as in FileMetaData
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               uint64_t newest_write_time = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.newest_write_time = newest_write_time;
+    new_files_.push_back(std::make_pair(level, f));
+  }
+
+  // Add the file described by "f" at the specified level.
+  // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
+  void AddFile(int level, const FileMetaData& f) {
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -27,6 +27,19 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    edit.AddFile(2, kBig + 800 + i, kBig + 400 + i,
+                 InternalKey("bar", kBig + 500 + i, kTypeValue),
+                 InternalKey("baz", kBig + 600 + i, kTypeValue),
+                 kBig + 1100 + i);
+    FileMetaData f;
+    f.number = kBig + 1200 + i;
+    f.file_size = kBig + 400 + i;
+    f.smallest = InternalKey("c", kBig + 500 + i, kTypeRangeDeletion);
+    f.largest = InternalKey("d", kMaxSequenceNumber, kValueTypeForSeek);
+    f.newest_write_time = kBig + 1100 + i;
+    f.largest_seq = kBig + 600 + i;
+    f.has_range_deletions = (i % 2 == 0);
+    edit.AddFile(1, f);
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
@@ -11,16 +11,24 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+// Readahead window of compaction inputs read with direct I/O, which get
+// no readahead from the operating system.
+static const size_t kDirectIOCompactionReadaheadSize = 1 << 20;
+
 static size_t TargetFileSize(const Options* options) {
   return options->max_file_size;
 }
@@ -82,6 +90,7 @@ Version::~Version() {
       }
     }
   }
+  delete tombstones_;
 }
 
 int FindFile(const InternalKeyComparator& icmp,
@@ -219,6 +228,19 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
   }
 }
 
+// GetFileIterator() for compaction inputs read with direct I/O.
+static Iterator* GetDirectFileIterator(void* arg, const ReadOptions& options,
+                                       const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewDirectIterator(options, DecodeFixed64(file_value.data()),
+                                    DecodeFixed64(file_value.data() + 8));
+  }
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
@@ -228,6 +250,11 @@ Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
 
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
+  if (!options.prefix.empty()) {
+    AddPrefixIterators(options, iters);
+    return;
+  }
+
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(vset_->table_cache_->NewIterator(
@@ -244,6 +271,59 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+// Returns true iff the key range of "*f" may include user keys that start
+// with "prefix".
+static bool FileMayHavePrefix(const Comparator* ucmp, const FileMetaData* f,
+                              const Slice& prefix) {
+  return ucmp->Compare(f->largest.user_key(), prefix) >= 0 &&
+         (f->smallest.user_key().starts_with(prefix) ||
+          ucmp->Compare(f->smallest.user_key(), prefix) < 0);
+}
+
+void Version::AddPrefixIterators(const ReadOptions& options,
+                                 std::vector<Iterator*>* iters) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const Slice prefix = options.prefix;
+
+  // If the filters of the tables hold prefixes, tables whose filter rules
+  // out the extracted prefix of "prefix" hold no key that starts with it.
+  std::string filter_key;
+  const SliceTransform* prefix_extractor = vset_->options_->prefix_extractor;
+  if (prefix_extractor != nullptr &&
+      vset_->options_->filter_policy != nullptr &&
+      prefix_extractor->InDomain(prefix)) {
+    AppendInternalKey(&filter_key,
+                      ParsedInternalKey(prefix_extractor->Transform(prefix),
+                                        kMaxSequenceNumber, kValueTypeForSeek));
+  }
+
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    size_t i = 0;
+    if (level > 0) {
+      // Skip the files that end before the prefix
+      InternalKey start(prefix, kMaxSequenceNumber, kValueTypeForSeek);
+      i = FindFile(vset_->icmp_, files, start.Encode());
+    }
+    for (; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (!FileMayHavePrefix(ucmp, f, prefix)) {
+        if (level > 0) {
+          break;  // This and later files start past the prefix
+        }
+        continue;
+      }
+      if (!filter_key.empty() &&
+          !vset_->table_cache_->KeyMayMatch(f->number, f->file_size,
+                                            filter_key)) {
+        continue;
+      }
+      iters->push_back(
+          vset_->table_cache_->NewIterator(options, f->number, f->file_size));
+    }
+  }
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -257,6 +337,8 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  Slice found_value;  // Set instead of *value if value is null
+  SequenceNumber sequence;  // Of the entry found, if any
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -267,13 +349,89 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
       s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      s->sequence = parsed_key.sequence;
       if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+        if (s->value != nullptr) {
+          s->value->assign(v.data(), v.size());
+        } else {
+          s->found_value = v;
+        }
       }
     }
   }
 }
 
+static void DeletePinnedIterator(void* arg1, void* arg2) {
+  delete reinterpret_cast<Iterator*>(arg1);
+}
+
+// Raise *max_seq to the sequence number of the newest range tombstone of
+// "f" that covers the key of "saver" at "snapshot".
+static Status AddCoveringTombstones(TableCache* table_cache, FileMetaData* f,
+                                    const Saver& saver, SequenceNumber snapshot,
+                                    SequenceNumber* max_seq) {
+  if (!f->has_range_deletions) {
+    return Status::OK();
+  }
+  SequenceNumber seq;
+  Status s = table_cache->MaxCoveringTombstoneSequence(
+      f->number, f->file_size, saver.user_key, snapshot, &seq);
+  if (s.ok() && seq > *max_seq) {
+    *max_seq = seq;
+  }
+  return s;
+}
+
+// Treat the result of a lookup in a file as a deletion if the newest range
+// tombstone seen so far covers it.  Files are searched from newest to
+// oldest, and the files that are left only hold older entries for the key,
+// so a covering tombstone also ends the search if nothing was found.
+static void ApplyCoveringTombstones(SequenceNumber max_covering_tombstone_seq,
+                                    Saver* saver) {
+  if (max_covering_tombstone_seq == 0) {
+    return;
+  }
+  if (saver->state == kNotFound ||
+      (saver->state != kCorrupt &&
+       saver->sequence < max_covering_tombstone_seq)) {
+    saver->state = kDeleted;
+  }
+}
+
+Status Version::GetRangeTombstones(const RangeTombstoneList** list) {
+  // tombstones_ is not changed once tombstones_read_ is set.
+  if (!tombstones_read_.load(std::memory_order_acquire)) {
+    MutexLock l(&tombstones_mutex_);
+    if (!tombstones_read_.load(std::memory_order_relaxed)) {
+      RangeTombstoneList* tombstones =
+          new RangeTombstoneList(vset_->icmp_.user_comparator());
+      for (int level = 0; level < config::kNumLevels; level++) {
+        for (size_t i = 0; i < files_[level].size(); i++) {
+          const FileMetaData* f = files_[level][i];
+          if (f->has_range_deletions) {
+            Status s = vset_->table_cache_->AddRangeTombstones(
+                f->number, f->file_size, tombstones);
+            if (!s.ok()) {
+              // Not cached, so that a later call retries.
+              delete tombstones;
+              return s;
+            }
+          }
+        }
+      }
+      if (tombstones->empty()) {
+        delete tombstones;
+      } else {
+        tombstones->Finish();
+        tombstones_ = tombstones;
+      }
+      tombstones_read_.store(true, std::memory_order_release);
+    }
+  }
+  *list = tombstones_;
+  return Status::OK();
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -322,17 +480,20 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
 }
 
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    PinnableSlice* value, GetStats* stats) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
   struct State {
     Saver saver;
+    PinnableSlice* value;
     GetStats* stats;
     const ReadOptions* options;
     Slice ikey;
     FileMetaData* last_file_read;
     int last_file_read_level;
+    SequenceNumber snapshot;
+    SequenceNumber max_covering_tombstone_seq;
 
     VersionSet* vset;
     Status s;
@@ -351,9 +512,31 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      state->s = AddCoveringTombstones(state->vset->table_cache_, f,
+                                       state->saver, state->snapshot,
+                                       &state->max_covering_tombstone_seq);
+      if (!state->s.ok()) {
+        state->found = true;
+        return false;
+      }
+
+      // The block iterator that found the value keeps its block in memory
+      // for as long as the value is pinned.
+      Iterator* pinned = nullptr;
+      state->s = state->vset->table_cache_->Get(
+          *state->options, f->number, f->file_size, state->ikey, &state->saver,
+          SaveValue, &pinned);
+      if (state->s.ok()) {
+        ApplyCoveringTombstones(state->max_covering_tombstone_seq,
+                                &state->saver);
+      }
+      if (state->s.ok() && state->saver.state == kFound) {
+        assert(pinned != nullptr);
+        state->value->PinSlice(state->saver.found_value, &DeletePinnedIterator,
+                               pinned, nullptr);
+      } else {
+        delete pinned;
+      }
       if (!state->s.ok()) {
         state->found = true;
         return false;
@@ -387,32 +570,221 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
   state.options = &options;
   state.ikey = k.internal_key();
+  state.snapshot = k.sequence();
+  state.max_covering_tombstone_seq = 0;
   state.vset = vset_;
 
   state.saver.state = kNotFound;
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
-  state.saver.value = value;
+  state.saver.value = nullptr;
+  state.value = value;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys, std::string* const* vals,
+                       Status* const* statuses, GetStats* stats) {
+  stats->seek_file = nullptr;
+  stats->seek_file_level = -1;
+
+  struct KeyState {
+    Saver saver;
+    Slice ikey;
+    Status* s;
+    bool done;
+    FileMetaData* last_file_read;
+    int last_file_read_level;
+    SequenceNumber snapshot;
+    SequenceNumber max_covering_tombstone_seq;
+  };
+
+  struct KeyOrder {
+    const InternalKeyComparator* icmp;
+    bool operator()(const KeyState* a, const KeyState* b) const {
+      return icmp->Compare(a->ikey, b->ikey) < 0;
+    }
+  };
+
+  struct State {
+    const ReadOptions* options;
+    VersionSet* vset;
+    GetStats* stats;
+
+    // Look up "batch", which is sorted by key, in file "f".
+    void ReadFile(int level, FileMetaData* f,
+                  const std::vector<KeyState*>& batch) {
+      const int m = batch.size();
+      std::vector<Slice> ikeys(m);
+      std::vector<void*> args(m);
+      std::vector<Status> file_statuses(m);
+      std::vector<Status> tombstone_statuses(m);
+      for (int i = 0; i < m; i++) {
+        KeyState* k = batch[i];
+        if (stats->seek_file == nullptr && k->last_file_read != nullptr) {
+          // We have had more than one seek for this read.  Charge the 1st
+          // file.
+          stats->seek_file = k->last_file_read;
+          stats->seek_file_level = k->last_file_read_level;
+        }
+        k->last_file_read = f;
+        k->last_file_read_level = level;
+        ikeys[i] = k->ikey;
+        args[i] = &k->saver;
+        tombstone_statuses[i] = AddCoveringTombstones(
+            vset->table_cache_, f, k->saver, k->snapshot,
+            &k->max_covering_tombstone_seq);
+      }
+
+      Status s = vset->table_cache_->MultiGet(
+          *options, f->number, f->file_size, m, &ikeys[0], &args[0],
+          SaveValue, &file_statuses[0]);
+      for (int i = 0; i < m; i++) {
+        KeyState* k = batch[i];
+        Status file_status = s.ok() ? file_statuses[i] : s;
+        if (file_status.ok()) {
+          file_status = tombstone_statuses[i];
+        }
+        if (!file_status.ok()) {
+          *k->s = file_status;
+          k->done = true;
+          continue;
+        }
+        ApplyCoveringTombstones(k->max_covering_tombstone_seq, &k->saver);
+        switch (k->saver.state) {
+          case kNotFound:
+            break;  // Keep searching in other files
+          case kFound:
+            k->done = true;
+            break;
+          case kDeleted:
+            *k->s = Status::NotFound(Slice());
+            k->done = true;
+            break;
+          case kCorrupt:
+            *k->s = Status::Corruption("corrupted key for ", k->saver.user_key);
+            k->done = true;
+            break;
+        }
+      }
+    }
+
+    // Drop the keys that have been resolved from *pending.
+    static void RemoveDone(std::vector<KeyState*>* pending) {
+      size_t live = 0;
+      for (size_t i = 0; i < pending->size(); i++) {
+        if (!(*pending)[i]->done) {
+          (*pending)[live++] = (*pending)[i];
+        }
+      }
+      pending->resize(live);
+    }
+  };
+
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  std::vector<KeyState> key_states(n);
+  std::vector<KeyState*> pending(n);
+  for (int i = 0; i < n; i++) {
+    KeyState* k = &key_states[i];
+    k->saver.state = kNotFound;
+    k->saver.ucmp = ucmp;
+    k->saver.user_key = keys[i]->user_key();
+    k->saver.value = vals[i];
+    k->ikey = keys[i]->internal_key();
+    k->s = statuses[i];
+    *k->s = Status::OK();
+    k->done = false;
+    k->last_file_read = nullptr;
+    k->last_file_read_level = -1;
+    k->snapshot = keys[i]->sequence();
+    k->max_covering_tombstone_seq = 0;
+    pending[i] = k;
+  }
+  KeyOrder order;
+  order.icmp = &vset_->icmp_;
+  std::sort(pending.begin(), pending.end(), order);
+
+  State state;
+  state.options = &options;
+  state.vset = vset_;
+  state.stats = stats;
+
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  std::vector<KeyState*> batch;
+  for (size_t i = 0; i < tmp.size() && !pending.empty(); i++) {
+    FileMetaData* f = tmp[i];
+    batch.clear();
+    for (size_t j = 0; j < pending.size(); j++) {
+      const Slice& user_key = pending[j]->saver.user_key;
+      if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(pending[j]);
+      }
+    }
+    if (!batch.empty()) {
+      state.ReadFile(0, f, batch);
+      State::RemoveDone(&pending);
+    }
+  }
+
+  // Search other levels, one file at a time for the keys it covers.
+  for (int level = 1; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    size_t j = 0;
+    while (j < pending.size()) {
+      uint32_t index = FindFile(vset_->icmp_, files, pending[j]->ikey);
+      if (index >= files.size()) {
+        break;  // This and all later keys are past the last file
+      }
+      FileMetaData* f = files[index];
+      batch.clear();
+      for (; j < pending.size() &&
+             vset_->icmp_.Compare(pending[j]->ikey, f->largest.Encode()) <= 0;
+           j++) {
+        if (ucmp->Compare(pending[j]->saver.user_key, f->smallest.user_key()) >=
+            0) {
+          batch.push_back(pending[j]);
+        }
+      }
+      if (!batch.empty()) {
+        state.ReadFile(level, f, batch);
+      }
+    }
+    State::RemoveDone(&pending);
+  }
+
+  for (size_t j = 0; j < pending.size(); j++) {
+    *pending[j]->s = Status::NotFound(Slice());
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != nullptr) {
-    f->allowed_seeks--;
-    if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
-      file_to_compact_ = f;
-      file_to_compact_level_ = stats.seek_file_level;
-      return true;
-    }
+  // Only the seek that uses up the allowed seeks reports it, so that later
+  // readers of the file do not take the lock again.  If another file is
+  // already picked by then, Finalize() picks this one for a later version.
+  return f != nullptr &&
+         f->allowed_seeks.fetch_sub(1, std::memory_order_relaxed) == 1;
+}
+
+bool Version::PickSeekCompaction(const GetStats& stats) {
+  if (file_to_compact_ == nullptr) {
+    file_to_compact_ = stats.seek_file;
+    file_to_compact_level_ = stats.seek_file_level;
+    return true;
   }
   return false;
 }
 
-bool Version::RecordReadSample(Slice internal_key) {
+bool Version::RecordReadSample(Slice internal_key, GetStats* stats) {
   ParsedInternalKey ikey;
   if (!ParseInternalKey(internal_key, &ikey)) {
     return false;
@@ -445,6 +817,7 @@ bool Version::RecordReadSample(Slice internal_key) {
   // finding such files?
   if (state.matches >= 2) {
     // 1MB cost is about 1 seek (see comment in Builder::Apply).
+    *stats = state.stats;
     return UpdateStats(state.stats);
   }
   return false;
@@ -747,6 +1120,9 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
       descriptor_log_(nullptr),
       dummy_versions_(this),
       current_(nullptr) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    level_in_compaction_[level] = false;
+  }
   AppendVersion(new Version(this));
 }
 
@@ -787,7 +1163,11 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  // An edit may publish sequence numbers of its own (see
+  // DBImpl::IngestExternalFile()).
+  if (!edit->has_last_sequence_ || edit->last_sequence_ < LastSequence()) {
+    edit->SetLastSequence(LastSequence());
+  }
 
   Version* v = new Version(this);
   {
@@ -1030,10 +1410,7 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
-  // Precomputed best level for next compaction
-  int best_level = -1;
-  double best_score = -1;
-
+  // Precomputed scores for the next compactions
   for (int level = 0; level < config::kNumLevels - 1; level++) {
     double score;
     if (level == 0) {
@@ -1057,14 +1434,82 @@ void VersionSet::Finalize(Version* v) {
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
-    if (score > best_score) {
+    v->compaction_score_[level] = score;
+
+    // A file may have used up its allowed seeks while another file was
+    // picked for a seek compaction.
+    for (size_t i = 0;
+         v->file_to_compact_ == nullptr && i < v->files_[level].size(); i++) {
+      FileMetaData* f = v->files_[level][i];
+      if (f->allowed_seeks.load(std::memory_order_relaxed) <= 0) {
+        v->file_to_compact_ = f;
+        v->file_to_compact_level_ = level;
+      }
+    }
+  }
+}
+
+int VersionSet::PickSizeCompactionLevel() const {
+  int best_level = -1;
+  double best_score = -1;
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    const double score = current_->compaction_score_[level];
+    if (score >= 1 && score > best_score && CanCompactLevel(level)) {
       best_level = level;
       best_score = score;
     }
   }
+  return best_level;
+}
+
+bool VersionSet::NeedsCompaction() const {
+  if (options_->compaction_style == kFIFOCompaction) {
+    int first_level, last_level;
+    return PickExpiredLevels(&first_level, &last_level);
+  }
+  if (options_->compaction_style == kUniversalCompaction) {
+    std::vector<SortedRun> runs;
+    GetSortedRuns(&runs);
+    size_t start, limit;
+    int output_level;
+    return PickUniversalRuns(runs, &start, &limit, &output_level);
+  }
+  Version* v = current_;
+  return (PickSizeCompactionLevel() >= 0) ||
+         (v->file_to_compact_ != nullptr &&
+          CanCompactLevel(v->file_to_compact_level_));
+}
+
+int VersionSet::PickLevelForExternalFile(const Slice& smallest_user_key,
+                                         const Slice& largest_user_key) {
+  // Go down as long as no file of the level overlaps the range, so that
+  // the older entries for the keys of the range are all below it.  Levels
+  // written by running compactions are skipped as their outputs may span
+  // the range.
+  Version* v = current_;
+  int level = 0;
+  if (!v->OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+    while (level + 1 < config::kNumLevels && !level_in_compaction_[level + 1] &&
+           !v->OverlapInLevel(level + 1, &smallest_user_key,
+                              &largest_user_key)) {
+      level++;
+    }
+  }
+  return level;
+}
 
-  v->compaction_level_ = best_level;
-  v->compaction_score_ = best_score;
+void VersionSet::AcquireCompactionLevels(const Compaction* c) {
+  for (int level = c->level(); level <= c->output_level(); level++) {
+    assert(!level_in_compaction_[level]);
+    level_in_compaction_[level] = true;
+  }
+}
+
+void VersionSet::ReleaseCompactionLevels(const Compaction* c) {
+  for (int level = c->level(); level <= c->output_level(); level++) {
+    assert(level_in_compaction_[level]);
+    level_in_compaction_[level] = false;
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1088,7 +1533,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
@@ -1221,26 +1666,36 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  const bool direct_io = options_->use_direct_io_for_compaction;
+  if (direct_io) {
+    options.readahead_size = kDirectIOCompactionReadaheadSize;
+  }
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  const int space = (c->level() == 0 ? c->files_to_read(0).size() : 1) +
+                    c->num_input_levels() - 1;
   Iterator** list = new Iterator*[space];
   int num = 0;
-  for (int which = 0; which < 2; which++) {
-    if (!c->inputs_[which].empty()) {
+  for (int which = 0; which < c->num_input_levels(); which++) {
+    if (!c->files_to_read(which).empty()) {
       if (c->level() + which == 0) {
-        const std::vector<FileMetaData*>& files = c->inputs_[which];
+        const std::vector<FileMetaData*>& files = c->files_to_read(which);
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] =
+              direct_io ? table_cache_->NewDirectIterator(
+                              options, files[i]->number, files[i]->file_size)
+                        : table_cache_->NewIterator(options, files[i]->number,
+                                                    files[i]->file_size);
         }
       } else {
         // Create concatenating iterator for the files from this level
+        const std::vector<FileMetaData*>* files = &c->files_to_read(which);
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            new Version::LevelFileNumIterator(icmp_, files),
+            direct_io ? &GetDirectFileIterator : &GetFileIterator,
+            table_cache_, options);
       }
     }
   }
@@ -1251,18 +1706,27 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
+  if (options_->compaction_style == kFIFOCompaction) {
+    return PickFIFOCompaction();
+  }
+  if (options_->compaction_style == kUniversalCompaction) {
+    return PickUniversalCompaction();
+  }
+
   Compaction* c;
   int level;
 
   // We prefer compactions triggered by too much data in a level over
   // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
+  const int size_level = PickSizeCompactionLevel();
+  const bool size_compaction = (size_level >= 0);
+  const bool seek_compaction =
+      (current_->file_to_compact_ != nullptr &&
+       CanCompactLevel(current_->file_to_compact_level_));
   if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
+    level = size_level;
     assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
+    c = new Compaction(options_, level, level + 1);
 
     // Pick the first file that comes after compact_pointer_[level]
     for (size_t i = 0; i < current_->files_[level].size(); i++) {
@@ -1279,7 +1743,7 @@ Compaction* VersionSet::PickCompaction() {
     }
   } else if (seek_compaction) {
     level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
+    c = new Compaction(options_, level, level + 1);
     c->inputs_[0].push_back(current_->file_to_compact_);
   } else {
     return nullptr;
@@ -1300,10 +1764,227 @@ Compaction* VersionSet::PickCompaction() {
   }
 
   SetupOtherInputs(c);
+  AcquireCompactionLevels(c);
 
   return c;
 }
 
+void VersionSet::GetSortedRuns(std::vector<SortedRun>* runs) const {
+  runs->clear();
+  std::vector<FileMetaData*> level0 = current_->files_[0];
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  for (size_t i = 0; i < level0.size(); i++) {
+    SortedRun run;
+    run.level = 0;
+    run.file = level0[i];
+    run.size = level0[i]->file_size;
+    runs->push_back(run);
+  }
+  for (int level = 1; level < config::kNumLevels; level++) {
+    if (!current_->files_[level].empty()) {
+      SortedRun run;
+      run.level = level;
+      run.file = nullptr;
+      run.size = TotalFileSize(current_->files_[level]);
+      runs->push_back(run);
+    }
+  }
+}
+
+bool VersionSet::PickUniversalRuns(const std::vector<SortedRun>& runs,
+                                   size_t* start, size_t* limit,
+                                   int* output_level) const {
+  const size_t n = runs.size();
+  if (n < static_cast<size_t>(config::kL0_CompactionTrigger)) {
+    return false;
+  }
+  size_t num_level0 = 0;
+  while (num_level0 < n && runs[num_level0].level == 0) {
+    num_level0++;
+  }
+
+  // Merge all runs if the newer runs take up too much space compared to
+  // the oldest one, which holds most of the live data.
+  int64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < n; i++) {
+    newer_bytes += runs[i].size;
+  }
+  bool found = false;
+  if (newer_bytes * 100 >
+      runs[n - 1].size *
+          options_->universal_max_size_amplification_percent) {
+    *start = 0;
+    *limit = n;
+    found = true;
+  }
+
+  // Otherwise merge the newest runs of similar size.
+  const size_t min_width = options_->universal_min_merge_width;
+  for (size_t i = 0; !found && i < n; i++) {
+    int64_t bytes = runs[i].size;
+    size_t j = i + 1;
+    while (j < n && runs[j].size * 100 <=
+                        bytes * (100 + options_->universal_size_ratio)) {
+      bytes += runs[j].size;
+      j++;
+    }
+    // The output of a compaction goes below level-0, so a compaction that
+    // takes a level-0 file has to take all older level-0 files as well.
+    j = std::max(j, num_level0);
+    if (j - i >= min_width) {
+      *start = i;
+      *limit = j;
+      found = true;
+    }
+  }
+
+  // Otherwise merge the newest runs regardless of their sizes if there
+  // are so many of them that writes would soon be slowed down.
+  if (!found) {
+    if (n < static_cast<size_t>(config::kL0_SlowdownWritesTrigger)) {
+      return false;
+    }
+    *start = 0;
+    *limit = std::min(
+        n, std::max(std::max(min_width, num_level0),
+                    n - config::kL0_SlowdownWritesTrigger + 2));
+  }
+
+  // Write to the level of the oldest run picked.  When only level-0 files
+  // are picked, write to the empty level right above the next older run,
+  // taking that run in as well if there is no empty level above it.
+  if (runs[*limit - 1].level > 0) {
+    *output_level = runs[*limit - 1].level;
+  } else if (*limit == n) {
+    *output_level = config::kNumLevels - 1;
+  } else if (runs[*limit].level > 1) {
+    *output_level = runs[*limit].level - 1;
+  } else {
+    *output_level = runs[*limit].level;
+    ++*limit;
+  }
+
+  for (int level = runs[*start].level; level <= *output_level; level++) {
+    if (level_in_compaction_[level]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Compaction* VersionSet::PickUniversalCompaction() {
+  std::vector<SortedRun> runs;
+  GetSortedRuns(&runs);
+  size_t start, limit;
+  int output_level;
+  if (!PickUniversalRuns(runs, &start, &limit, &output_level)) {
+    return nullptr;
+  }
+
+  Compaction* c = new Compaction(options_, runs[start].level, output_level);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  for (size_t i = start; i < limit; i++) {
+    const SortedRun& run = runs[i];
+    if (run.level == 0) {
+      c->inputs_[0].push_back(run.file);
+    } else {
+      c->inputs_[run.level - c->level()] = current_->files_[run.level];
+    }
+  }
+
+  // Compute the set of grandparent files that overlap this compaction
+  if (output_level + 1 < config::kNumLevels) {
+    std::vector<FileMetaData*> all;
+    for (int which = 0; which < c->num_input_levels(); which++) {
+      all.insert(all.end(), c->inputs_[which].begin(),
+                 c->inputs_[which].end());
+    }
+    InternalKey smallest, largest;
+    GetRange(all, &smallest, &largest);
+    current_->GetOverlappingInputs(output_level + 1, &smallest, &largest,
+                                   &c->grandparents_);
+  }
+
+  Log(options_->info_log, "Universal compaction of %d sorted runs to level-%d",
+      static_cast<int>(limit - start), output_level);
+  AcquireCompactionLevels(c);
+  return c;
+}
+
+bool VersionSet::IsExpired(const FileMetaData* f) const {
+  const uint64_t ttl = options_->ttl_seconds;
+  return ttl > 0 && f->newest_write_time != 0 &&
+         f->newest_write_time + ttl <= env_->NowMicros() / 1000000;
+}
+
+uint64_t VersionSet::NextExpiryTime() const {
+  const uint64_t ttl = options_->ttl_seconds;
+  const uint64_t now = env_->NowMicros() / 1000000;
+  uint64_t result = 0;
+  if (ttl == 0) {
+    return result;
+  }
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      const uint64_t newest = files[i]->newest_write_time;
+      if (newest != 0 && newest + ttl > now &&
+          (result == 0 || newest + ttl < result)) {
+        result = newest + ttl;
+      }
+    }
+  }
+  return result;
+}
+
+bool VersionSet::PickExpiredLevels(int* first_level, int* last_level) const {
+  *first_level = -1;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      if (IsExpired(files[i])) {
+        if (*first_level < 0) {
+          *first_level = level;
+        }
+        *last_level = level;
+        break;
+      }
+    }
+  }
+  if (*first_level < 0) {
+    return false;
+  }
+  for (int level = *first_level; level <= *last_level; level++) {
+    if (level_in_compaction_[level]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Compaction* VersionSet::PickFIFOCompaction() {
+  int first_level, last_level;
+  if (!PickExpiredLevels(&first_level, &last_level)) {
+    return nullptr;
+  }
+
+  Compaction* c = new Compaction(options_, first_level, last_level);
+  c->deletion_ = true;
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  for (int level = first_level; level <= last_level; level++) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      if (IsExpired(files[i])) {
+        c->inputs_[level - first_level].push_back(files[i]);
+      }
+    }
+  }
+  AcquireCompactionLevels(c);
+  return c;
+}
+
 // Finds the largest key in a vector of files. Returns true if files it not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1469,26 +2150,30 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
     }
   }
 
-  Compaction* c = new Compaction(options_, level);
+  Compaction* c = new Compaction(options_, level, level + 1);
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  AcquireCompactionLevels(c);
   return c;
 }
 
-Compaction::Compaction(const Options* options, int level)
-    : level_(level),
-      max_output_file_size_(MaxFileSizeForLevel(options, level)),
-      input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+Compaction::Cursor::Cursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
+Compaction::Compaction(const Options* options, int level, int output_level)
+    : level_(level),
+      output_level_(output_level),
+      deletion_(false),
+      max_output_file_size_(MaxFileSizeForLevel(options, level)),
+      input_version_(nullptr),
+      skipped_inputs_(false) {}
+
 Compaction::~Compaction() {
   if (input_version_ != nullptr) {
     input_version_->Unref();
@@ -1500,26 +2185,44 @@ bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
-          TotalFileSize(grandparents_) <=
-              MaxGrandParentOverlapBytes(vset->options_));
+  if (num_input_files(0) != 1) {
+    return false;
+  }
+  for (int which = 1; which < num_input_levels(); which++) {
+    if (num_input_files(which) != 0) {
+      return false;
+    }
+  }
+  return TotalFileSize(grandparents_) <=
+         MaxGrandParentOverlapBytes(vset->options_);
+}
+
+uint64_t Compaction::NewestWriteTime() const {
+  uint64_t result = 0;
+  for (int which = 0; which < num_input_levels(); which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      result = std::max(result, inputs_[which][i]->newest_write_time);
+    }
+  }
+  return result;
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < num_input_levels(); which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
       edit->RemoveFile(level_ + which, inputs_[which][i]->number);
     }
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1528,36 +2231,131 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Compaction::HasRangeDeletions() const {
+  for (int which = 0; which < num_input_levels(); which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      if (inputs_[which][i]->has_range_deletions) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int Compaction::SkipCoveredInputs(const RangeTombstoneList& tombstones,
+                                  SequenceNumber smallest_snapshot) {
+  int skipped = 0;
+  for (int which = 0; which < num_input_levels(); which++) {
+    inputs_to_read_[which].clear();
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      FileMetaData* f = inputs_[which][i];
+      // A file's own tombstones are in "tombstones" already, so it need
+      // not be read once they and its entries are all covered by newer
+      // tombstones.  Files written before largest_seq was recorded are
+      // always read.
+      if (f->largest_seq != 0 &&
+          tombstones.CoversRange(f->smallest.user_key(),
+                                 f->largest.user_key(), f->largest_seq,
+                                 smallest_snapshot)) {
+        skipped++;
+      } else {
+        inputs_to_read_[which].push_back(f);
+      }
+    }
+  }
+  skipped_inputs_ = true;
+  return skipped;
+}
+
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
-         icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+  while (cursor->grandparent_index < grandparents_.size() &&
+         icmp->Compare(
+             internal_key,
+             grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+namespace {
+struct BySmallestKey {
+  const InternalKeyComparator* icmp;
+
+  bool operator()(FileMetaData* f1, FileMetaData* f2) const {
+    return icmp->Compare(f1->smallest, f2->smallest) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetSubcompactionBoundaries(
+    int max_subcompactions, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  std::vector<FileMetaData*> files;
+  for (int which = 0; which < num_input_levels(); which++) {
+    files.insert(files.end(), inputs_[which].begin(), inputs_[which].end());
+  }
+  if (max_subcompactions <= 1 || files.size() < 2) {
+    return;
+  }
+
+  // Walk the input files in key order and start a new range whenever
+  // the files seen so far hold another 1/max_subcompactions of the
+  // input bytes.  Ranges start at user keys, so every version of a user
+  // key is merged by the same subcompaction.
+  BySmallestKey cmp;
+  cmp.icmp = &input_version_->vset_->icmp_;
+  std::sort(files.begin(), files.end(), cmp);
+
+  const Comparator* user_cmp = cmp.icmp->user_comparator();
+  const int64_t range_bytes = TotalFileSize(files) / max_subcompactions;
+  int64_t bytes = 0;
+  Slice last_start = files[0]->smallest.user_key();
+  for (size_t i = 0; i < files.size(); i++) {
+    const int64_t limit =
+        range_bytes * static_cast<int64_t>(boundaries->size() + 1);
+    const Slice start = files[i]->smallest.user_key();
+    if (bytes >= limit && bytes > 0 &&
+        boundaries->size() + 1 < static_cast<size_t>(max_subcompactions) &&
+        user_cmp->Compare(start, last_start) > 0) {
+      boundaries->push_back(start.ToString());
+      last_start = start;
+    }
+    bytes += files[i]->file_size;
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
     input_version_->Unref();
@@ -15,6 +15,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -33,6 +34,8 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class PinnableSlice;
+class RangeTombstoneList;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -70,21 +73,47 @@ class Version {
   // Append to *iters a sequence of iterators that will
   // yield the contents of this Version when merged together.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
+  //
+  // If the options bound iterators to a prefix, only the files that may
+  // hold keys with that prefix are included.
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
+  // A value found is pinned to the table block holding it.
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
              GetStats* stats);
 
-  // Adds "stats" into the current state.  Returns true if a new
-  // compaction may need to be triggered, false otherwise.
-  // REQUIRES: lock is held
+  // Get() for each of keys[0,n-1], storing the result of keys[i] in
+  // *vals[i] and *statuses[i].  Keys that fall into the same table file
+  // are looked up in that file together.  Fills *stats.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string* const* vals, Status* const* statuses,
+                GetStats* stats);
+
+  // Charges the seek recorded in "stats" to its file.  Returns true if
+  // this seek used up the allowed seeks of the file, in which case the
+  // caller should pass "stats" to PickSeekCompaction() with the lock held.
+  // REQUIRES: lock is not held
   bool UpdateStats(const GetStats& stats);
 
+  // Picks the file of "stats" for a seek compaction of this version unless
+  // another file is already picked.  Returns true if a new compaction may
+  // need to be triggered, false otherwise.
+  // REQUIRES: lock is held
+  bool PickSeekCompaction(const GetStats& stats);
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.  Returns true if a new compaction may need to be triggered.
-  // REQUIRES: lock is held
-  bool RecordReadSample(Slice key);
+  // bytes.  Returns true if the sample used up the allowed seeks of a
+  // file, which is then stored in *stats (see UpdateStats()).
+  // REQUIRES: lock is not held
+  bool RecordReadSample(Slice key, GetStats* stats);
+
+  // Store in *list the fragmented range tombstones of all of the files
+  // of this version, or null if they hold none.  The list is read on first
+  // use and kept until the version is deleted.
+  // REQUIRES: lock is not held
+  Status GetRangeTombstones(const RangeTombstoneList** list);
 
   // Reference count management (so Versions do not disappear out from
   // under live iterators)
@@ -127,8 +156,12 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
-        compaction_score_(-1),
-        compaction_level_(-1) {}
+        tombstones_read_(false),
+        tombstones_(nullptr) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      compaction_score_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -137,6 +170,9 @@ class Version {
 
   Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
 
+  // AddIterators() for options with a non-empty prefix.
+  void AddPrefixIterators(const ReadOptions&, std::vector<Iterator*>* iters);
+
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
   // false, makes no more calls.
@@ -157,11 +193,15 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
-  // Level that should be compacted next and its compaction score.
-  // Score < 1 means compaction is not strictly needed.  These fields
+  // Compaction score of every level that can be compacted into the next
+  // one.  Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
-  double compaction_score_;
-  int compaction_level_;
+  double compaction_score_[config::kNumLevels - 1];
+
+  // Range tombstones of the files, once tombstones_read_ is set.
+  port::Mutex tombstones_mutex_;
+  std::atomic<bool> tombstones_read_;
+  RangeTombstoneList* tombstones_;  // Null if there are none
 };
 
 class VersionSet {
@@ -178,6 +218,7 @@ class VersionSet {
   // current version.  Will release *mu while actually writing to the file.
   // REQUIRES: *mu is held on entry.
   // REQUIRES: no other thread concurrently calls LogAndApply()
+  //           (DBImpl serializes its calls, see DBImpl::LogAndApply())
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
@@ -208,13 +249,16 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the last sequence number.  May be called without holding the
+  // lock, by readers that only need the writes published so far.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -227,19 +271,40 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
+  // Pick level and inputs for a new compaction in the style given by
+  // Options::compaction_style, skipping levels that running compactions
+  // read from or write to.
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction.  Caller should pass the result to
+  // ReleaseCompactionLevels() once the compaction is done, then delete it.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
-  // level that overlaps the specified range.  Caller should delete
-  // the result.
+  // level that overlaps the specified range.  Caller should pass the
+  // result to ReleaseCompactionLevels() once the compaction is done,
+  // then delete it.
+  // REQUIRES: CanCompactLevel(level)
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
+  // Returns true iff no running compaction reads from or writes to
+  // "level" or "level+1", so a compaction of "level" may start.
+  bool CanCompactLevel(int level) const {
+    return !level_in_compaction_[level] && !level_in_compaction_[level + 1];
+  }
+
+  // Allow new compactions to use the levels of "*c", which has finished.
+  void ReleaseCompactionLevels(const Compaction* c);
+
+  // Return the level of the current version at which to place an external
+  // file that covers the range [smallest_user_key,largest_user_key] and
+  // holds newer entries than any of the version: the deepest level such
+  // that neither it nor the levels above it overlap the range.
+  int PickLevelForExternalFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -248,11 +313,13 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
-  // Returns true iff some level needs a compaction.
-  bool NeedsCompaction() const {
-    Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
-  }
+  // Returns true iff some level needs a compaction that can start now.
+  bool NeedsCompaction() const;
+
+  // Returns the time (in seconds, as Env::NowMicros() / 1000000) at which
+  // the first file of the current version that has not expired yet will
+  // expire, or zero if there is none (see Options::ttl_seconds).
+  uint64_t NextExpiryTime() const;
 
   // Add all files listed in any live version to *live.
   // May also mutate some internal state.
@@ -275,10 +342,48 @@ class VersionSet {
   friend class Compaction;
   friend class Version;
 
+  // A sorted run of a version, as seen by universal compaction: either a
+  // single level-0 file or all the files of a level above level-0.
+  struct SortedRun {
+    int level;
+    FileMetaData* file;  // The level-0 file; nullptr for other levels
+    int64_t size;
+  };
+
   bool ReuseManifest(const std::string& dscname, const std::string& dscbase);
 
   void Finalize(Version* v);
 
+  // Return the level of the current version with the highest compaction
+  // score >= 1 that can be compacted now, or -1 if there is none.
+  int PickSizeCompactionLevel() const;
+
+  // Store the sorted runs of the current version in *runs, newest first.
+  void GetSortedRuns(std::vector<SortedRun>* runs) const;
+
+  // Pick runs[*start,*limit) for a universal compaction into
+  // *output_level, where "runs" are the sorted runs of the current
+  // version.  Returns false if no compaction is needed or if the picked
+  // levels are taken by a running compaction.
+  bool PickUniversalRuns(const std::vector<SortedRun>& runs, size_t* start,
+                         size_t* limit, int* output_level) const;
+
+  Compaction* PickUniversalCompaction();
+
+  // Returns true iff all the data of "f" is older than Options::ttl_seconds.
+  bool IsExpired(const FileMetaData* f) const;
+
+  // Set *first_level and *last_level to the first and last level of the
+  // current version that hold expired files.  Returns false if there are
+  // no expired files, or if the levels in between are taken by a running
+  // compaction.
+  bool PickExpiredLevels(int* first_level, int* last_level) const;
+
+  Compaction* PickFIFOCompaction();
+
+  // Mark the levels of "*c" as taken by a running compaction.
+  void AcquireCompactionLevels(const Compaction* c);
+
   void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
                 InternalKey* largest);
 
@@ -300,7 +405,7 @@ class VersionSet {
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -313,25 +418,61 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Per-level flag that is set while a running compaction reads from or
+  // writes to that level.
+  bool level_in_compaction_[config::kNumLevels];
 };
 
 // A Compaction encapsulates information about a compaction.
 class Compaction {
  public:
+  // Position of one stream of output keys within the compaction.
+  // IsBaseLevelForKey() and ShouldStopBefore() only ever move forward
+  // through the key space, so every subcompaction needs its own Cursor.
+  struct Cursor {
+    Cursor();
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == output_level_, grandparent == output_level_ + 1)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L > output_level_).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // through "output_level" will be merged to produce a set of
+  // "output_level" files.
   int level() const { return level_; }
 
+  // Return the level the compaction writes to: "level+1" for the
+  // compactions of kLevelCompaction, possibly further down for those of
+  // kUniversalCompaction.
+  int output_level() const { return output_level_; }
+
+  // Return the number of levels the compaction reads from.
+  int num_input_levels() const { return output_level_ - level_ + 1; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
 
-  // "which" must be either 0 or 1
+  // "which" must be in [0, num_input_levels())
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()+which" ("which" must be in
+  // [0, num_input_levels())).
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
@@ -341,17 +482,46 @@ class Compaction {
   // moving a single input file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
+  // Is this a compaction of kFIFOCompaction that just drops its input
+  // files, without reading them or writing any output?
+  bool IsDeletion() const { return deletion_; }
+
+  // Return the newest write time of the input files (see FileMetaData).
+  uint64_t NewestWriteTime() const;
+
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Like IsBaseLevelForKey(), for all the user keys in [begin,end].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
+
+  // Returns true iff some input file holds range tombstones.
+  bool HasRangeDeletions() const;
+
+  // Leave the input files whose entries are all deleted by "tombstones",
+  // as seen by every snapshot at or after "smallest_snapshot", out of the
+  // files read by VersionSet::MakeInputIterator().  They are still deleted
+  // by AddInputDeletions().  Returns the number of files left out.
+  int SkipCoveredInputs(const RangeTombstoneList& tombstones,
+                        SequenceNumber smallest_snapshot);
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // Split the key space of this compaction into at most
+  // "max_subcompactions" ranges holding roughly equal amounts of input,
+  // cut at the smallest keys of the input files.  Stores the user keys
+  // at which the second and later ranges start in *boundaries, in
+  // increasing order.  Leaves *boundaries empty if the compaction should
+  // not be split.
+  void GetSubcompactionBoundaries(int max_subcompactions,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
   // is successful.
@@ -361,31 +531,33 @@ class Compaction {
   friend class Version;
   friend class VersionSet;
 
-  Compaction(const Options* options, int level);
+  Compaction(const Options* options, int level, int output_level);
+
+  // Return the files of inputs_[which] that have to be read.
+  const std::vector<FileMetaData*>& files_to_read(int which) const {
+    return skipped_inputs_ ? inputs_to_read_[which] : inputs_[which];
+  }
 
   int level_;
+  int output_level_;
+  bool deletion_;
   uint64_t max_output_file_size_;
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
-  std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
+  // Each compaction reads inputs from "level_" through "output_level_";
+  // inputs_[which] holds the inputs from "level_+which".  Compactions
+  // of kLevelCompaction only use inputs_[0] and inputs_[1].
+  std::vector<FileMetaData*> inputs_[config::kNumLevels];
+
+  // If skipped_inputs_, the files of inputs_ left after SkipCoveredInputs().
+  bool skipped_inputs_;
+  std::vector<FileMetaData*> inputs_to_read_[config::kNumLevels];
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // Files in output_level_ + 1 that overlap this compaction, used to
+  // decide where to split the output (parent == output_level_,
+  // grandparent == output_level_ + 1)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
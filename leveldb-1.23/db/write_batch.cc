@@ -8,7 +8,8 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -32,6 +33,8 @@ WriteBatch::~WriteBatch() = default;
 
 WriteBatch::Handler::~Handler() = default;
 
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -68,6 +71,14 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -108,6 +119,13 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
 void WriteBatch::Append(const WriteBatch& source) {
   WriteBatchInternal::Append(this, &source);
 }
@@ -117,13 +135,25 @@ class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
   MemTable* mem_;
+  bool concurrent_;
 
   void Put(const Slice& key, const Slice& value) override {
-    mem_->Add(sequence_, kTypeValue, key, value);
-    sequence_++;
+    Add(kTypeValue, key, value);
   }
   void Delete(const Slice& key) override {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    Add(kTypeDeletion, key, Slice());
+  }
+  void DeleteRange(const Slice& begin, const Slice& end) override {
+    Add(kTypeRangeDeletion, begin, end);
+  }
+
+ private:
+  void Add(ValueType type, const Slice& key, const Slice& value) {
+    if (concurrent_) {
+      mem_->AddConcurrently(sequence_, type, key, value);
+    } else {
+      mem_->Add(sequence_, type, key, value);
+    }
     sequence_++;
   }
 };
@@ -133,6 +163,16 @@ Status WriteBatchInternal::InsertInto(const WriteBatch* b, MemTable* memtable) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
   inserter.mem_ = memtable;
+  inserter.concurrent_ = false;
+  return b->Iterate(&inserter);
+}
+
+Status WriteBatchInternal::InsertIntoConcurrently(const WriteBatch* b,
+                                                  MemTable* memtable) {
+  MemTableInserter inserter;
+  inserter.sequence_ = WriteBatchInternal::Sequence(b);
+  inserter.mem_ = memtable;
+  inserter.concurrent_ = true;
   return b->Iterate(&inserter);
 }
 
@@ -37,6 +37,11 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Like InsertInto(), but other threads may insert into *memtable with
+  // InsertIntoConcurrently() at the same time.
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       MemTable* memtable);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
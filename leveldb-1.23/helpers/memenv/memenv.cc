@@ -286,6 +286,19 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  Status ReuseWritableFile(const std::string& fname,
+                           const std::string& old_fname,
+                           WritableFile** result) override {
+    // Memory is not allocated ahead of writes, so there is nothing to save
+    // by writing over the old contents.
+    Status s = RenameFile(old_fname, fname);
+    if (!s.ok()) {
+      *result = nullptr;
+      return s;
+    }
+    return NewWritableFile(fname, result);
+  }
+
   bool FileExists(const std::string& fname) override {
     MutexLock lock(&mutex_);
     return file_map_.find(fname) != file_map_.end();
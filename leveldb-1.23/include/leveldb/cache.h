@@ -19,6 +19,7 @@
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
 
 #include <cstdint>
+#include <string>
 
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
@@ -31,6 +32,23 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but splits the cache into "num_shards"
+// independently locked shards (rounded up to a power of two, at most
+// 1024).  More shards reduce lock contention between concurrent readers;
+// use at least the number of threads expected to read concurrently.  If
+// num_shards <= 0, the count is chosen from the number of hardware threads.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shards);
+
+// Create a new cache with a fixed size capacity.  This implementation
+// of Cache is scan resistant: entries that are only looked up once (e.g.
+// by a long range scan) are evicted before entries that are reused.
+// Unlike with the LRU cache, concurrent Lookup() calls share the internal
+// locks, and Release() takes none.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity);
+
+// Like NewClockCache(capacity), with "num_shards" as for NewLRUCache().
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shards);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -97,6 +115,11 @@ class LEVELDB_EXPORT Cache {
   // cache.
   virtual size_t TotalCharge() const = 0;
 
+  // Return a human-readable table of per-shard statistics: usage,
+  // capacity, hits, misses, inserts, evictions and lock acquisitions that
+  // had to wait.  The default implementation returns an empty string.
+  virtual std::string GetStats() const;
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
@@ -7,10 +7,13 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -21,6 +24,7 @@ static const int kMinorVersion = 23;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
+struct IngestExternalFileOptions;
 class WriteBatch;
 
 // Abstract handle to particular state of a DB.
@@ -72,11 +76,36 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all of the keys in
+  // ["begin","end").  Returns OK on success, and a non-OK status on error.
+  // The range is deleted with a single tombstone, whatever the number of
+  // keys it holds; the keys are only dropped from the files by later
+  // compactions.
+  //
+  // The default implementation writes a batch with a single
+  // WriteBatch::DeleteRange() operation.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
   virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
 
+  // Bulk load the table file "fname", built with an SstFileWriter from
+  // options that match the ones of this database, into the database.  The
+  // entries of the file take precedence over any older entry for their keys
+  // but are hidden from existing snapshots.  The file is placed at the
+  // deepest level it does not overlap with, without being rewritten, so
+  // its entries skip the memtable, the log and the compactions of the levels
+  // above.  Returns OK on success, and a non-OK status on error, in which
+  // case the database is left unchanged.
+  //
+  // The default implementation returns a NotSupported error.
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    const std::string& fname);
+
   // If the database contains an entry for "key" store the
   // corresponding value in *value and return OK.
   //
@@ -87,6 +116,28 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Like Get(), but a value found in a table is not copied: *value is
+  // pinned to the block holding it instead, and keeps that block (and the
+  // table) in memory until it is reset or destroyed.  Any value *value
+  // held before the call is released first.  *value must be reset or
+  // destroyed before this db is deleted.
+  //
+  // The default implementation calls Get() and copies the value into the
+  // buffer owned by *value.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value);
+
+  // Look up every key in "keys" against a single view of the database.
+  // On return (*values)[i] and (*statuses)[i] hold what Get() would have
+  // stored and returned for keys[i].  Both vectors are resized to
+  // keys.size().
+  //
+  // The default implementation calls Get() for each key under a snapshot.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +172,9 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.block-cache-stats" - returns a multi-line string with the
+  //     usage, hit, miss, insert, eviction and lock-wait counters of each
+  //     shard of the block cache (see Cache::GetStats()).
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -85,6 +85,25 @@ class LEVELDB_EXPORT Env {
   virtual Status NewRandomAccessFile(const std::string& fname,
                                      RandomAccessFile** result) = 0;
 
+  // Like NewRandomAccessFile(), but the caller decides whether the file
+  // is memory-mapped, bypassing any limit the Env places on the number
+  // of memory-mapped files.  Envs that cannot memory-map files may
+  // ignore "use_mmap".
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewRandomAccessFileWithMmap(const std::string& fname,
+                                             bool use_mmap,
+                                             RandomAccessFile** result);
+
+  // Like NewRandomAccessFile(), but reads bypass the operating system's
+  // page cache where the platform and file system allow it.  Meant for
+  // large one-off reads, such as compaction inputs, that would otherwise
+  // evict data other readers depend on.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
   // Create an object that writes to a new file with the specified
   // name.  Deletes any existing file with the same name and creates a
   // new file.  On success, stores a pointer to the new file in
@@ -95,6 +114,15 @@ class LEVELDB_EXPORT Env {
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) = 0;
 
+  // Like NewWritableFile(), but writes bypass the operating system's page
+  // cache where the platform and file system allow it.  Data appended to
+  // the file may not reach the file before the next Sync() or Close();
+  // Flush() is not enough.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Create an object that either appends to an existing file, or
   // writes to a new file (if the file does not exist to begin with).
   // On success, stores a pointer to the new file in *result and
@@ -110,6 +138,20 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Rename the existing file "old_fname" to "fname", and create an object
+  // that writes over its contents from the beginning of the file, without
+  // truncating it first.  On success, stores a pointer to the new file in
+  // *result and returns OK.  On failure stores nullptr in *result and
+  // returns non-OK.
+  //
+  // The returned file will only be accessed by one thread at a time.
+  //
+  // The default implementation renames the file and calls
+  // NewWritableFile(), which truncates it.
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -197,6 +239,20 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Arrange to run "(*function)(arg)" once in a background thread that is
+  // reserved for short, latency-sensitive work such as memtable flushes,
+  // so that it does not queue up behind long-running work passed to
+  // Schedule().
+  //
+  // The default implementation calls Schedule().
+  virtual void ScheduleHighPriority(void (*function)(void* arg), void* arg);
+
+  // Allow up to "number" functions passed to Schedule() to run at the same
+  // time.  The number of background threads never decreases.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -269,6 +325,34 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // One of the reads of a MultiRead() call.  The caller fills in offset,
+  // n and scratch; MultiRead() fills in result and status as Read() would.
+  struct ReadRequest {
+    uint64_t offset;
+    size_t n;
+    char* scratch;
+    Slice result;
+    Status status;
+  };
+
+  // Perform the reads described by requests[0,n-1].  Implementations
+  // may keep several of them in flight at once, so that the latency of
+  // the batch is close to that of a single read.  Returns OK if every
+  // read succeeded, otherwise the status of the first failed read.
+  //
+  // The default implementation calls Read() for each request in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status MultiRead(ReadRequest* requests, size_t n) const;
+
+  // Hint that [offset, offset+n) is likely to be read soon.  The
+  // implementation may start loading it in the background.
+  //
+  // The default implementation does nothing.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Prefetch(uint64_t offset, size_t n) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -287,6 +371,13 @@ class LEVELDB_EXPORT WritableFile {
   virtual Status Close() = 0;
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
+
+  // Hint that the file will grow to about "size" bytes, so that the file
+  // system may allocate its space now rather than as data is appended.
+  // Does not change the size of the file.
+  //
+  // The default implementation does nothing.
+  virtual void Preallocate(uint64_t size);
 };
 
 // An interface for writing log messages.
@@ -349,12 +440,28 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
                              RandomAccessFile** r) override {
     return target_->NewRandomAccessFile(f, r);
   }
+  Status NewRandomAccessFileWithMmap(const std::string& f, bool use_mmap,
+                                     RandomAccessFile** r) override {
+    return target_->NewRandomAccessFileWithMmap(f, use_mmap, r);
+  }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
   Status NewWritableFile(const std::string& f, WritableFile** r) override {
     return target_->NewWritableFile(f, r);
   }
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    return target_->NewDirectWritableFile(f, r);
+  }
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status ReuseWritableFile(const std::string& f, const std::string& old_f,
+                           WritableFile** r) override {
+    return target_->ReuseWritableFile(f, old_f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -384,6 +491,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleHighPriority(void (*f)(void*), void* a) override {
+    return target_->ScheduleHighPriority(f, a);
+  }
+  void SetBackgroundThreads(int n) override {
+    return target_->SetBackgroundThreads(n);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
@@ -67,6 +67,19 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a cache-line-blocked bloom filter
+// with approximately the specified number of bits per key.  All of the
+// probes for a key fall into one 64-byte cache line of the filter, so a
+// lookup costs at most one cache miss (and is vectorized on CPUs with
+// AVX2), in exchange for a slightly higher false positive rate than
+// NewBloomFilterPolicy() with the same number of bits per key.  Best
+// combined with Options::full_filter.
+//
+// The same caveats as for NewBloomFilterPolicy() apply to comparators
+// that ignore parts of the keys.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -6,8 +6,10 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <vector>
 
 #include "leveldb/export.h"
+#include "leveldb/slice.h"
 
 namespace leveldb {
 
@@ -16,6 +18,8 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class RateLimiter;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -26,7 +30,30 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZstdCompression = 0x2,
+  kLZ4Compression = 0x3
+};
+
+// The strategy compactions follow to bound the number of tables that
+// reads have to search.
+enum CompactionStyle {
+  // Every level above level-0 holds non-overlapping files and is merged
+  // into the next level once it outgrows its size limit.  Keeps the space
+  // and read overhead low, but rewrites every byte once per level.
+  kLevelCompaction = 0,
+
+  // Every level-0 file and every non-empty level above level-0 is one
+  // sorted run.  Runs of similar size are merged into one larger run, as
+  // in a size-tiered scheme.  Rewrites every byte fewer times than
+  // kLevelCompaction, at the cost of more space and more runs to search.
+  kUniversalCompaction = 1,
+
+  // Every table file stays in level-0 and is never merged.  Files are
+  // dropped whole once all their data is older than Options::ttl_seconds,
+  // which costs almost no I/O.  Meant for cache-like data that is only
+  // needed for some time after it was written.
+  kFIFOCompaction = 2
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -86,6 +113,13 @@ struct LEVELDB_EXPORT Options {
   // one open file per 2MB of working set).
   int max_open_files = 1000;
 
+  // Number of open table files that the DB may memory-map.  Values read
+  // from a memory-mapped table are not copied into a read buffer, and
+  // values returned by the PinnableSlice flavor of DB::Get() point right
+  // into the mapping.  Negative values leave the choice to the Env (the
+  // default Env maps up to 1000 files per process on 64-bit platforms).
+  int max_mmap_files = -1;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -104,6 +138,17 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, each data block ends with a small hash table that maps the
+  // user keys in the block to their restart point, so that DB::Get()
+  // jumps straight to the right restart point (or learns that the key is
+  // not in the block) instead of binary searching the restart points.
+  // Costs about 1.3 bytes per key.  Blocks written with a hash index
+  // cannot be read by versions of leveldb that predate it, but blocks
+  // without one are read as before.
+  //
+  // Default: false
+  bool data_block_hash_index = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -128,8 +173,39 @@ struct LEVELDB_EXPORT Options {
   // worth switching to kNoCompression.  Even if the input data is
   // incompressible, the kSnappyCompression implementation will
   // efficiently detect that and will switch to uncompressed mode.
+  //
+  // kZstdCompression compresses noticeably better at a higher cost, and
+  // kLZ4Compression is about as fast as kSnappyCompression.  Blocks are
+  // stored uncompressed if the chosen algorithm is not compiled in.
   CompressionType compression = kSnappyCompression;
 
+  // If non-empty, the files written to level L are compressed with
+  // compression_per_level[L] instead of "compression" (levels beyond the
+  // end of the vector use its last entry).  For example, {kLZ4Compression,
+  // kLZ4Compression, kZstdCompression} keeps the frequently rewritten
+  // levels 0 and 1 cheap to compress and read, and stores the bulk of the
+  // data in the lower levels compactly.  Memtable flushes use the entry
+  // for level 0.
+  std::vector<CompressionType> compression_per_level;
+
+  // Compression level used by kZstdCompression.  Higher levels compress
+  // better but more slowly; negative levels trade ratio for speed.
+  int zstd_compression_level = 1;
+
+  // If non-zero, each table compressed with kZstdCompression trains a
+  // dictionary of up to this many bytes from its first data blocks, and
+  // compresses the rest of its data blocks with it.  The dictionary is
+  // stored in the table.  This improves the compression of small blocks
+  // whose contents resemble each other, at the cost of slower compression.
+  //
+  // Default: 0, i.e. no dictionary
+  size_t zstd_max_dict_bytes = 0;
+
+  // Number of bytes of data blocks to sample for dictionary training (see
+  // zstd_max_dict_bytes).  Data blocks written before this much data has
+  // been sampled are compressed without the dictionary.
+  size_t zstd_max_train_bytes = 256 * 1024;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
@@ -140,6 +216,181 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, the index and filter of each table are split into partitions
+  // of about metadata_block_size bytes, and only a small top-level index
+  // stays in memory while the table is open.  Partitions are read through
+  // the block cache when needed.  This bounds the memory used by open
+  // tables, so that many more of them can be kept open, at the cost of an
+  // extra block cache lookup (or read) per point lookup.
+  //
+  // Default: false
+  bool partition_index_and_filters = false;
+
+  // Approximate size of the index partitions of a table when
+  // partition_index_and_filters is true.
+  size_t metadata_block_size = 4096;
+
+  // If true, each table gets a single filter over all of its keys instead
+  // of one filter per 2KB of data blocks, and the filter is checked before
+  // the index is searched.  Best combined with
+  // NewBlockedBloomFilterPolicy().  Ignored if partition_index_and_filters
+  // is true.
+  //
+  // Default: false
+  bool full_filter = false;
+
+  // If non-null (and filter_policy is non-null), the filters of the tables
+  // also hold the prefix that this transform extracts from each key.
+  // Iterators bounded to a prefix (see ReadOptions::prefix) then skip the
+  // tables whose full filter (see full_filter) rules the prefix out.  The
+  // comparator must sort all keys sharing a prefix next to each other, in
+  // the same order as BytewiseComparator() would place the prefixes.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // Maximum number of threads that a single compaction may use.  When
+  // greater than one, a compaction with several input files is split
+  // into key ranges at input file boundaries, and each range is merged
+  // on its own thread into its own output files.  This shortens large
+  // compactions (and therefore write stalls) on machines with idle cores.
+  //
+  // Default: 1, i.e. every compaction runs on a single thread.
+  int max_subcompactions = 1;
+
+  // Maximum number of compactions that may run at the same time.  Only
+  // compactions that read and write disjoint sets of levels run
+  // concurrently, e.g. level-0 into level-1 next to level-2 into level-3.
+  // Memtable flushes do not count against this limit: they run on a
+  // separate high priority thread (see Env::ScheduleHighPriority()).
+  //
+  // Default: 1
+  int max_background_compactions = 1;
+
+  // If true, compactions read their input tables and write their output
+  // tables bypassing the operating system's page cache (see
+  // Env::NewDirectRandomAccessFile() and Env::NewDirectWritableFile()), so
+  // that they do not evict the pages that reads depend on, nor build up
+  // dirty pages that are written back in bursts.  Inputs are read through
+  // a readahead window to make up for the lost readahead of the operating
+  // system.  Memtable flushes still go through the page cache.
+  //
+  // Default: false
+  bool use_direct_io_for_compaction = false;
+
+  // The strategy compactions follow.  A DB may be reopened with another
+  // style.
+  //
+  // Default: kLevelCompaction
+  CompactionStyle compaction_style = kLevelCompaction;
+
+  // Universal compaction starts once there are as many sorted runs as
+  // level-0 files that trigger a level-0 compaction.  It then merges the
+  // newest sorted runs it can find that are each at most this percentage
+  // larger than all the runs merged before them.
+  //
+  // Default: 1
+  int universal_size_ratio = 1;
+
+  // Minimum number of sorted runs that universal compaction merges
+  // because of their sizes.
+  //
+  // Default: 2
+  int universal_min_merge_width = 2;
+
+  // Universal compaction merges all sorted runs once the runs other than
+  // the oldest one hold more than this percentage of the bytes of the
+  // oldest one.  Bounds the space overhead of the DB.
+  //
+  // Default: 200
+  int universal_max_size_amplification_percent = 200;
+
+  // With kFIFOCompaction, a table file is dropped once all the data it
+  // holds was written at least this many seconds ago.  A key overwritten
+  // or deleted by a dropped file may then show an older value again if
+  // that value is held by a file that is not dropped yet; data that is
+  // only ever written with kFIFOCompaction is dropped oldest file first,
+  // so this only happens to data left by another style.  A background
+  // thread drops the files as they expire, even if the DB is idle.  Zero
+  // means data never expires.
+  //
+  // Default: 0
+  uint64_t ttl_seconds = 0;
+
+  // If non-null, bounds the rate at which memtable flushes and compactions
+  // write table files.  Compactions are slowed down less as level-0 fills
+  // up: fully throttled up to the level-0 compaction trigger, unthrottled
+  // once level-0 is large enough for writes to be slowed down.  Flushes are
+  // never held up by compactions.  See leveldb/rate_limiter.h.
+  //
+  // Default: nullptr
+  RateLimiter* rate_limiter = nullptr;
+
+  // If true, writes go through a two stage pipeline: while one group of
+  // writes is being applied to the memtable, the next group may already
+  // append to the log.  This raises write throughput with many concurrent
+  // writers.  Writes still become visible to readers in sequence order.
+  //
+  // Default: false
+  bool enable_pipelined_write = false;
+
+  // If true, the logs are replayed by DB::Open() through a pipeline: a
+  // thread reads and checks the log records ahead of their insertion into
+  // the memtable, and full memtables are written to level-0 tables in the
+  // background while the replay goes on.  This shortens recovery from
+  // large logs.
+  //
+  // Default: false
+  bool enable_pipelined_recovery = false;
+
+  // If true, the writers of a write group apply their own batches to the
+  // memtable in parallel, instead of leaving all of the group's updates
+  // to the group leader.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write = false;
+
+  // If non-zero, a group of sync writes (see WriteOptions::sync) waits up
+  // to this many microseconds for more writes to join it before the log is
+  // synced, so that a single sync covers them all.  This trades latency
+  // for sync throughput with many concurrent writers.
+  //
+  // Default: 0
+  uint64_t wal_group_commit_micros = 0;
+
+  // If non-zero, the wait above ends early once the writes waiting for the
+  // sync add up to this many bytes.
+  //
+  // Default: 0
+  size_t wal_group_commit_bytes = 0;
+
+  // If true, a dedicated thread syncs the log on behalf of sync writes.
+  // The writer that appends a group of sync writes to the log then hands
+  // the log over to the next group right away, and only waits for the
+  // sync afterwards; one sync may cover several groups.  Sync writes only
+  // become visible to readers once their sync completes, and so do the
+  // writes that follow them: a non-sync write that follows a sync write
+  // still waits for that sync before it returns.  Writes whose sync fails
+  // never become visible.
+  //
+  // Default: false
+  bool enable_wal_sync_thread = false;
+
+  // If non-zero, up to this many log files that are no longer needed are
+  // kept, and overwritten by new log files instead of creating them.
+  // Writing over blocks the file system has already allocated saves it
+  // from updating the file's metadata on every sync of the log.
+  //
+  // Logs are then written in a format that older versions of leveldb
+  // cannot read.  Such logs are never appended to (see reuse_logs).
+  //
+  // Default: 0
+  size_t recycle_log_file_num = 0;
+
+  // If true, the space for each new log file is allocated up front (with
+  // fallocate() where available), for about write_buffer_size bytes.
+  //
+  // Default: false
+  bool preallocate_log_files = false;
 };
 
 // Options that control read operations
@@ -159,6 +410,20 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If non-zero, iterators that read several data blocks of a table in
+  // file order start reading that many bytes ahead at a time, serving
+  // the following blocks from memory and asking the operating system to
+  // prefetch the next window.  Useful for long range scans over data that
+  // is not in the block cache.
+  size_t readahead_size = 0;
+
+  // If non-empty, iterators only see the keys that start with "prefix",
+  // as if the DB held no other keys.  If "prefix" is in the domain of
+  // Options::prefix_extractor, tables whose filter rules out its
+  // extracted prefix are not read at all.  The data "prefix" points to is
+  // copied when the iterator is created.
+  Slice prefix;
 };
 
 // Options that control write operations
@@ -182,6 +447,16 @@ struct LEVELDB_EXPORT WriteOptions {
   bool sync = false;
 };
 
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  IngestExternalFileOptions() = default;
+
+  // If true, the file is moved into the database directory, which must be
+  // on the same file system, instead of being copied there and left
+  // unchanged.
+  bool move_files = false;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
@@ -0,0 +1,95 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is a Slice that may keep the storage it refers to alive.
+// DB::Get() uses it to return a value found in a table without copying it:
+// the slice then points into the cached block (or the mmap()ed table file)
+// holding the value, and that block stays pinned until the PinnableSlice is
+// reset or destroyed.  Values that cannot be pinned are copied into a buffer
+// owned by the PinnableSlice.
+//
+// Pinned values hold on to blocks of the block cache and to open tables, so
+// they should be released once the caller is done with them.  A value pinned
+// by DB::Get() must be reset or destroyed before the DB is deleted.
+//
+// A PinnableSlice is not thread-safe; callers sharing one across threads
+// must use external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <cassert>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT PinnableSlice : public Slice {
+ public:
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+
+  PinnableSlice() : cleanup_(nullptr), arg1_(nullptr), arg2_(nullptr) {}
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  ~PinnableSlice() { Reset(); }
+
+  // Refer to "s", whose storage stays valid until (*cleanup)(arg1, arg2)
+  // is called by Reset() or the destructor.
+  // REQUIRES: !IsPinned()
+  void PinSlice(const Slice& s, CleanupFunction cleanup, void* arg1,
+                void* arg2) {
+    assert(!IsPinned());
+    Slice::operator=(s);
+    cleanup_ = cleanup;
+    arg1_ = arg1;
+    arg2_ = arg2;
+  }
+
+  // Copy "s" into the buffer owned by this slice and refer to it.
+  // REQUIRES: !IsPinned()
+  void PinSelf(const Slice& s) {
+    assert(!IsPinned());
+    self_.assign(s.data(), s.size());
+    Slice::operator=(self_);
+  }
+
+  // Refer to the buffer owned by this slice after it was filled in
+  // through GetSelf().
+  // REQUIRES: !IsPinned()
+  void PinSelf() {
+    assert(!IsPinned());
+    Slice::operator=(self_);
+  }
+
+  // Return the buffer owned by this slice.  Call PinSelf() once it has been
+  // filled in.
+  std::string* GetSelf() { return &self_; }
+
+  // Returns true iff the slice refers to storage it does not own.
+  bool IsPinned() const { return cleanup_ != nullptr; }
+
+  // Release the pinned storage, if any, and make the slice empty.
+  void Reset() {
+    if (cleanup_ != nullptr) {
+      (*cleanup_)(arg1_, arg2_);
+      cleanup_ = nullptr;
+    }
+    self_.clear();
+    clear();
+  }
+
+ private:
+  std::string self_;
+  CleanupFunction cleanup_;
+  void* arg1_;
+  void* arg2_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
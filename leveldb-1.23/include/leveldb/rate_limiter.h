@@ -0,0 +1,49 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which background work (memtable flushes
+// and compactions) writes table files, so that it leaves disk bandwidth to
+// foreground reads.  A single RateLimiter may be shared by several DBs to
+// bound their combined rate.
+//
+// A RateLimiter is thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  // Memtable flushes are requested at kHigh priority, compactions at kLow
+  // priority.
+  enum IOPriority { kLow, kHigh };
+
+  virtual ~RateLimiter();
+
+  // Blocks until "bytes" more bytes may be written at "priority".
+  virtual void Request(size_t bytes, IOPriority priority) = 0;
+
+  // Changes the rate.  Values <= 0 disable rate limiting.
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  virtual int64_t GetBytesPerSecond() const = 0;
+};
+
+// Return a new rate limiter that lets through "bytes_per_second" bytes per
+// second, in bursts of up to a tenth of that.  All requests are charged
+// against that rate, but kHigh requests only wait for the bytes requested
+// at kHigh priority: they slow down kLow requests but are never held up by
+// them.
+LEVELDB_EXPORT RateLimiter* NewTokenBucketRateLimiter(
+    int64_t bytes_per_second);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,49 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to a prefix of it, e.g. "tenant|entity|ts"
+// to "tenant|entity|".  If Options::prefix_extractor is set, the prefix of
+// every key is added to the filters of the tables, and iterators bounded
+// to a prefix (see ReadOptions::prefix) skip the tables whose filter rules
+// out that prefix.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  Note that if the transform
+  // changes in an incompatible way, the name returned by this method
+  // must be changed.  Otherwise, filters of old tables may be used to
+  // look up prefixes they do not hold.
+  virtual const char* Name() const = 0;
+
+  // Returns true iff "key" has a prefix, i.e. Transform() may be called
+  // for it.
+  virtual bool InDomain(const Slice& key) const = 0;
+
+  // Returns the prefix of "key", which must be in the domain.  The result
+  // must be a prefix of "key", and for every key k that starts with
+  // Transform(key), k must be in the domain and Transform(k) must equal
+  // Transform(key).
+  virtual Slice Transform(const Slice& key) const = 0;
+};
+
+// Return a new transform that maps keys of at least "prefix_len" bytes to
+// their first "prefix_len" bytes.  Shorter keys have no prefix.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,71 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any database, from keys
+// added in order, that can later be bulk loaded into a database with
+// DB::IngestExternalFile().  The entries of the file bypass the memtable
+// and the write-ahead log, and are written exactly once.
+//
+// An SstFileWriter is not thread-safe: all threads accessing the same
+// SstFileWriter must use external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // Create a writer of files for a database opened with "options".  The
+  // comparator, filter policy, prefix extractor, block and compression
+  // options of the file are taken from "options", and must match the ones
+  // of the database the file is ingested into.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Abandons the file being written, if Finish() has not been called.
+  ~SstFileWriter();
+
+  // Create the file "fname" and prepare to add entries to it.
+  // REQUIRES: Open() has not been called, or the previous file is finished.
+  Status Open(const std::string& fname);
+
+  // Add the mapping "key"->"value" to the file.  Returns an error if "key"
+  // is not after any previously added key according to the comparator.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Add a deletion of "key" to the file, which hides the older entries for
+  // "key" of the database the file is ingested into.  Returns an error if
+  // "key" is not after any previously added key according to the comparator.
+  Status Delete(const Slice& key);
+
+  // Finish writing the file and close it.  Returns an error if no entries
+  // were added.
+  Status Finish();
+
+  // Size of the file generated so far.  If invoked after a successful
+  // Finish() call, returns the size of the final generated file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
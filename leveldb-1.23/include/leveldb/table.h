@@ -14,6 +14,7 @@ namespace leveldb {
 
 class Block;
 class BlockHandle;
+struct BlockContents;
 class Footer;
 struct Options;
 class RandomAccessFile;
@@ -62,19 +63,86 @@ class LEVELDB_EXPORT Table {
   friend class TableCache;
   struct Rep;
 
+  class ReadaheadFile;
+
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  // BlockReader() for iterators with ReadOptions::readahead_size set; "arg"
+  // is the iterator's ReadaheadFile.
+  static Iterator* ReadaheadBlockReader(void*, const ReadOptions&,
+                                        const Slice&);
+
+  // Returns an iterator over the data block at "index_value", reading it
+  // through "file" if it is not in the block cache.  If "point_lookup" is
+  // true, the iterator is only used to look up keys (see
+  // Block::NewIterator()).
+  Iterator* ReadDataBlock(RandomAccessFile* file, const ReadOptions&,
+                          const Slice& index_value,
+                          bool point_lookup = false) const;
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
+  // Returns "iter", an iterator over entries of the table, or if the table
+  // has a global sequence number, an iterator that returns the keys of
+  // "iter" with that sequence number.  Takes ownership of "iter".
+  Iterator* ApplyGlobalSequence(Iterator* iter) const;
+
+  // Like NewIterator() with ReadOptions::readahead_size set, but reads
+  // the data blocks from "file", which must hold the same contents as the
+  // file the table was opened from and outlive the returned iterator.
+  Iterator* NewReadaheadIterator(const ReadOptions&,
+                                 RandomAccessFile* file) const;
+
+  // Returns an iterator over the index entries (data block handles) of
+  // the table, reading index partitions as needed.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Returns false if the filter rules out that "key" is in the table.
+  // "index_value" is the value of the entry of the index block (the
+  // top-level index if partitioned) covering "key".
+  bool KeyMayMatch(const ReadOptions&, const Slice& index_value,
+                   const Slice& key) const;
+
+  // Returns false if the full filter of the table (if any) rules out
+  // that "key" is in the table.  Needs no index search.
+  bool FullFilterMayMatch(const Slice& key) const;
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
+  //
+  // If "pinned" is non-null and such a call was made, *pinned is set to
+  // the iterator over the data block holding the entry instead of
+  // deleting it, so that k and v stay valid until the caller deletes it.
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
-
-  void ReadMeta(const Footer& footer);
+                                           const Slice& v),
+                     Iterator** pinned = nullptr);
+
+  // InternalGet() for keys[0,n-1], which must be in increasing order.
+  // Calls (*handle_result)(args[i], ...) for keys[i] and stores the
+  // status of that lookup in statuses[i].  Each data block is read at
+  // most once for the whole batch.
+  void InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                        void* const* args,
+                        void (*handle_result)(void* arg, const Slice& k,
+                                              const Slice& v),
+                        Status* statuses);
+
+  // Returns an iterator over a data block that was read by ReadBlocks()
+  // on behalf of InternalMultiGet(), adding it to the block cache if
+  // appropriate.  The iterator is only used to look up keys.
+  Iterator* NewPrefetchedBlockIterator(const ReadOptions& options,
+                                       const BlockHandle& handle,
+                                       const BlockContents& contents,
+                                       const Status& status);
+
+  // Returns an iterator over the range tombstones of the table (see
+  // TableBuilder::AddRangeDeletion()), or nullptr if it has none.
+  Iterator* NewRangeTombstoneIterator() const;
+
+  Status ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadCompressionDict(const Slice& dict_handle_value);
 
   Rep* const rep_;
 };
@@ -37,6 +37,9 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // Called for DeleteRange() records.  The default implementation
+    // ignores them.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
   };
 
   WriteBatch();
@@ -53,6 +56,12 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase the mappings for all of the keys in ["begin","end") from the
+  // database.  Keys written to the database later, including by later
+  // operations of this batch, are not affected.  Does nothing if "begin"
+  // is not before "end" according to the comparator of the database.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
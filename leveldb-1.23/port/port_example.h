@@ -30,6 +30,10 @@ class LOCKABLE Mutex {
   // Will deadlock if the mutex is already locked by this thread.
   void Lock() EXCLUSIVE_LOCK_FUNCTION();
 
+  // Lock the mutex if it is not held by anyone, without waiting.
+  // Returns true iff the mutex was locked.
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true);
+
   // Unlock the mutex.
   // REQUIRES: This mutex was locked by this thread.
   void Unlock() UNLOCK_FUNCTION();
@@ -51,6 +55,11 @@ class CondVar {
   // REQUIRES: this thread holds *mu
   void Wait();
 
+  // Like Wait(), but also returns once "micros" microseconds have passed.
+  // Returns true if it returned because of the timeout.
+  // REQUIRES: this thread holds *mu
+  bool TimedWait(uint64_t micros);
+
   // If there are some threads waiting, wake up at least one of them.
   void Signal();
 
@@ -81,6 +90,50 @@ bool Snappy_GetUncompressedLength(const char* input, size_t length,
 bool Snappy_Uncompress(const char* input_data, size_t input_length,
                        char* output);
 
+// Store the Zstd compression of "input[0,input_length-1]" at the given
+// compression level in *output.  If dict_length is non-zero, compress
+// with the dictionary "dict[0,dict_length-1]" (see Zstd_TrainDictionary).
+// Returns false if Zstd is not supported by this port.
+bool Zstd_Compress(int level, const char* input, size_t input_length,
+                   const char* dict, size_t dict_length, std::string* output);
+
+// If input[0,input_length-1] looks like a valid Zstd compressed buffer,
+// store the size of the uncompressed data in *result and return true.
+// Else return false.
+bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                size_t* result);
+
+// Attempt to Zstd uncompress input[0,input_length-1] into *output.  The
+// dictionary is only used if the input was compressed with one.  Returns
+// true if successful, false if the input is invalid or needs a dictionary
+// that was not supplied.
+//
+// REQUIRES: at least the first "n" bytes of output[] must be writable
+// where "n" is the result of a successful call to
+// Zstd_GetUncompressedLength.
+bool Zstd_Uncompress(const char* input_data, size_t input_length,
+                     const char* dict, size_t dict_length, char* output);
+
+// Train a Zstd dictionary of at most max_dict_length bytes from the
+// num_samples samples concatenated in "samples", where sample i is
+// sample_sizes[i] bytes long.  Stores the dictionary in *dict and returns
+// true on success.  Returns false if Zstd is not supported by this port or
+// the samples are not suitable for training.
+bool Zstd_TrainDictionary(const char* samples, const size_t* sample_sizes,
+                          unsigned num_samples, size_t max_dict_length,
+                          std::string* dict);
+
+// Append the LZ4 compression of "input[0,input_length-1]" to *output.
+// Returns false if LZ4 is not supported by this port.
+bool LZ4_Compress(const char* input, size_t input_length,
+                  std::string* output);
+
+// Attempt to LZ4 uncompress input[0,input_length-1] into
+// output[0,output_length-1].  Returns true if successful, false if the
+// input is invalid or does not uncompress to exactly output_length bytes.
+bool LZ4_Uncompress(const char* input_data, size_t input_length,
+                    char* output, size_t output_length);
+
 // ------------------ Miscellaneous -------------------
 
 // If heap profiling is not supported, returns false.
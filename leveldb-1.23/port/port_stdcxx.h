@@ -28,8 +28,16 @@
 #if HAVE_SNAPPY
 #include <snappy.h>
 #endif  // HAVE_SNAPPY
+#if HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif  // HAVE_ZSTD
+#if HAVE_LZ4
+#include <lz4.h>
+#endif  // HAVE_LZ4
 
 #include <cassert>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
 #include <cstddef>
 #include <cstdint>
@@ -53,6 +61,7 @@ class LOCKABLE Mutex {
   Mutex& operator=(const Mutex&) = delete;
 
   void Lock() EXCLUSIVE_LOCK_FUNCTION() { mu_.lock(); }
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true) { return mu_.try_lock(); }
   void Unlock() UNLOCK_FUNCTION() { mu_.unlock(); }
   void AssertHeld() ASSERT_EXCLUSIVE_LOCK() {}
 
@@ -75,6 +84,15 @@ class CondVar {
     cv_.wait(lock);
     lock.release();
   }
+  // Returns true if "micros" microseconds passed without a wakeup.
+  bool TimedWait(uint64_t micros) {
+    std::unique_lock<std::mutex> lock(mu_->mu_, std::adopt_lock);
+    const bool timed_out =
+        cv_.wait_for(lock, std::chrono::microseconds(micros)) ==
+        std::cv_status::timeout;
+    lock.release();
+    return timed_out;
+  }
   void Signal() { cv_.notify_one(); }
   void SignalAll() { cv_.notify_all(); }
 
@@ -126,6 +144,162 @@ inline bool Snappy_Uncompress(const char* input, size_t length, char* output) {
 #endif  // HAVE_SNAPPY
 }
 
+inline bool Zstd_Compress(int level, const char* input, size_t length,
+                          const char* dict, size_t dict_length,
+                          std::string* output) {
+#if HAVE_ZSTD
+  size_t outlen = ZSTD_compressBound(length);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  ZSTD_CCtx* ctx = ZSTD_createCCtx();
+  if (dict_length > 0) {
+    outlen = ZSTD_compress_usingDict(ctx, &(*output)[0], output->size(), input,
+                                     length, dict, dict_length, level);
+  } else {
+    outlen = ZSTD_compressCCtx(ctx, &(*output)[0], output->size(), input,
+                               length, level);
+  }
+  ZSTD_freeCCtx(ctx);
+  if (ZSTD_isError(outlen)) {
+    return false;
+  }
+  output->resize(outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)level;
+  (void)input;
+  (void)length;
+  (void)dict;
+  (void)dict_length;
+  (void)output;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_GetUncompressedLength(const char* input, size_t length,
+                                       size_t* result) {
+#if HAVE_ZSTD
+  unsigned long long size = ZSTD_getFrameContentSize(input, length);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+    return false;
+  }
+  *result = size;
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)result;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_Uncompress(const char* input, size_t length, const char* dict,
+                            size_t dict_length, char* output) {
+#if HAVE_ZSTD
+  size_t outlen;
+  if (!Zstd_GetUncompressedLength(input, length, &outlen)) {
+    return false;
+  }
+  const bool use_dict = ZSTD_getDictID_fromFrame(input, length) != 0;
+  if (use_dict && dict_length == 0) {
+    return false;  // Compressed with a dictionary we do not have
+  }
+  ZSTD_DCtx* ctx = ZSTD_createDCtx();
+  size_t n;
+  if (use_dict) {
+    n = ZSTD_decompress_usingDict(ctx, output, outlen, input, length, dict,
+                                  dict_length);
+  } else {
+    n = ZSTD_decompressDCtx(ctx, output, outlen, input, length);
+  }
+  ZSTD_freeDCtx(ctx);
+  return !ZSTD_isError(n) && n == outlen;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)dict;
+  (void)dict_length;
+  (void)output;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool Zstd_TrainDictionary(const char* samples,
+                                 const size_t* sample_sizes,
+                                 unsigned num_samples, size_t max_dict_length,
+                                 std::string* dict) {
+#if HAVE_ZSTD
+  dict->resize(max_dict_length);
+  size_t n = ZDICT_trainFromBuffer(&(*dict)[0], dict->size(), samples,
+                                   sample_sizes, num_samples);
+  if (ZDICT_isError(n)) {
+    dict->clear();
+    return false;
+  }
+  dict->resize(n);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)samples;
+  (void)sample_sizes;
+  (void)num_samples;
+  (void)max_dict_length;
+  (void)dict;
+  return false;
+#endif  // HAVE_ZSTD
+}
+
+inline bool LZ4_Compress(const char* input, size_t length,
+                         std::string* output) {
+#if HAVE_LZ4
+  if (length > LZ4_MAX_INPUT_SIZE) {
+    return false;
+  }
+  const int bound = LZ4_compressBound(static_cast<int>(length));
+  const size_t start = output->size();
+  output->resize(start + bound);
+  const int outlen = LZ4_compress_default(input, &(*output)[start],
+                                          static_cast<int>(length), bound);
+  if (outlen <= 0) {
+    output->resize(start);
+    return false;
+  }
+  output->resize(start + outlen);
+  return true;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  return false;
+#endif  // HAVE_LZ4
+}
+
+inline bool LZ4_Uncompress(const char* input, size_t length, char* output,
+                           size_t output_length) {
+#if HAVE_LZ4
+  if (length > LZ4_MAX_INPUT_SIZE || output_length > LZ4_MAX_INPUT_SIZE) {
+    return false;
+  }
+  const int n =
+      LZ4_decompress_safe(input, output, static_cast<int>(length),
+                          static_cast<int>(output_length));
+  return n >= 0 && static_cast<size_t>(n) == output_length;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)input;
+  (void)length;
+  (void)output;
+  (void)output_length;
+  return false;
+#endif  // HAVE_LZ4
+}
+
 inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   // Silence compiler warnings about unused arguments.
   (void)func;
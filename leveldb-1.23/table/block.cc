@@ -19,12 +19,14 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & ~kBlockHashIndexFlag;
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      buckets_(nullptr),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
@@ -35,6 +37,23 @@ Block::Block(const BlockContents& contents)
       size_ = 0;
     } else {
       restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      entries_end_ = restart_offset_;
+      if (DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+          kBlockHashIndexFlag) {
+        // Hash index: buckets followed by their number
+        if (entries_end_ < sizeof(uint32_t)) {
+          size_ = 0;
+          return;
+        }
+        entries_end_ -= sizeof(uint32_t);
+        num_buckets_ = DecodeFixed32(data_ + entries_end_);
+        if (num_buckets_ == 0 || num_buckets_ > entries_end_) {
+          size_ = 0;
+          return;
+        }
+        entries_end_ -= num_buckets_;
+        buckets_ = reinterpret_cast<const uint8_t*>(data_ + entries_end_);
+      }
     }
   }
 }
@@ -78,8 +97,11 @@ class Block::Iter : public Iterator {
  private:
   const Comparator* const comparator_;
   const char* const data_;       // underlying block contents
-  uint32_t const restarts_;      // Offset of restart array (list of fixed32)
+  uint32_t const restarts_;      // Offset just past the last entry
+  uint32_t const restart_array_;  // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const uint8_t* const buckets_;  // Hash index used by Seek(), if non-null
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -99,7 +121,7 @@ class Block::Iter : public Iterator {
 
   uint32_t GetRestartPoint(uint32_t index) {
     assert(index < num_restarts_);
-    return DecodeFixed32(data_ + restarts_ + index * sizeof(uint32_t));
+    return DecodeFixed32(data_ + restart_array_ + index * sizeof(uint32_t));
   }
 
   void SeekToRestartPoint(uint32_t index) {
@@ -113,12 +135,16 @@ class Block::Iter : public Iterator {
   }
 
  public:
-  Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+  Iter(const Comparator* comparator, const char* data, uint32_t entries_end,
+       uint32_t restarts, uint32_t num_restarts, const uint8_t* buckets,
+       uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
-        restarts_(restarts),
+        restarts_(entries_end),
+        restart_array_(restarts),
         num_restarts_(num_restarts),
+        buckets_(buckets),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -162,6 +188,27 @@ class Block::Iter : public Iterator {
   }
 
   void Seek(const Slice& target) override {
+    if (buckets_ != nullptr && target.size() >= 8) {
+      const uint8_t restart =
+          buckets_[BlockHashIndexHash(target) % num_buckets_];
+      if (restart == kHashIndexNoEntry) {
+        // No entry for the user key of target
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return;
+      }
+      if (restart < num_restarts_) {
+        // Entries for the user key of target (if any) are all in the
+        // interval of "restart"
+        SeekToRestartPoint(restart);
+        while (ParseNextKey() && Compare(key_, target) < 0) {
+          // Keep skipping
+        }
+        return;
+      }
+      // kHashIndexCollision: fall back to a binary search
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -250,7 +297,7 @@ class Block::Iter : public Iterator {
   bool ParseNextKey() {
     current_ = NextEntryOffset();
     const char* p = data_ + current_;
-    const char* limit = data_ + restarts_;  // Restarts come right after data
+    const char* limit = data_ + restarts_;  // Restarts or hash index follow
     if (p >= limit) {
       // No more entries to return.  Mark as invalid.
       current_ = restarts_;
@@ -277,7 +324,7 @@ class Block::Iter : public Iterator {
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* comparator) {
+Iterator* Block::NewIterator(const Comparator* comparator, bool point_lookup) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
@@ -285,7 +332,9 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, entries_end_, restart_offset_,
+                    num_restarts, point_lookup ? buckets_ : nullptr,
+                    num_buckets_);
   }
 }
 
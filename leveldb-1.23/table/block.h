@@ -26,7 +26,12 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
+
+  // If "point_lookup" is true and the block has a hash index, Seek() to an
+  // internal key uses the index, and leaves the iterator invalid if the
+  // block has no entry for the user key of the target.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool point_lookup = false);
 
  private:
   class Iter;
@@ -36,6 +41,9 @@ class Block {
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
+  uint32_t entries_end_;     // Offset in data_ just past the last entry
+  const uint8_t* buckets_;   // Hash index buckets, or nullptr if none
+  uint32_t num_buckets_;
   bool owned_;               // Block owns data_[]
 };
 
@@ -25,6 +25,15 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If the block has a hash index, kBlockHashIndexFlag is set in
+// num_restarts, and the index comes between the entries and the restarts:
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+// The bucket of a user key holds the index of the restart point whose
+// interval holds the entries for that key, kHashIndexNoEntry if no key
+// maps to the bucket, or kHashIndexCollision if keys of several restart
+// intervals do.
 
 #include "table/block_builder.h"
 
@@ -33,12 +42,21 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+// Hash index buckets per key
+static const double kHashIndexBucketsPerKey = 1.33;
+
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index)
+    : options_(options),
+      restarts_(),
+      counter_(0),
+      finished_(false),
+      hash_index_(hash_index),
+      hashable_(true) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -50,20 +68,51 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hashable_ = true;
+  key_hashes_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
+  size_t hash_index_size = 0;
+  if (hash_index_) {
+    hash_index_size = static_cast<size_t>(key_hashes_.size() *
+                                          kHashIndexBucketsPerKey) +
+                      sizeof(uint32_t);
+  }
   return (buffer_.size() +                       // Raw data buffer
+          hash_index_size +                      // Hash index
           restarts_.size() * sizeof(uint32_t) +  // Restart array
           sizeof(uint32_t));                     // Restart array length
 }
 
 Slice BlockBuilder::Finish() {
+  uint32_t num_restarts = restarts_.size();
+  if (hash_index_ && hashable_ && !key_hashes_.empty() &&
+      num_restarts <= kMaxHashIndexRestarts) {
+    // Append hash index
+    const uint32_t num_buckets = std::max<uint32_t>(
+        1, static_cast<uint32_t>(key_hashes_.size() * kHashIndexBucketsPerKey));
+    const size_t buckets_offset = buffer_.size();
+    buffer_.resize(buckets_offset + num_buckets, kHashIndexNoEntry);
+    uint8_t* buckets = reinterpret_cast<uint8_t*>(&buffer_[buckets_offset]);
+    for (size_t i = 0; i < key_hashes_.size(); i++) {
+      uint8_t& bucket = buckets[key_hashes_[i].first % num_buckets];
+      const uint8_t restart = static_cast<uint8_t>(key_hashes_[i].second);
+      if (bucket == kHashIndexNoEntry) {
+        bucket = restart;
+      } else if (bucket != restart) {
+        bucket = kHashIndexCollision;
+      }
+    }
+    PutFixed32(&buffer_, num_buckets);
+    num_restarts |= kBlockHashIndexFlag;
+  }
+
   // Append restart array
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
@@ -88,6 +137,15 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (hash_index_ && hashable_) {
+    if (key.size() < 8) {
+      hashable_ = false;
+    } else {
+      key_hashes_.push_back(
+          std::make_pair(BlockHashIndexHash(key), restarts_.size() - 1));
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
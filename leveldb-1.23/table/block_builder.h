@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -16,7 +17,10 @@ struct Options;
 
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // If "hash_index" is true, Finish() appends a hash index of the user
+  // keys (see Options::data_block_hash_index).  The keys must then be
+  // internal keys.
+  explicit BlockBuilder(const Options* options, bool hash_index = false);
 
   BlockBuilder(const BlockBuilder&) = delete;
   BlockBuilder& operator=(const BlockBuilder&) = delete;
@@ -47,6 +51,11 @@ class BlockBuilder {
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
+
+  const bool hash_index_;
+  bool hashable_;  // False once a key shorter than an internal key is added
+  // (hash, restart index) of each key added, for the hash index
+  std::vector<std::pair<uint32_t, uint32_t>> key_hashes_;
 };
 
 }  // namespace leveldb
@@ -4,9 +4,15 @@
 
 #include "table/format.h"
 
+#include <map>
+#include <vector>
+
+#include "leveldb/comparator.h"
 #include "leveldb/env.h"
+#include "leveldb/options.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/block_builder.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -61,18 +67,17 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
+// Finish a block read of "handle" that placed "contents" (with status
+// "s") into "buf".  Takes ownership of "buf".
+static Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                          const Slice& compression_dict, char* buf,
+                          const Slice& contents, Status s,
+                          BlockContents* result) {
   result->data = Slice();
   result->cachable = false;
   result->heap_allocated = false;
 
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
   if (!s.ok()) {
     delete[] buf;
     return s;
@@ -130,6 +135,47 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
       result->cachable = true;
       break;
     }
+    case kZstdCompression: {
+      size_t ulength = 0;
+      if (!port::Zstd_GetUncompressedLength(data, n, &ulength)) {
+        delete[] buf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      char* ubuf = new char[ulength];
+      if (!port::Zstd_Uncompress(data, n, compression_dict.data(),
+                                 compression_dict.size(), ubuf)) {
+        delete[] buf;
+        delete[] ubuf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      delete[] buf;
+      result->data = Slice(ubuf, ulength);
+      result->heap_allocated = true;
+      result->cachable = true;
+      break;
+    }
+    case kLZ4Compression: {
+      // LZ4 does not record the uncompressed length, so the block starts
+      // with it (see TableBuilder::WriteBlock).
+      uint32_t ulength = 0;
+      const char* compressed = GetVarint32Ptr(data, data + n, &ulength);
+      if (compressed == nullptr) {
+        delete[] buf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      char* ubuf = new char[ulength];
+      if (!port::LZ4_Uncompress(compressed, data + n - compressed, ubuf,
+                                ulength)) {
+        delete[] buf;
+        delete[] ubuf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      delete[] buf;
+      result->data = Slice(ubuf, ulength);
+      result->heap_allocated = true;
+      result->cachable = true;
+      break;
+    }
     default:
       delete[] buf;
       return Status::Corruption("bad block type");
@@ -138,4 +184,143 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result) {
+  return ReadBlock(file, options, handle, Slice(), result);
+}
+
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, const Slice& compression_dict,
+                 BlockContents* result) {
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  return DecodeBlock(options, handle, compression_dict, buf, contents, s,
+                     result);
+}
+
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options, int n,
+                const BlockHandle* handles, const Slice& compression_dict,
+                BlockContents* results, Status* statuses) {
+  std::vector<RandomAccessFile::ReadRequest> requests(n);
+  for (int i = 0; i < n; i++) {
+    RandomAccessFile::ReadRequest* req = &requests[i];
+    req->offset = handles[i].offset();
+    req->n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    req->scratch = new char[req->n];
+  }
+  if (n > 0) {
+    file->MultiRead(&requests[0], n);
+  }
+  for (int i = 0; i < n; i++) {
+    const RandomAccessFile::ReadRequest& req = requests[i];
+    statuses[i] = DecodeBlock(options, handles[i], compression_dict,
+                              req.scratch, req.result, req.status,
+                              &results[i]);
+  }
+}
+
+// Read the footer and the metaindex entries of the table in "file".
+static Status ReadMetaIndex(RandomAccessFile* file, uint64_t file_size,
+                            Footer* footer,
+                            std::map<std::string, std::string>* entries) {
+  if (file_size < Footer::kEncodedLength) {
+    return Status::Corruption("file is too short to be an sstable");
+  }
+  char footer_space[Footer::kEncodedLength];
+  Slice footer_input;
+  Status s = file->Read(file_size - Footer::kEncodedLength,
+                        Footer::kEncodedLength, &footer_input, footer_space);
+  if (s.ok()) {
+    s = footer->DecodeFrom(&footer_input);
+  }
+  BlockContents contents;
+  if (s.ok()) {
+    ReadOptions options;
+    options.verify_checksums = true;
+    s = ReadBlock(file, options, footer->metaindex_handle(), &contents);
+  }
+  if (s.ok()) {
+    Block meta(contents);
+    Iterator* iter = meta.NewIterator(BytewiseComparator());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      (*entries)[iter->key().ToString()] = iter->value().ToString();
+    }
+    s = iter->status();
+    delete iter;
+  }
+  return s;
+}
+
+Status SetTableGlobalSequence(Env* env, const std::string& fname,
+                              uint64_t seq, uint64_t* file_size) {
+  uint64_t size;
+  Status s = env->GetFileSize(fname, &size);
+  if (!s.ok()) {
+    return s;
+  }
+  RandomAccessFile* file;
+  s = env->NewRandomAccessFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  Footer footer;
+  std::map<std::string, std::string> entries;
+  s = ReadMetaIndex(file, size, &footer, &entries);
+  delete file;
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::string encoded_seq;
+  PutFixed64(&encoded_seq, seq);
+  entries[kGlobalSequenceKey] = encoded_seq;
+  Options options;
+  options.comparator = BytewiseComparator();
+  BlockBuilder builder(&options);
+  for (std::map<std::string, std::string>::const_iterator iter =
+           entries.begin();
+       iter != entries.end(); ++iter) {
+    builder.Add(iter->first, iter->second);
+  }
+
+  // The metaindex block that the old footer points to is left in place;
+  // only the new footer is read.
+  std::string appended = builder.Finish().ToString();
+  BlockHandle handle;
+  handle.set_offset(size);
+  handle.set_size(appended.size());
+  char trailer[kBlockTrailerSize];
+  trailer[0] = kNoCompression;
+  uint32_t crc = crc32c::Value(appended.data(), appended.size());
+  crc = crc32c::Extend(crc, trailer, 1);  // Extend crc to cover block type
+  EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+  appended.append(trailer, kBlockTrailerSize);
+  footer.set_metaindex_handle(handle);
+  std::string footer_encoding;
+  footer.EncodeTo(&footer_encoding);
+  appended.append(footer_encoding);
+
+  WritableFile* out;
+  s = env->NewAppendableFile(fname, &out);
+  if (!s.ok()) {
+    return s;
+  }
+  s = out->Append(appended);
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  if (s.ok()) {
+    *file_size = size + appended.size();
+  }
+  return s;
+}
+
 }  // namespace leveldb
@@ -5,16 +5,19 @@
 #ifndef STORAGE_LEVELDB_TABLE_FORMAT_H_
 #define STORAGE_LEVELDB_TABLE_FORMAT_H_
 
+#include <cassert>
 #include <cstdint>
 #include <string>
 
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "leveldb/table_builder.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
 class Block;
+class Env;
 class RandomAccessFile;
 struct ReadOptions;
 
@@ -78,6 +81,54 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Set in the restart count of a block that ends with a hash index (see
+// Options::data_block_hash_index and block_builder.cc).
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+
+// Hash index buckets hold the restart index of the keys that hash to them,
+// or one of these markers.
+static const uint8_t kHashIndexNoEntry = 0xff;
+static const uint8_t kHashIndexCollision = 0xfe;
+
+// Blocks with more restart points than this get no hash index.
+static const uint32_t kMaxHashIndexRestarts = 0xfd;
+
+// Returns the hash of internal key "key" in the hash index of a block,
+// which only covers its user key.  REQUIRES: key.size() >= 8
+inline uint32_t BlockHashIndexHash(const Slice& key) {
+  assert(key.size() >= 8);
+  return Hash(key.data(), key.size() - 8, 0xa1b2c3d4);
+}
+
+// Metaindex key of the block holding the Zstd dictionary that the data
+// blocks of a table were compressed with, if any.
+static const char kZstdDictionaryKey[] = "compression.zstd_dict";
+
+// Metaindex key present iff the index block of a table is the top level of
+// a partitioned index (see Options::partition_index_and_filters).  Each of
+// its entries points at an index partition, followed by the handle of the
+// filter partition for the same keys if the table has filters.
+static const char kPartitionedIndexKey[] = "index.partitioned";
+
+// Prefix of the metaindex key, followed by the filter policy name, that
+// marks a table with partitioned filters.  Each filter partition holds a
+// single filter over all of the keys of its index partition.
+static const char kPartitionedFilterKeyPrefix[] = "partitionedfilter.";
+
+// Prefix of the metaindex key, followed by the filter policy name, of the
+// filter block of a table with a full filter (see Options::full_filter).
+// The block holds a single filter over all of the keys of the table.
+static const char kFullFilterKeyPrefix[] = "fullfilter.";
+
+// Metaindex key of the block holding the range tombstones of a table, if
+// any (see TableBuilder::AddRangeDeletion()).
+static const char kRangeDelBlockKey[] = "rangedel";
+
+// Metaindex key whose value, a fixed64, replaces the sequence numbers of
+// all the internal keys of a table, if present.  Set on the tables written
+// by SstFileWriter when they are ingested (see DB::IngestExternalFile()).
+static const char kGlobalSequenceKey[] = "globalseq";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -89,6 +140,26 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Like ReadBlock() above, for a data block of a table whose data blocks
+// may have been compressed with the Zstd dictionary "compression_dict".
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, const Slice& compression_dict,
+                 BlockContents* result);
+
+// Read the data blocks identified by handles[0,n-1] from "file" with a
+// single RandomAccessFile::MultiRead() call.  Stores the outcome of reading
+// handles[i] in results[i] and statuses[i] as ReadBlock() would.
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options, int n,
+                const BlockHandle* handles, const Slice& compression_dict,
+                BlockContents* results, Status* statuses);
+
+// Set the global sequence number (see kGlobalSequenceKey) of the table
+// stored in "fname" to "seq", by appending a copy of its metaindex block
+// that maps kGlobalSequenceKey to "seq" and a footer that points to the
+// copy.  Stores the new size of the file in *file_size.
+Status SetTableGlobalSequence(Env* env, const std::string& fname,
+                              uint64_t seq, uint64_t* file_size);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -4,6 +4,10 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -17,10 +21,14 @@
 
 namespace leveldb {
 
+// Full filters are kept in memory at this alignment (a cache line).
+static const size_t kFilterAlignment = 64;
+
 struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
+    delete[] compression_dict_data;
     delete index_block;
   }
 
@@ -30,9 +38,18 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  Slice compression_dict;  // Zstd dictionary of the data blocks, if any
+  const char* compression_dict_data;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  bool partitioned_index;   // index_block is the top level of the index
+  bool partitioned_filter;  // Index partitions have filter partitions
+  bool full_filter;         // filter has a single filter over all keys
+  bool has_range_deletions;
+  BlockHandle range_del_handle;  // Valid iff has_range_deletions
+  bool has_global_seq;
+  uint64_t global_seq;  // Valid iff has_global_seq
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -72,18 +89,24 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->compression_dict_data = nullptr;
+    rep->partitioned_index = false;
+    rep->partitioned_filter = false;
+    rep->full_filter = false;
+    rep->has_range_deletions = false;
+    rep->has_global_seq = false;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
-  }
-
+Status Table::ReadMeta(const Footer& footer) {
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -91,21 +114,63 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // Propagate errors, since without the metaindex we cannot tell whether
+    // the index block is partitioned.
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  iter->Seek(kZstdDictionaryKey);
+  if (iter->Valid() && iter->key() == Slice(kZstdDictionaryKey)) {
+    ReadCompressionDict(iter->value());
+  }
+  iter->Seek(kRangeDelBlockKey);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockKey)) {
+    // Unlike a missing filter, missing tombstones would resurrect deleted
+    // keys, so a bad handle fails the open.
+    Slice v = iter->value();
+    s = rep_->range_del_handle.DecodeFrom(&v);
+    rep_->has_range_deletions = s.ok();
+  }
+  iter->Seek(kGlobalSequenceKey);
+  if (s.ok() && iter->Valid() && iter->key() == Slice(kGlobalSequenceKey)) {
+    if (iter->value().size() == 8) {
+      rep_->has_global_seq = true;
+      rep_->global_seq = DecodeFixed64(iter->value().data());
+    } else {
+      s = Status::Corruption("bad global sequence number");
+    }
+  }
+  iter->Seek(kPartitionedIndexKey);
+  rep_->partitioned_index =
+      iter->Valid() && iter->key() == Slice(kPartitionedIndexKey);
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = rep_->partitioned_index ? kPartitionedFilterKeyPrefix
+                                              : kFullFilterKeyPrefix;
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      if (rep_->partitioned_index) {
+        rep_->partitioned_filter = true;
+      } else {
+        rep_->full_filter = true;
+        ReadFilter(iter->value());
+      }
+    } else if (!rep_->partitioned_index) {
+      key = "filter.";
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value());
+      }
+    }
   }
   delete iter;
   delete meta;
+  return s;
 }
 
 void Table::ReadFilter(const Slice& filter_handle_value) {
@@ -125,14 +190,116 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
+  if (rep_->full_filter) {
+    // Copy the filter to the start of a cache line, so that the lines of a
+    // blocked bloom filter each map to a single cache line.
+    const size_t n = block.data.size();
+    char* buf = new char[n + kFilterAlignment - 1];
+    char* filter = buf + (-reinterpret_cast<uintptr_t>(buf) &
+                          (kFilterAlignment - 1));
+    std::memcpy(filter, block.data.data(), n);
+    if (block.heap_allocated) {
+      delete[] block.data.data();
+    }
+    rep_->filter_data = buf;
+    rep_->filter = new FilterBlockReader(rep_->options.filter_policy,
+                                         Slice(filter, n));
+    return;
+  }
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+void Table::ReadCompressionDict(const Slice& dict_handle_value) {
+  Slice v = dict_handle_value;
+  BlockHandle dict_handle;
+  if (!dict_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // Without the dictionary, reads of the data blocks compressed with it
+  // fail with a corruption error.
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, dict_handle, &block).ok()) {
+    return;
+  }
+  if (block.heap_allocated) {
+    rep_->compression_dict_data = block.data.data();  // Will need to delete
+  }
+  rep_->compression_dict = block.data;
+}
+
 Table::~Table() { delete rep_; }
 
+namespace {
+
+// Iterator over the entries of a table with a global sequence number,
+// which it substitutes for the sequence numbers of their internal keys.
+// The keys of such a table all have distinct user keys.
+class GlobalSequenceIterator : public Iterator {
+ public:
+  GlobalSequenceIterator(Iterator* iter, const Comparator* comparator,
+                         uint64_t seq)
+      : iter_(iter), comparator_(comparator), seq_(seq) {}
+
+  ~GlobalSequenceIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    Update();
+    // The entry found may have become newer than "target".
+    if (iter_->Valid() && comparator_->Compare(key_, target) < 0) {
+      iter_->Next();
+      Update();
+    }
+  }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Update();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Update();
+  }
+  void Next() override {
+    iter_->Next();
+    Update();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Update();
+  }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      const Slice k = iter_->key();
+      key_.assign(k.data(), k.size());
+      if (k.size() >= 8) {
+        const uint64_t type = DecodeFixed64(k.data() + k.size() - 8) & 0xff;
+        EncodeFixed64(&key_[k.size() - 8], (seq_ << 8) | type);
+      }
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const comparator_;
+  const uint64_t seq_;
+  std::string key_;
+};
+
+}  // namespace
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
@@ -142,18 +309,138 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+// Fills "buf" with the block cache key of "handle" and returns it.
+static Slice BlockCacheKey(uint64_t cache_id, const BlockHandle& handle,
+                           char (&buf)[16]) {
+  EncodeFixed64(buf, cache_id);
+  EncodeFixed64(buf + 8, handle.offset());
+  return Slice(buf, sizeof(buf));
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+// A filter partition of a table with partitioned filters, as stored in
+// the block cache.
+struct FilterPartition {
+  FilterPartition(const FilterPolicy* policy, const BlockContents& contents)
+      : reader(policy, contents.data),
+        data(contents.heap_allocated ? contents.data.data() : nullptr) {}
+  ~FilterPartition() { delete[] data; }
+
+  FilterBlockReader reader;
+  const char* data;  // Owned contents; null if not heap allocated
+};
+
+static void DeleteCachedFilterPartition(const Slice& key, void* value) {
+  delete reinterpret_cast<FilterPartition*>(value);
+}
+
+// Serves the data block reads of a single table iterator.  Once the
+// iterator has read a few blocks back to back in file order, reads a
+// whole readahead window at a time and serves the following blocks from
+// it, and hints the next window to the file.
+//
+// Unlike other RandomAccessFile implementations, instances are not safe
+// for concurrent use; each belongs to one iterator.
+class Table::ReadaheadFile : public RandomAccessFile {
+ public:
+  ReadaheadFile(const Table* table, RandomAccessFile* file,
+                size_t readahead_size)
+      : table_(table),
+        file_(file),
+        readahead_size_(readahead_size),
+        // Data blocks all precede the metaindex block.
+        limit_(table->rep_->metaindex_handle.offset()),
+        disabled_(false),
+        next_offset_(0),
+        sequential_reads_(0),
+        buffer_offset_(0) {}
+
+  const Table* table() const { return table_; }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (offset >= buffer_offset_ &&
+        offset + n <= buffer_offset_ + buffer_.size()) {
+      std::memcpy(scratch, buffer_.data() + (offset - buffer_offset_), n);
+      *result = Slice(scratch, n);
+      next_offset_ = offset + n;
+      return Status::OK();
+    }
+
+    const bool sequential = (offset == next_offset_);
+    next_offset_ = offset + n;
+    sequential_reads_ = sequential ? sequential_reads_ + 1 : 0;
+    if (disabled_ || sequential_reads_ < kMinSequentialReads ||
+        offset + n >= limit_) {
+      return file_->Read(offset, n, result, scratch);
+    }
+
+    size_t window = std::max<uint64_t>(
+        n, std::min<uint64_t>(readahead_size_, limit_ - offset));
+    buffer_.resize(window);
+    Slice contents;
+    Status s = file_->Read(offset, window, &contents, &buffer_[0]);
+    if (!s.ok() || contents.data() != buffer_.data() ||
+        contents.size() < n) {
+      // Either the read failed or the file serves reads from memory
+      // (e.g. mmap) and gains nothing from reading ahead.
+      disabled_ = s.ok() && contents.data() != buffer_.data();
+      buffer_.clear();
+      return file_->Read(offset, n, result, scratch);
+    }
+    buffer_.resize(contents.size());
+    buffer_offset_ = offset;
+    file_->Prefetch(offset + buffer_.size(), readahead_size_);
+
+    std::memcpy(scratch, buffer_.data(), n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+ private:
+  // Number of back to back block reads before reading ahead.
+  static const int kMinSequentialReads = 2;
+
+  const Table* const table_;
+  RandomAccessFile* const file_;
+  const size_t readahead_size_;
+  const uint64_t limit_;
+
+  mutable bool disabled_;
+  mutable uint64_t next_offset_;
+  mutable int sequential_reads_;
+  mutable uint64_t buffer_offset_;  // File offset of buffer_[0]
+  mutable std::string buffer_;
+};
+
+static void DeleteReadaheadFile(void* arg, void* ignored) {
+  delete reinterpret_cast<RandomAccessFile*>(arg);
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->ReadDataBlock(table->rep_->file, options, index_value);
+}
+
+Iterator* Table::ReadaheadBlockReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  ReadaheadFile* file = reinterpret_cast<ReadaheadFile*>(arg);
+  return file->table()->ReadDataBlock(file, options, index_value);
+}
+
+Iterator* Table::ReadDataBlock(RandomAccessFile* file,
+                               const ReadOptions& options,
+                               const Slice& index_value,
+                               bool point_lookup) const {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -167,14 +454,13 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      Slice key = BlockCacheKey(rep_->cache_id, handle, cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(file, options, handle, rep_->compression_dict,
+                      &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
@@ -184,7 +470,7 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(file, options, handle, rep_->compression_dict, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -193,7 +479,7 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(rep_->options.comparator, point_lookup);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -205,33 +491,147 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+Iterator* Table::ApplyGlobalSequence(Iterator* iter) const {
+  if (!rep_->has_global_seq) {
+    return iter;
+  }
+  return new GlobalSequenceIterator(iter, rep_->options.comparator,
+                                    rep_->global_seq);
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (rep_->partitioned_index) {
+    // Index partitions are read like data blocks.
+    iter = NewTwoLevelIterator(iter, &Table::BlockReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
+bool Table::KeyMayMatch(const ReadOptions& options, const Slice& index_value,
+                        const Slice& key) const {
+  Slice input = index_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return true;  // BlockReader() reports the error
+  }
+  if (rep_->full_filter) {
+    return true;  // Checked by FullFilterMayMatch() before the index search
+  }
+  if (!rep_->partitioned_filter) {
+    return rep_->filter == nullptr ||
+           rep_->filter->KeyMayMatch(handle.offset(), key);
+  }
+
+  // "index_value" is a top-level index entry: the handle of the index
+  // partition followed by that of the filter partition.
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&input).ok()) {
+    return true;
+  }
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  Slice cache_key;
+  if (block_cache != nullptr) {
+    cache_key = BlockCacheKey(rep_->cache_id, filter_handle, cache_key_buffer);
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      FilterPartition* partition =
+          reinterpret_cast<FilterPartition*>(block_cache->Value(cache_handle));
+      const bool result = partition->reader.KeyMayMatch(0, key);
+      block_cache->Release(cache_handle);
+      return result;
+    }
+  }
+
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, options, filter_handle, &contents).ok()) {
+    return true;  // Errors only cost us the filtering
+  }
+  FilterPartition* partition =
+      new FilterPartition(rep_->options.filter_policy, contents);
+  const bool result = partition->reader.KeyMayMatch(0, key);
+  // Unlike data blocks, partitions that point into the file's memory
+  // (e.g. mmap) are cached too, since they are consulted on every lookup.
+  // Entries are only found through this table's cache_id, so they are
+  // never used after the file is closed.
+  if (block_cache != nullptr && options.fill_cache) {
+    block_cache->Release(block_cache->Insert(cache_key, partition,
+                                             contents.data.size(),
+                                             &DeleteCachedFilterPartition));
+  } else {
+    delete partition;
+  }
+  return result;
+}
+
+bool Table::FullFilterMayMatch(const Slice& key) const {
+  return !rep_->full_filter || rep_->filter == nullptr ||
+         rep_->filter->KeyMayMatch(0, key);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  if (options.readahead_size == 0) {
+    return ApplyGlobalSequence(
+        NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                            const_cast<Table*>(this), options));
+  }
+  return NewReadaheadIterator(options, rep_->file);
+}
+
+Iterator* Table::NewReadaheadIterator(const ReadOptions& options,
+                                      RandomAccessFile* file) const {
+  ReadaheadFile* readahead_file =
+      new ReadaheadFile(this, file, options.readahead_size);
+  Iterator* iter = NewTwoLevelIterator(NewIndexIterator(options),
+                                       &Table::ReadaheadBlockReader,
+                                       readahead_file, options);
+  iter->RegisterCleanup(&DeleteReadaheadFile, readahead_file, nullptr);
+  return ApplyGlobalSequence(iter);
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                                                const Slice&),
+                          Iterator** pinned) {
+  if (pinned != nullptr) {
+    *pinned = nullptr;
+  }
+  if (!FullFilterMayMatch(k)) {
+    return Status::OK();  // Not found
+  }
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   iiter->Seek(k);
   if (iiter->Valid()) {
-    Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
-    BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (!KeyMayMatch(options, iiter->value(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
+      // With a partitioned index, find the data block in the partition.
+      Iterator* piter = nullptr;
+      Slice handle_value = iiter->value();
+      if (rep_->partitioned_index) {
+        piter = BlockReader(this, options, handle_value);
+        piter->Seek(k);
+        handle_value = piter->Valid() ? piter->value() : Slice();
+        s = piter->status();
       }
-      s = block_iter->status();
-      delete block_iter;
+      if (!handle_value.empty()) {
+        Iterator* block_iter = ApplyGlobalSequence(
+            ReadDataBlock(rep_->file, options, handle_value, true));
+        block_iter->Seek(k);
+        s = block_iter->status();
+        if (block_iter->Valid()) {
+          (*handle_result)(arg, block_iter->key(), block_iter->value());
+          if (pinned != nullptr) {
+            *pinned = block_iter;
+            block_iter = nullptr;
+          }
+        }
+        delete block_iter;
+      }
+      delete piter;
     }
   }
   if (s.ok()) {
@@ -241,9 +641,171 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+void Table::InternalMultiGet(const ReadOptions& options, int n,
+                             const Slice* keys, void* const* args,
+                             void (*handle_result)(void*, const Slice&,
+                                                   const Slice&),
+                             Status* statuses) {
+  const Comparator* cmp = rep_->options.comparator;
+  Cache* block_cache = rep_->options.block_cache;
+
+  // Find the data block of every key that the filter does not rule out.
+  // Keys sharing a block end up next to each other.  With partitioned
+  // filters, the top-level index entry of a key is needed to find its
+  // filter partition, so that the index partition is only read if the
+  // filter does not rule the key out.
+  std::vector<std::string> key_blocks(n);  // Index value; empty if none
+  Iterator* iiter = NewIndexIterator(options);
+  Iterator* titer = rep_->partitioned_filter
+                        ? rep_->index_block->NewIterator(cmp)
+                        : nullptr;
+  bool positioned = false;
+  for (int i = 0; i < n; i++) {
+    assert(i == 0 || cmp->Compare(keys[i - 1], keys[i]) <= 0);
+    statuses[i] = Status::OK();
+    if (!FullFilterMayMatch(keys[i])) {
+      continue;  // Not found
+    }
+    if (titer != nullptr) {
+      titer->Seek(keys[i]);
+      if (titer->Valid() && !KeyMayMatch(options, titer->value(), keys[i])) {
+        continue;  // Not found
+      }
+    }
+    // The index entry of the previous key also covers this one unless
+    // the key is past that block's separator.
+    if (!positioned || !iiter->Valid() ||
+        cmp->Compare(keys[i], iiter->key()) > 0) {
+      iiter->Seek(keys[i]);
+      positioned = true;
+    }
+    if (!iiter->Valid()) {
+      // Past the last block; so are the remaining keys.
+      for (; i < n; i++) {
+        statuses[i] = iiter->status();
+      }
+      break;
+    }
+    if (titer == nullptr && !KeyMayMatch(options, iiter->value(), keys[i])) {
+      continue;  // Not found
+    }
+    key_blocks[i].assign(iiter->value().data(), iiter->value().size());
+  }
+  delete titer;
+  delete iiter;
+
+  // Read the blocks that are not in the block cache with a single
+  // MultiRead() so that the file can serve them concurrently.
+  std::vector<std::string> read_blocks;
+  std::vector<BlockHandle> read_handles;
+  const std::string* last_block = nullptr;
+  for (int i = 0; i < n; i++) {
+    if (key_blocks[i].empty() ||
+        (last_block != nullptr && key_blocks[i] == *last_block)) {
+      continue;
+    }
+    last_block = &key_blocks[i];
+    BlockHandle handle;
+    Slice input = key_blocks[i];
+    if (!handle.DecodeFrom(&input).ok()) {
+      continue;  // BlockReader() reports the error
+    }
+    if (block_cache != nullptr) {
+      char cache_key_buffer[16];
+      Cache::Handle* cache_handle = block_cache->Lookup(
+          BlockCacheKey(rep_->cache_id, handle, cache_key_buffer));
+      if (cache_handle != nullptr) {
+        block_cache->Release(cache_handle);
+        continue;
+      }
+    }
+    read_blocks.push_back(key_blocks[i]);
+    read_handles.push_back(handle);
+  }
+  const int num_reads = read_handles.size();
+  std::vector<BlockContents> read_contents;
+  std::vector<Status> read_statuses;
+  if (num_reads > 1) {
+    read_contents.resize(num_reads);
+    read_statuses.resize(num_reads);
+    ReadBlocks(rep_->file, options, num_reads, &read_handles[0],
+               rep_->compression_dict, &read_contents[0], &read_statuses[0]);
+  }
+
+  // Look up every key in its block.  Each block is visited once.
+  Iterator* block_iter = nullptr;
+  int next_read = 0;
+  last_block = nullptr;
+  for (int i = 0; i < n; i++) {
+    if (key_blocks[i].empty()) {
+      continue;
+    }
+    if (last_block == nullptr || key_blocks[i] != *last_block) {
+      last_block = &key_blocks[i];
+      delete block_iter;
+      if (!read_contents.empty() && next_read < num_reads &&
+          read_blocks[next_read] == key_blocks[i]) {
+        block_iter = ApplyGlobalSequence(NewPrefetchedBlockIterator(
+            options, read_handles[next_read], read_contents[next_read],
+            read_statuses[next_read]));
+        next_read++;
+      } else {
+        block_iter = ApplyGlobalSequence(
+            ReadDataBlock(rep_->file, options, key_blocks[i], true));
+      }
+    }
+    block_iter->Seek(keys[i]);
+    if (block_iter->Valid()) {
+      (*handle_result)(args[i], block_iter->key(), block_iter->value());
+    }
+    statuses[i] = block_iter->status();
+  }
+  delete block_iter;
+}
+
+Iterator* Table::NewPrefetchedBlockIterator(const ReadOptions& options,
+                                            const BlockHandle& handle,
+                                            const BlockContents& contents,
+                                            const Status& status) {
+  if (!status.ok()) {
+    return NewErrorIterator(status);
+  }
+  Cache* block_cache = rep_->options.block_cache;
+  Block* block = new Block(contents);
+  Iterator* iter = block->NewIterator(rep_->options.comparator, true);
+  if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+    char cache_key_buffer[16];
+    Cache::Handle* cache_handle = block_cache->Insert(
+        BlockCacheKey(rep_->cache_id, handle, cache_key_buffer), block,
+        block->size(), &DeleteCachedBlock);
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  } else {
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  }
+  return iter;
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (!rep_->has_range_deletions) {
+    return nullptr;
+  }
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, opt, rep_->range_del_handle, &contents);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Block* block = new Block(contents);
+  Iterator* iter = block->NewIterator(rep_->options.comparator);
+  iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  return iter;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -5,6 +5,7 @@
 #include "leveldb/table_builder.h"
 
 #include <cassert>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -24,14 +25,19 @@ struct TableBuilder::Rep {
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options, opt.data_block_hash_index),
         index_block(&index_block_options),
+        top_index_block(&index_block_options),
+        range_del_block(&index_block_options),
         num_entries(0),
+        num_range_deletions(0),
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        dict_sampling(opt.compression == kZstdCompression &&
+                      opt.zstd_max_dict_bytes > 0) {
     index_block_options.block_restart_interval = 1;
   }
 
@@ -42,8 +48,14 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  // If options.partition_index_and_filters, index_block and filter_block
+  // hold the current index and filter partitions, and top_index_block has
+  // an entry for each partition written so far.
+  BlockBuilder top_index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
+  int64_t num_range_deletions;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
 
@@ -60,6 +72,15 @@ struct TableBuilder::Rep {
   BlockHandle pending_handle;  // Handle to add to index block
 
   std::string compressed_output;
+
+  // Zstd dictionary training (see Options::zstd_max_dict_bytes).  While
+  // dict_sampling is true, the raw contents of the data blocks are
+  // collected in dict_samples.  Once enough have been seen, the dictionary
+  // is trained and used to compress the remaining data blocks.
+  bool dict_sampling;
+  std::string dict_samples;
+  std::vector<size_t> dict_sample_sizes;
+  std::string compression_dict;
 };
 
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
@@ -82,6 +103,18 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.partition_index_and_filters !=
+      rep_->options.partition_index_and_filters) {
+    return Status::InvalidArgument(
+        "changing index partitioning while building table");
+  }
+  if (options.data_block_hash_index != rep_->options.data_block_hash_index) {
+    return Status::InvalidArgument(
+        "changing data block hash index while building table");
+  }
+  if (options.full_filter != rep_->options.full_filter) {
+    return Status::InvalidArgument("changing filter type while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -106,6 +139,12 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.partition_index_and_filters &&
+        r->index_block.CurrentSizeEstimate() >=
+            r->options.metadata_block_size) {
+      WriteIndexPartition(r->last_key);
+      if (!ok()) return;
+    }
   }
 
   if (r->filter_block != nullptr) {
@@ -122,6 +161,14 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeDeletion(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->num_range_deletions++;
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -133,7 +180,8 @@ void TableBuilder::Flush() {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
-  if (r->filter_block != nullptr) {
+  if (r->filter_block != nullptr && !r->options.partition_index_and_filters &&
+      !r->options.full_filter) {
     r->filter_block->StartBlock(r->offset);
   }
 }
@@ -147,6 +195,16 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   Rep* r = rep_;
   Slice raw = block->Finish();
 
+  // Only data blocks are compressed with the dictionary, so that the
+  // index and meta blocks can be read before the dictionary.
+  Slice dict;
+  if (block == &r->data_block) {
+    if (r->dict_sampling) {
+      SampleForDictionary(raw);
+    }
+    dict = r->compression_dict;
+  }
+
   Slice block_contents;
   CompressionType type = r->options.compression;
   // TODO(postrelease): Support more compression options: zlib?
@@ -168,6 +226,38 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
       }
       break;
     }
+
+    case kZstdCompression: {
+      std::string* compressed = &r->compressed_output;
+      if (port::Zstd_Compress(r->options.zstd_compression_level, raw.data(),
+                              raw.size(), dict.data(), dict.size(),
+                              compressed) &&
+          compressed->size() < raw.size() - (raw.size() / 8u)) {
+        block_contents = *compressed;
+      } else {
+        // Zstd not supported, or compressed less than 12.5%, so just
+        // store uncompressed form
+        block_contents = raw;
+        type = kNoCompression;
+      }
+      break;
+    }
+
+    case kLZ4Compression: {
+      // LZ4 does not record the uncompressed length, so store it first.
+      std::string* compressed = &r->compressed_output;
+      PutVarint32(compressed, static_cast<uint32_t>(raw.size()));
+      if (port::LZ4_Compress(raw.data(), raw.size(), compressed) &&
+          compressed->size() < raw.size() - (raw.size() / 8u)) {
+        block_contents = *compressed;
+      } else {
+        // LZ4 not supported, or compressed less than 12.5%, so just
+        // store uncompressed form
+        block_contents = raw;
+        type = kNoCompression;
+      }
+      break;
+    }
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
@@ -193,6 +283,46 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   }
 }
 
+void TableBuilder::SampleForDictionary(const Slice& data_block) {
+  Rep* r = rep_;
+  if (r->options.compression != kZstdCompression) {
+    return;  // Compression was changed by ChangeOptions()
+  }
+  r->dict_samples.append(data_block.data(), data_block.size());
+  r->dict_sample_sizes.push_back(data_block.size());
+  if (r->dict_samples.size() >= r->options.zstd_max_train_bytes) {
+    // If training fails (e.g. too few samples), carry on without a
+    // dictionary.
+    port::Zstd_TrainDictionary(r->dict_samples.data(),
+                               r->dict_sample_sizes.data(),
+                               r->dict_sample_sizes.size(),
+                               r->options.zstd_max_dict_bytes,
+                               &r->compression_dict);
+    r->dict_sampling = false;
+    std::string().swap(r->dict_samples);
+    std::vector<size_t>().swap(r->dict_sample_sizes);
+  }
+}
+
+void TableBuilder::WriteIndexPartition(const Slice& last_index_key) {
+  Rep* r = rep_;
+  assert(!r->index_block.empty());
+  std::string handle_encoding;
+  BlockHandle partition_handle, filter_handle;
+  WriteBlock(&r->index_block, &partition_handle);
+  partition_handle.EncodeTo(&handle_encoding);
+  if (ok() && r->filter_block != nullptr) {
+    WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_handle);
+    filter_handle.EncodeTo(&handle_encoding);
+    delete r->filter_block;
+    r->filter_block = new FilterBlockBuilder(r->options.filter_policy);
+    r->filter_block->StartBlock(0);
+  }
+  if (ok()) {
+    r->top_index_block.Add(last_index_key, Slice(handle_encoding));
+  }
+}
+
 Status TableBuilder::status() const { return rep_->status; }
 
 Status TableBuilder::Finish() {
@@ -201,25 +331,75 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      dict_block_handle, range_del_block_handle;
+
+  // Write compression dictionary block
+  if (ok() && !r->compression_dict.empty()) {
+    WriteRawBlock(r->compression_dict, kNoCompression, &dict_block_handle);
+  }
+
+  // Write the last index and filter partitions
+  const bool partitioned = r->options.partition_index_and_filters;
+  if (ok() && partitioned) {
+    if (r->pending_index_entry) {
+      r->options.comparator->FindShortSuccessor(&r->last_key);
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+      r->pending_index_entry = false;
+    }
+    if (!r->index_block.empty()) {
+      WriteIndexPartition(r->last_key);
+    }
+  }
 
   // Write filter block
-  if (ok() && r->filter_block != nullptr) {
+  if (ok() && r->filter_block != nullptr && !partitioned) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
 
+  // Write range tombstone block
+  if (ok() && r->num_range_deletions > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    // Table::ReadMeta() looks its keys up bytewise.
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
+    if (!r->compression_dict.empty()) {
+      // Add mapping from kZstdDictionaryKey to location of the dictionary
+      std::string handle_encoding;
+      dict_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kZstdDictionaryKey, handle_encoding);
+    }
+    if (r->filter_block != nullptr && !partitioned) {
+      // Add mapping from "filter.Name" (or "fullfilter.Name") to location
+      // of filter data
+      std::string key = r->options.full_filter ? kFullFilterKeyPrefix
+                                               : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (partitioned) {
+      meta_index_block.Add(kPartitionedIndexKey, Slice());
+      if (r->filter_block != nullptr) {
+        std::string key = kPartitionedFilterKeyPrefix;
+        key.append(r->options.filter_policy->Name());
+        meta_index_block.Add(key, Slice());
+      }
+    }
+    if (r->num_range_deletions > 0) {
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockKey, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -234,7 +414,8 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    WriteBlock(partitioned ? &r->top_index_block : &r->index_block,
+               &index_block_handle);
   }
 
   // Write footer
@@ -260,6 +441,10 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
+uint64_t TableBuilder::NumRangeDeletions() const {
+  return rep_->num_range_deletions;
+}
+
 uint64_t TableBuilder::FileSize() const { return rep_->offset; }
 
 }  // namespace leveldb
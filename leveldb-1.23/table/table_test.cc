@@ -109,11 +109,12 @@ class StringSink : public WritableFile {
 class StringSource : public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {}
+      : contents_(contents.data(), contents.size()), num_reads_(0) {}
 
   ~StringSource() override = default;
 
   uint64_t Size() const { return contents_.size(); }
+  int num_reads() const { return num_reads_; }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
               char* scratch) const override {
@@ -125,11 +126,13 @@ class StringSource : public RandomAccessFile {
     }
     std::memcpy(scratch, &contents_[offset], n);
     *result = Slice(scratch, n);
+    num_reads_++;
     return Status::OK();
   }
 
  private:
   std::string contents_;
+  mutable int num_reads_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -370,7 +373,13 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  PARTITIONED_TABLE_TEST,
+  BLOCK_TEST,
+  MEMTABLE_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
@@ -386,6 +395,10 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Tables with an index split into many small partitions
+    {PARTITIONED_TABLE_TEST, false, 16},
+    {PARTITIONED_TABLE_TEST, true, 16},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
@@ -423,6 +436,11 @@ class Harness : public testing::Test {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PARTITIONED_TABLE_TEST:
+        options_.partition_index_and_filters = true;
+        options_.metadata_block_size = 64;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
@@ -755,6 +773,80 @@ static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   return result;
 }
 
+TEST(BlockTest, HashIndex) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  for (int restart_interval : {1, 16}) {
+    for (int n : {10, 1000}) {
+      options.block_restart_interval = restart_interval;
+      BlockBuilder builder(&options, true);
+      // Even user keys only; every third one has two versions.
+      int num_entries = 0;
+      for (int i = 0; i < n; i++) {
+        char user_key[20];
+        std::snprintf(user_key, sizeof(user_key), "k%05d", 2 * i);
+        builder.Add(InternalKey(user_key, 100, kTypeValue).Encode(), "v100");
+        num_entries++;
+        if (i % 3 == 0) {
+          builder.Add(InternalKey(user_key, 50, kTypeValue).Encode(), "v50");
+          num_entries++;
+        }
+      }
+      const Slice raw = builder.Finish();
+      const bool has_index =
+          (DecodeFixed32(raw.data() + raw.size() - 4) & kBlockHashIndexFlag) !=
+          0;
+      // Blocks with too many restart points get no index.
+      ASSERT_EQ(restart_interval != 1 || n < 100, has_index);
+
+      BlockContents contents;
+      contents.data = raw;
+      contents.cachable = false;
+      contents.heap_allocated = false;
+      Block block(contents);
+
+      Iterator* iter = block.NewIterator(&icmp, true);
+      for (int i = 0; i < n; i++) {
+        char user_key[20];
+        std::snprintf(user_key, sizeof(user_key), "k%05d", 2 * i);
+        iter->Seek(LookupKey(user_key, 200).internal_key());
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(InternalKey(user_key, 100, kTypeValue).Encode().ToString(),
+                  iter->key().ToString());
+        ASSERT_EQ("v100", iter->value().ToString());
+        if (i % 3 == 0) {
+          iter->Seek(LookupKey(user_key, 70).internal_key());
+          ASSERT_TRUE(iter->Valid());
+          ASSERT_EQ("v50", iter->value().ToString());
+        }
+
+        // Keys that are not in the block find no entry for their user key
+        std::snprintf(user_key, sizeof(user_key), "k%05d", 2 * i + 1);
+        iter->Seek(LookupKey(user_key, 200).internal_key());
+        ASSERT_TRUE(!iter->Valid() ||
+                    ExtractUserKey(iter->key()) != Slice(user_key));
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+
+      // Scans ignore the index
+      iter = block.NewIterator(&icmp);
+      int count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+      }
+      ASSERT_EQ(num_entries, count);
+      for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        count--;
+      }
+      ASSERT_EQ(0, count);
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+    }
+  }
+}
+
 TEST(TableTest, ApproximateOffsetOfPlain) {
   TableConstructor c(BytewiseComparator());
   c.Add("k01", "hello");
@@ -784,14 +876,107 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
-static bool SnappyCompressionSupported() {
+TEST(TableTest, ApproximateOffsetOfPartitioned) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 1;  // One index partition per data block
+  c.Finish(options, &keys, &kvmap);
+
+  // Index partitions are interleaved with the data blocks.
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k03"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"), 10000, 11000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k05"), 210000, 211000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k06"), 510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"), 510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
+}
+
+TEST(TableTest, Readahead) {
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  Random rnd(301);
+  std::vector<std::string> keys(1000);
+  std::vector<std::string> values(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    char buf[20];
+    std::snprintf(buf, sizeof(buf), "k%06d", static_cast<int>(i));
+    keys[i] = buf;
+    test::RandomString(&rnd, 100, &values[i]);
+    builder.Add(keys[i], values[i]);
+  }
+  ASSERT_LEVELDB_OK(builder.Finish());
+
+  for (size_t readahead_size : {0, 64 << 10}) {
+    StringSource* source = new StringSource(sink.contents());
+    Table* table;
+    ASSERT_LEVELDB_OK(Table::Open(options, source, source->Size(), &table));
+    const int table_open_reads = source->num_reads();
+
+    ReadOptions read_options;
+    read_options.readahead_size = readahead_size;
+    Iterator* iter = table->NewIterator(read_options);
+    size_t i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      ASSERT_LT(i, keys.size());
+      ASSERT_EQ(keys[i], iter->key().ToString());
+      ASSERT_EQ(values[i], iter->value().ToString());
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(keys.size(), i);
+
+    // Reading backwards is served block by block.
+    i = keys.size();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      ASSERT_EQ(keys[--i], iter->key().ToString());
+    }
+    ASSERT_EQ(0, i);
+    delete iter;
+
+    const int data_reads = source->num_reads() - table_open_reads;
+    if (readahead_size == 0) {
+      ASSERT_GT(data_reads, 2 * 300);  // One per block per direction
+    } else {
+      ASSERT_LT(data_reads, 300 + 10);
+    }
+    delete table;
+    delete source;
+  }
+}
+
+static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
-  return port::Snappy_Compress(in.data(), in.size(), &out);
+  switch (type) {
+    case kSnappyCompression:
+      return port::Snappy_Compress(in.data(), in.size(), &out);
+    case kZstdCompression:
+      return port::Zstd_Compress(1, in.data(), in.size(), nullptr, 0, &out);
+    case kLZ4Compression:
+      return port::LZ4_Compress(in.data(), in.size(), &out);
+    default:
+      return false;
+  }
 }
 
-TEST(TableTest, ApproximateOffsetOfCompressed) {
-  if (!SnappyCompressionSupported()) {
+static void TestApproximateOffsetOfCompressed(CompressionType type) {
+  if (!CompressionSupported(type)) {
     std::fprintf(stderr, "skipping compression tests\n");
     return;
   }
@@ -807,7 +992,7 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   KVMap kvmap;
   Options options;
   options.block_size = 1024;
-  options.compression = kSnappyCompression;
+  options.compression = type;
   c.Finish(options, &keys, &kvmap);
 
   // Expected upper and lower bounds of space used by compressible strings.
@@ -826,6 +1011,57 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+TEST(TableTest, ApproximateOffsetOfCompressed) {
+  TestApproximateOffsetOfCompressed(kSnappyCompression);
+}
+
+TEST(TableTest, ApproximateOffsetOfZstdCompressed) {
+  TestApproximateOffsetOfCompressed(kZstdCompression);
+}
+
+TEST(TableTest, ApproximateOffsetOfLZ4Compressed) {
+  TestApproximateOffsetOfCompressed(kLZ4Compression);
+}
+
+// Blocks must read back correctly whether or not the compression type is
+// supported by this build (unsupported types store blocks uncompressed).
+TEST(TableTest, CompressionRoundTrip) {
+  const CompressionType kTypes[] = {kSnappyCompression, kZstdCompression,
+                                    kLZ4Compression};
+  for (CompressionType type : kTypes) {
+    for (size_t dict_bytes : {0, 1024}) {
+      Random rnd(301);
+      TableConstructor c(BytewiseComparator());
+      std::string tmp;
+      for (int i = 0; i < 1000; i++) {
+        char key[20];
+        std::snprintf(key, sizeof(key), "k%06d", i);
+        c.Add(key, test::CompressibleString(&rnd, 0.25, 100, &tmp));
+      }
+      std::vector<std::string> keys;
+      KVMap kvmap;
+      Options options;
+      options.block_size = 256;
+      options.compression = type;
+      options.zstd_max_dict_bytes = dict_bytes;
+      options.zstd_max_train_bytes = 16 * 1024;
+      c.Finish(options, &keys, &kvmap);
+
+      Iterator* iter = c.NewIterator();
+      iter->SeekToFirst();
+      for (const auto& kvp : kvmap) {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(kvp.first, iter->key().ToString());
+        ASSERT_EQ(kvp.second, iter->value().ToString());
+        iter->Next();
+      }
+      ASSERT_FALSE(iter->Valid());
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+    }
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,6 +4,9 @@
 
 #include "util/arena.h"
 
+#include <functional>
+#include <thread>
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
@@ -55,9 +58,54 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  return AllocateConcurrently(bytes, 1);
+}
+
+char* Arena::AllocateAlignedConcurrently(size_t bytes) {
+  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+  static_assert((align & (align - 1)) == 0,
+                "Pointer size should be a power of 2");
+  char* result = AllocateConcurrently(bytes, align);
+  assert((reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
+  return result;
+}
+
+char* Arena::AllocateConcurrently(size_t bytes, size_t align) {
+  assert(bytes > 0);
+  const size_t thread_hash = std::hash<std::thread::id>()(
+      std::this_thread::get_id());
+  Shard* shard = &shards_[thread_hash % kNumShards];
+
+  shard->mu.Lock();
+  size_t current_mod =
+      reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (align - 1);
+  size_t slop = (current_mod == 0 ? 0 : align - current_mod);
+  size_t needed = bytes + slop;
+  char* result;
+  if (needed <= shard->alloc_bytes_remaining) {
+    result = shard->alloc_ptr + slop;
+    shard->alloc_ptr += needed;
+    shard->alloc_bytes_remaining -= needed;
+  } else if (bytes > kBlockSize / 4) {
+    // Same policy as AllocateFallback(), which returns aligned memory.
+    result = AllocateNewBlock(bytes);
+  } else {
+    shard->alloc_ptr = AllocateNewBlock(kBlockSize);
+    shard->alloc_bytes_remaining = kBlockSize;
+    result = shard->alloc_ptr;
+    shard->alloc_ptr += bytes;
+    shard->alloc_bytes_remaining -= bytes;
+  }
+  shard->mu.Unlock();
+  return result;
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
+  blocks_mutex_.Lock();
   blocks_.push_back(result);
+  blocks_mutex_.Unlock();
   memory_usage_.fetch_add(block_bytes + sizeof(char*),
                           std::memory_order_relaxed);
   return result;
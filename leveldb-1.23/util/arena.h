@@ -11,6 +11,9 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
 class Arena {
@@ -28,6 +31,13 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc.
   char* AllocateAligned(size_t bytes);
 
+  // Variants of Allocate() and AllocateAligned() that may be called by
+  // several threads at the same time.  Threads are spread over a few
+  // independently locked allocation shards so that they rarely contend.
+  // REQUIRES: Allocate() and AllocateAligned() are not running concurrently.
+  char* AllocateConcurrently(size_t bytes);
+  char* AllocateAlignedConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena.
   size_t MemoryUsage() const {
@@ -35,14 +45,34 @@ class Arena {
   }
 
  private:
+  // Allocation state of one shard used by the concurrent allocators.
+  struct Shard {
+    Shard() : alloc_ptr(nullptr), alloc_bytes_remaining(0) {}
+
+    port::Mutex mu;
+    char* alloc_ptr GUARDED_BY(mu);
+    size_t alloc_bytes_remaining GUARDED_BY(mu);
+
+    // Keep shards on separate cache lines.
+    char padding[64];
+  };
+
+  static const int kNumShards = 8;
+
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  char* AllocateConcurrently(size_t bytes, size_t align);
 
   // Allocation state
   char* alloc_ptr_;
   size_t alloc_bytes_remaining_;
 
-  // Array of new[] allocated memory blocks
+  Shard shards_[kNumShards];
+
+  // Array of new[] allocated memory blocks.  Appended to under
+  // blocks_mutex_, since the concurrent allocators may add blocks at the
+  // same time.
+  port::Mutex blocks_mutex_;
   std::vector<char*> blocks_;
 
   // Total memory usage of the arena.
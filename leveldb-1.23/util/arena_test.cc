@@ -4,7 +4,11 @@
 
 #include "util/arena.h"
 
+#include <atomic>
+#include <cstring>
+
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -58,6 +62,66 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+namespace {
+
+struct ConcurrentAllocState {
+  Arena* arena;
+  std::atomic<int> next_id;
+  std::atomic<int> done;
+  std::vector<std::pair<size_t, char*>> allocated[4];
+};
+
+void ConcurrentAllocator(void* arg) {
+  ConcurrentAllocState* state = reinterpret_cast<ConcurrentAllocState*>(arg);
+  const int id = state->next_id.fetch_add(1);
+  Random rnd(301 + id);
+  for (int i = 0; i < 10000; i++) {
+    size_t s = rnd.OneIn(1000) ? rnd.Uniform(6000) + 1 : rnd.Uniform(100) + 1;
+    char* r;
+    if (rnd.OneIn(10)) {
+      r = state->arena->AllocateAlignedConcurrently(s);
+      const size_t align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+      ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (align - 1));
+    } else {
+      r = state->arena->AllocateConcurrently(s);
+    }
+    std::memset(r, id, s);
+    state->allocated[id].push_back(std::make_pair(s, r));
+  }
+  state->done.fetch_add(1);
+}
+
+}  // namespace
+
+TEST(ArenaTest, AllocateConcurrently) {
+  Arena arena;
+  ConcurrentAllocState state;
+  state.arena = &arena;
+  state.next_id = 0;
+  state.done = 0;
+  const int kThreads = 4;
+  for (int i = 0; i < kThreads; i++) {
+    Env::Default()->StartThread(ConcurrentAllocator, &state);
+  }
+  while (state.done.load() < kThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  // No two threads may have been handed overlapping memory.
+  size_t bytes = 0;
+  for (int id = 0; id < kThreads; id++) {
+    for (size_t i = 0; i < state.allocated[id].size(); i++) {
+      size_t num_bytes = state.allocated[id][i].first;
+      const char* p = state.allocated[id][i].second;
+      for (size_t b = 0; b < num_bytes; b++) {
+        ASSERT_EQ(id, p[b]);
+      }
+      bytes += num_bytes;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,9 +4,16 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <algorithm>
+
 #include "leveldb/slice.h"
+#include "port/port.h"
 #include "util/hash.h"
 
+#if HAVE_AVX2
+#include <immintrin.h>
+#endif  // HAVE_AVX2
+
 namespace leveldb {
 
 namespace {
@@ -83,10 +90,138 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t bits_per_key_;
   size_t k_;
 };
+
+// A blocked bloom filter is an array of 64-byte lines followed by the
+// number of probes.  Each key picks a line with the high bits of its hash,
+// and sets up to kMaxBlockedProbes bits in it at positions derived from
+// the hash by multiplication with the salts below.
+static const size_t kCacheLineSize = 64;
+static const size_t kMaxBlockedProbes = 8;
+static const uint32_t kProbeSalt[kMaxBlockedProbes] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+// Returns the offset in a filter of "num_lines" lines of the line for a
+// key with hash "h".
+static inline size_t LineOffset(uint32_t h, size_t num_lines) {
+  return static_cast<size_t>((static_cast<uint64_t>(h) * num_lines) >> 32) *
+         kCacheLineSize;
+}
+
+// Returns the hash used to place the bits of a key within its line.  The
+// bits of "h" that picked the line are rotated away from the top.
+static inline uint32_t ProbeHash(uint32_t h) { return (h >> 17) | (h << 15); }
+
+// Returns the position (0..511) of probe "j" within a line.
+static inline uint32_t ProbeBit(uint32_t h, size_t j) {
+  return (h * kProbeSalt[j]) >> 23;
+}
+
+static bool ProbeLine(const char* line, uint32_t h, size_t k) {
+  for (size_t j = 0; j < k; j++) {
+    const uint32_t bitpos = ProbeBit(h, j);
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+  }
+  return true;
+}
+
+#if HAVE_AVX2
+// ProbeLine() with all of the probes done at once.  Reading the line as
+// 32-bit little-endian words finds bit "bitpos" where ProbeLine() does.
+__attribute__((target("avx2"))) static bool ProbeLineAVX2(const char* line,
+                                                          uint32_t h,
+                                                          size_t k) {
+  const __m256i salt =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kProbeSalt));
+  const __m256i bitpos =
+      _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(h), salt), 23);
+  const __m256i words =
+      _mm256_i32gather_epi32(reinterpret_cast<const int*>(line),
+                             _mm256_srli_epi32(bitpos, 5), 4);
+  __m256i bits = _mm256_sllv_epi32(
+      _mm256_set1_epi32(1), _mm256_and_si256(bitpos, _mm256_set1_epi32(31)));
+  // Only the first k lanes are probes of this filter.
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  bits = _mm256_and_si256(
+      bits, _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(k)), lane));
+  return _mm256_testc_si256(words, bits);
+}
+#endif  // HAVE_AVX2
+
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key), use_avx2_(false) {
+    // We intentionally round down to reduce probing cost a little bit
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > kMaxBlockedProbes) k_ = kMaxBlockedProbes;
+#if HAVE_AVX2
+    use_avx2_ = __builtin_cpu_supports("avx2");
+#endif  // HAVE_AVX2
+  }
+
+  const char* Name() const override { return "leveldb.BlockedBloomFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    const size_t bits = n * bits_per_key_;
+    const size_t num_lines =
+        std::max<size_t>(1, (bits + kCacheLineSize * 8 - 1) /
+                                (kCacheLineSize * 8));
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kCacheLineSize, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      char* line = array + LineOffset(h, num_lines);
+      const uint32_t probe_hash = ProbeHash(h);
+      for (size_t j = 0; j < k_; j++) {
+        const uint32_t bitpos = ProbeBit(probe_hash, j);
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    const size_t len = bloom_filter.size();
+    if (len < 2) return false;
+    if ((len - 1) % kCacheLineSize != 0) {
+      // Not a filter built by this policy.  Consider it a match.
+      return true;
+    }
+
+    const char* array = bloom_filter.data();
+    const size_t k = array[len - 1];
+    if (k > kMaxBlockedProbes) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    const char* line = array + LineOffset(h, (len - 1) / kCacheLineSize);
+#if HAVE_AVX2
+    if (use_avx2_) {
+      return ProbeLineAVX2(line, ProbeHash(h), k);
+    }
+#endif  // HAVE_AVX2
+    return ProbeLine(line, ProbeHash(h), k);
+  }
+
+ private:
+  size_t bits_per_key_;
+  size_t k_;
+  bool use_avx2_;  // True if the CPU supports AVX2
+};
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
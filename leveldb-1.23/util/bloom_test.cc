@@ -20,6 +20,7 @@ static Slice Key(int i, char* buffer) {
 class BloomTest : public testing::Test {
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -73,6 +74,13 @@ class BloomTest : public testing::Test {
     return result / 10000.0;
   }
 
+  // Checks filters for growing numbers of keys.  Filters may be at most
+  // "max_overhead" bytes larger than 10 bits per key, and no filter may
+  // have a false positive rate above "max_rate".  Rates above
+  // "mediocre_rate" are allowed for at most one in six filters.
+  void CheckVaryingLengths(size_t max_overhead, double max_rate,
+                           double mediocre_rate);
+
  private:
   const FilterPolicy* policy_;
   std::string filter_;
@@ -106,7 +114,8 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST_F(BloomTest, VaryingLengths) {
+void BloomTest::CheckVaryingLengths(size_t max_overhead, double max_rate,
+                                    double mediocre_rate) {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -120,7 +129,7 @@ TEST_F(BloomTest, VaryingLengths) {
     }
     Build();
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+    ASSERT_LE(FilterSize(), static_cast<size_t>(length * 10 / 8) + max_overhead)
         << length;
 
     // All added keys must match
@@ -136,8 +145,8 @@ TEST_F(BloomTest, VaryingLengths) {
                    "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
                    rate * 100.0, length, static_cast<int>(FilterSize()));
     }
-    ASSERT_LE(rate, 0.02);  // Must not be over 2%
-    if (rate > 0.0125)
+    ASSERT_LE(rate, max_rate);
+    if (rate > mediocre_rate)
       mediocre_filters++;  // Allowed, but not too often
     else
       good_filters++;
@@ -149,6 +158,36 @@ TEST_F(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
+TEST_F(BloomTest, VaryingLengths) {
+  // False positive rate must not be over 2%, and should mostly stay below
+  // 1.25%.
+  CheckVaryingLengths(40, 0.02, 0.0125);
+}
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST_F(BlockedBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BlockedBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(BlockedBloomTest, VaryingLengths) {
+  // Filters are rounded up to whole cache lines, plus the probe count.
+  CheckVaryingLengths(65, 0.02, 0.0125);
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
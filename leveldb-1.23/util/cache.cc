@@ -4,9 +4,14 @@
 
 #include "leveldb/cache.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -17,6 +22,8 @@ namespace leveldb {
 
 Cache::~Cache() {}
 
+std::string Cache::GetStats() const { return std::string(); }
+
 namespace {
 
 // LRU cache implementation
@@ -67,18 +74,19 @@ struct LRUHandle {
 // table implementations in some of the compiler/runtime combinations
 // we have tested.  E.g., readrandom speeds up by ~5% over the g++
 // 4.4.3's builtin hashtable.
+template <typename Entry>
 class HandleTable {
  public:
   HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
   ~HandleTable() { delete[] list_; }
 
-  LRUHandle* Lookup(const Slice& key, uint32_t hash) {
+  Entry* Lookup(const Slice& key, uint32_t hash) {
     return *FindPointer(key, hash);
   }
 
-  LRUHandle* Insert(LRUHandle* h) {
-    LRUHandle** ptr = FindPointer(h->key(), h->hash);
-    LRUHandle* old = *ptr;
+  Entry* Insert(Entry* h) {
+    Entry** ptr = FindPointer(h->key(), h->hash);
+    Entry* old = *ptr;
     h->next_hash = (old == nullptr ? nullptr : old->next_hash);
     *ptr = h;
     if (old == nullptr) {
@@ -92,9 +100,9 @@ class HandleTable {
     return old;
   }
 
-  LRUHandle* Remove(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = FindPointer(key, hash);
-    LRUHandle* result = *ptr;
+  Entry* Remove(const Slice& key, uint32_t hash) {
+    Entry** ptr = FindPointer(key, hash);
+    Entry* result = *ptr;
     if (result != nullptr) {
       *ptr = result->next_hash;
       --elems_;
@@ -107,13 +115,13 @@ class HandleTable {
   // a linked list of cache entries that hash into the bucket.
   uint32_t length_;
   uint32_t elems_;
-  LRUHandle** list_;
+  Entry** list_;
 
   // Return a pointer to slot that points to a cache entry that
   // matches key/hash.  If there is no such cache entry, return a
   // pointer to the trailing slot in the corresponding linked list.
-  LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = &list_[hash & (length_ - 1)];
+  Entry** FindPointer(const Slice& key, uint32_t hash) {
+    Entry** ptr = &list_[hash & (length_ - 1)];
     while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
       ptr = &(*ptr)->next_hash;
     }
@@ -125,15 +133,15 @@ class HandleTable {
     while (new_length < elems_) {
       new_length *= 2;
     }
-    LRUHandle** new_list = new LRUHandle*[new_length];
+    Entry** new_list = new Entry*[new_length];
     memset(new_list, 0, sizeof(new_list[0]) * new_length);
     uint32_t count = 0;
     for (uint32_t i = 0; i < length_; i++) {
-      LRUHandle* h = list_[i];
+      Entry* h = list_[i];
       while (h != nullptr) {
-        LRUHandle* next = h->next_hash;
+        Entry* next = h->next_hash;
         uint32_t hash = h->hash;
-        LRUHandle** ptr = &new_list[hash & (new_length - 1)];
+        Entry** ptr = &new_list[hash & (new_length - 1)];
         h->next_hash = *ptr;
         *ptr = h;
         h = next;
@@ -147,9 +155,140 @@ class HandleTable {
   }
 };
 
+// Counters kept by each shard of a sharded cache.
+struct ShardStats {
+  size_t usage;
+  size_t capacity;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t inserts;
+  uint64_t evictions;
+  uint64_t lock_waits;  // Acquisitions of the shard lock that had to wait
+};
+
+// Like MutexLock, but increments *waits (which must be guarded by *mu) if
+// the mutex was not immediately available.
+class SCOPED_LOCKABLE CountingMutexLock {
+ public:
+  CountingMutexLock(port::Mutex* mu, uint64_t* waits)
+      EXCLUSIVE_LOCK_FUNCTION(mu)
+      : mu_(mu) {
+    if (!mu_->TryLock()) {
+      mu_->Lock();
+      ++*waits;
+    }
+  }
+  ~CountingMutexLock() UNLOCK_FUNCTION() { mu_->Unlock(); }
+
+  CountingMutexLock(const CountingMutexLock&) = delete;
+  CountingMutexLock& operator=(const CountingMutexLock&) = delete;
+
+ private:
+  port::Mutex* const mu_;
+};
+
+// A reader-writer lock.  Readers count themselves in state_; a writer
+// holds mu_ and sets kWriter in state_, then waits for the readers that
+// are already inside to leave.  Readers that find kWriter set wait for the
+// writer on mu_, so only a writer ever spins, and only for as long as the
+// readers ahead of it hold the lock.
+class LOCKABLE SharedMutex {
+ public:
+  SharedMutex() : state_(0) {}
+
+  SharedMutex(const SharedMutex&) = delete;
+  SharedMutex& operator=(const SharedMutex&) = delete;
+
+  // Both lock functions return false if they had to wait.
+  bool Lock() EXCLUSIVE_LOCK_FUNCTION() {
+    bool waited = !mu_.TryLock();
+    if (waited) {
+      mu_.Lock();
+    }
+    // Readers do not enter while kWriter is set.
+    state_.fetch_or(kWriter, std::memory_order_relaxed);
+    while (state_.load(std::memory_order_acquire) != kWriter) {
+      waited = true;
+      std::this_thread::yield();
+    }
+    return !waited;
+  }
+  void Unlock() UNLOCK_FUNCTION() {
+    state_.store(0, std::memory_order_release);
+    mu_.Unlock();
+  }
+
+  bool LockShared() SHARED_LOCK_FUNCTION() {
+    bool waited = false;
+    uint32_t state = state_.load(std::memory_order_relaxed);
+    while (true) {
+      if ((state & kWriter) != 0) {
+        // Wait for the writer to finish.
+        waited = true;
+        mu_.Lock();
+        mu_.Unlock();
+        state = state_.load(std::memory_order_relaxed);
+      } else if (state_.compare_exchange_weak(state, state + 1,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+        return !waited;
+      }
+    }
+  }
+  void UnlockShared() UNLOCK_FUNCTION() {
+    state_.fetch_sub(1, std::memory_order_release);
+  }
+
+ private:
+  static const uint32_t kWriter = 1u << 31;
+
+  port::Mutex mu_;
+  std::atomic<uint32_t> state_;  // kWriter | number of readers
+};
+
+// Hold a SharedMutex exclusively or shared for the duration of a scope,
+// incrementing *waits (if non-null) if it was not immediately available.
+class SCOPED_LOCKABLE WriterLock {
+ public:
+  WriterLock(SharedMutex* mu, std::atomic<uint64_t>* waits)
+      EXCLUSIVE_LOCK_FUNCTION(mu)
+      : mu_(mu) {
+    if (!mu_->Lock() && waits != nullptr) {
+      waits->fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  ~WriterLock() UNLOCK_FUNCTION() { mu_->Unlock(); }
+
+  WriterLock(const WriterLock&) = delete;
+  WriterLock& operator=(const WriterLock&) = delete;
+
+ private:
+  SharedMutex* const mu_;
+};
+
+class SCOPED_LOCKABLE ReaderLock {
+ public:
+  ReaderLock(SharedMutex* mu, std::atomic<uint64_t>* waits)
+      SHARED_LOCK_FUNCTION(mu)
+      : mu_(mu) {
+    if (!mu_->LockShared() && waits != nullptr) {
+      waits->fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  ~ReaderLock() UNLOCK_FUNCTION() { mu_->UnlockShared(); }
+
+  ReaderLock(const ReaderLock&) = delete;
+  ReaderLock& operator=(const ReaderLock&) = delete;
+
+ private:
+  SharedMutex* const mu_;
+};
+
 // A single shard of sharded cache.
 class LRUCache {
  public:
+  typedef LRUHandle Entry;
+
   LRUCache();
   ~LRUCache();
 
@@ -168,6 +307,7 @@ class LRUCache {
     MutexLock l(&mutex_);
     return usage_;
   }
+  ShardStats Stats() const;
 
  private:
   void LRU_Remove(LRUHandle* e);
@@ -182,6 +322,11 @@ class LRUCache {
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  uint64_t hits_ GUARDED_BY(mutex_);
+  uint64_t misses_ GUARDED_BY(mutex_);
+  uint64_t inserts_ GUARDED_BY(mutex_);
+  uint64_t evictions_ GUARDED_BY(mutex_);
+  uint64_t lock_waits_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
@@ -192,10 +337,17 @@ class LRUCache {
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
 
-  HandleTable table_ GUARDED_BY(mutex_);
+  HandleTable<LRUHandle> table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      usage_(0),
+      hits_(0),
+      misses_(0),
+      inserts_(0),
+      evictions_(0),
+      lock_waits_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
@@ -251,16 +403,19 @@ void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
 }
 
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
+  CountingMutexLock l(&mutex_, &lock_waits_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
+    hits_++;
     Ref(e);
+  } else {
+    misses_++;
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
 void LRUCache::Release(Cache::Handle* handle) {
-  MutexLock l(&mutex_);
+  CountingMutexLock l(&mutex_, &lock_waits_);
   Unref(reinterpret_cast<LRUHandle*>(handle));
 }
 
@@ -268,7 +423,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
                                                 void* value)) {
-  MutexLock l(&mutex_);
+  CountingMutexLock l(&mutex_, &lock_waits_);
+  inserts_++;
 
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
@@ -294,6 +450,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   while (usage_ > capacity_ && lru_.next != &lru_) {
     LRUHandle* old = lru_.next;
     assert(old->refs == 1);
+    evictions_++;
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
       assert(erased);
@@ -317,7 +474,7 @@ bool LRUCache::FinishErase(LRUHandle* e) {
 }
 
 void LRUCache::Erase(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
+  CountingMutexLock l(&mutex_, &lock_waits_);
   FinishErase(table_.Remove(key, hash));
 }
 
@@ -333,12 +490,385 @@ void LRUCache::Prune() {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+ShardStats LRUCache::Stats() const {
+  MutexLock l(&mutex_);
+  ShardStats stats;
+  stats.usage = usage_;
+  stats.capacity = capacity_;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.inserts = inserts_;
+  stats.evictions = evictions_;
+  stats.lock_waits = lock_waits_;
+  return stats;
+}
+
+// CLOCK cache implementation
+//
+// A scan-resistant alternative to the LRU cache, organized like 2Q: new
+// entries enter a probationary FIFO queue and are only promoted to the
+// main queue if they are looked up again before they reach its head.  The
+// main queue is managed with the CLOCK algorithm.  A scan that touches
+// each block once therefore only recycles the probationary queue and
+// leaves the hot working set in the main queue alone.
+//
+// The shard lock is a reader-writer lock.  Lookup() only changes atomic
+// fields of the entry it finds, so it holds the lock shared and lookups
+// of one shard run in parallel: instead of moving the entry in a list, it
+// bumps a small atomic hit counter.  The clock hand decrements the counter
+// of each entry it passes, so entries that are hit often survive several
+// sweeps.  Release() does not take the lock at all.  Insert(), Erase() and
+// eviction hold the lock exclusively.  References are counted atomically
+// and only acquired with the lock held, so eviction can safely evict
+// entries with no outstanding handles.
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockHandle* next_hash;
+  ClockHandle* next;
+  ClockHandle* prev;
+  size_t charge;
+  size_t key_length;
+  bool in_cache;  // Whether entry is in the cache.
+  bool in_main;   // Whether entry is in the main queue (else probationary).
+  std::atomic<uint8_t> hits;   // Recent lookups, see ClockCache::kMaxHits
+  std::atomic<uint32_t> refs;  // References, including cache reference,
+                               // if present.
+  uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
+  char key_data[1];  // Beginning of key
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// A single shard of sharded cache.
+class ClockCache {
+ public:
+  typedef ClockHandle Entry;
+
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of ClockCache
+  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    ReaderLock l(&mutex_, nullptr);
+    return usage_;
+  }
+  ShardStats Stats() const;
 
-class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  // Percentage of the capacity the probationary queue may use before
+  // eviction prefers it over the main queue.
+  static const int kProbationPercent = 25;
+
+  // Saturation value of ClockHandle::hits, i.e. the number of sweeps of
+  // the clock hand an entry survives without further lookups.
+  static const uint8_t kMaxHits = 3;
+
+  static void List_Remove(ClockHandle* e);
+  static void List_Append(ClockHandle* list, ClockHandle* e);
+  static void Unref(ClockHandle* e);
+  bool EvictFromProbation() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool EvictFromMain() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool FinishErase(ClockHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Initialized before use.
+  size_t capacity_;
+
+  // Updated by lookups, which only hold mutex_ shared.
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+  std::atomic<uint64_t> lock_waits_;
+
+  // mutex_ protects the following state.
+  mutable SharedMutex mutex_;
+  size_t usage_ GUARDED_BY(mutex_);
+  size_t probation_usage_ GUARDED_BY(mutex_);
+  size_t probation_count_ GUARDED_BY(mutex_);
+  size_t main_count_ GUARDED_BY(mutex_);
+  uint64_t inserts_ GUARDED_BY(mutex_);
+  uint64_t evictions_ GUARDED_BY(mutex_);
+
+  // Dummy heads of the probationary and main queues.  list.next is the
+  // oldest entry (the clock hand), list.prev the newest.  Entries in either
+  // queue have in_cache==true, and may or may not be in use by clients.
+  ClockHandle probation_ GUARDED_BY(mutex_);
+  ClockHandle main_ GUARDED_BY(mutex_);
+
+  HandleTable<ClockHandle> table_ GUARDED_BY(mutex_);
+};
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      hits_(0),
+      misses_(0),
+      lock_waits_(0),
+      usage_(0),
+      probation_usage_(0),
+      probation_count_(0),
+      main_count_(0),
+      inserts_(0),
+      evictions_(0) {
+  // Make empty circular linked lists.
+  probation_.next = &probation_;
+  probation_.prev = &probation_;
+  main_.next = &main_;
+  main_.prev = &main_;
+}
+
+ClockCache::~ClockCache() {
+  ClockHandle* lists[2] = {&probation_, &main_};
+  for (ClockHandle* list : lists) {
+    for (ClockHandle* e = list->next; e != list;) {
+      ClockHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      // Error if caller has an unreleased handle
+      assert(e->refs.load(std::memory_order_relaxed) == 1);
+      Unref(e);
+      e = next;
+    }
+  }
+}
+
+void ClockCache::List_Remove(ClockHandle* e) {
+  e->next->prev = e->prev;
+  e->prev->next = e->next;
+}
+
+void ClockCache::List_Append(ClockHandle* list, ClockHandle* e) {
+  // Make "e" newest entry by inserting just before *list
+  e->next = list;
+  e->prev = list->prev;
+  e->prev->next = e;
+  e->next->prev = e;
+}
+
+void ClockCache::Unref(ClockHandle* e) {
+  if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    // Last reference; the cache's own reference is gone, so e is no
+    // longer reachable.
+    assert(!e->in_cache);
+    (*e->deleter)(e->key(), e->value);
+    e->~ClockHandle();
+    free(e);
+  }
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  ReaderLock l(&mutex_, &lock_waits_);
+  ClockHandle* e = table_.Lookup(key, hash);
+  if (e == nullptr) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    // The cache's reference keeps e alive until a writer erases it.
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    // Concurrent lookups may lose an increment; the count is a hint.
+    uint8_t hits = e->hits.load(std::memory_order_relaxed);
+    if (hits < kMaxHits) {
+      e->hits.store(hits + 1, std::memory_order_relaxed);
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, uint32_t hash, void* value,
+                                  size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value)) {
+  WriterLock l(&mutex_, &lock_waits_);
+  inserts_++;
+
+  ClockHandle* e = new (malloc(sizeof(ClockHandle) - 1 + key.size()))
+      ClockHandle;
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  e->in_cache = false;
+  e->in_main = false;
+  e->hits.store(0, std::memory_order_relaxed);
+  e->refs.store(1, std::memory_order_relaxed);  // for the returned handle.
+  std::memcpy(e->key_data, key.data(), key.size());
+
+  if (capacity_ > 0) {
+    e->refs.fetch_add(1, std::memory_order_relaxed);  // for the cache's
+                                                      // reference.
+    e->in_cache = true;
+    List_Append(&probation_, e);
+    probation_usage_ += charge;
+    probation_count_++;
+    usage_ += charge;
+    FinishErase(table_.Insert(e));
+  }  // else don't cache. (capacity_==0 is supported and turns off caching.)
+
+  while (usage_ > capacity_) {
+    // Recycle the probationary queue first while it holds more than its
+    // share, so that entries seen only once make room for each other.
+    bool evicted = false;
+    if (probation_usage_ > capacity_ * kProbationPercent / 100 ||
+        main_count_ == 0) {
+      evicted = EvictFromProbation();
+    }
+    if (!evicted) {
+      evicted = EvictFromMain() || EvictFromProbation();
+    }
+    if (!evicted) {
+      break;  // Everything left is in use
+    }
+    evictions_++;
+  }
+
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+bool ClockCache::EvictFromProbation() {
+  for (size_t n = probation_count_; n > 0; n--) {
+    ClockHandle* e = probation_.next;
+    if (e->hits.load(std::memory_order_relaxed) > 0) {
+      // Looked up again: promote to the main queue.
+      List_Remove(e);
+      List_Append(&main_, e);
+      e->in_main = true;
+      probation_usage_ -= e->charge;
+      probation_count_--;
+      main_count_++;
+    } else if (e->refs.load(std::memory_order_acquire) > 1) {
+      // In use; skip.
+      List_Remove(e);
+      List_Append(&probation_, e);
+    } else {
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ClockCache::EvictFromMain() {
+  // An entry may be passed kMaxHits times before it can be evicted.
+  for (size_t n = (kMaxHits + 1) * main_count_; n > 0; n--) {
+    ClockHandle* e = main_.next;
+    const uint8_t hits = e->hits.load(std::memory_order_relaxed);
+    if (e->refs.load(std::memory_order_acquire) == 1 && hits == 0) {
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+      return true;
+    }
+    // Give it another chance: advance the clock hand past it.
+    if (hits > 0) {
+      e->hits.store(hits - 1, std::memory_order_relaxed);
+    }
+    List_Remove(e);
+    List_Append(&main_, e);
+  }
+  return false;
+}
+
+// If e != nullptr, finish removing *e from the cache; it has already been
+// removed from the hash table.  Return whether e != nullptr.
+bool ClockCache::FinishErase(ClockHandle* e) {
+  if (e != nullptr) {
+    assert(e->in_cache);
+    List_Remove(e);
+    e->in_cache = false;
+    usage_ -= e->charge;
+    if (e->in_main) {
+      main_count_--;
+    } else {
+      probation_usage_ -= e->charge;
+      probation_count_--;
+    }
+    Unref(e);
+  }
+  return e != nullptr;
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  WriterLock l(&mutex_, &lock_waits_);
+  FinishErase(table_.Remove(key, hash));
+}
+
+void ClockCache::Prune() {
+  WriterLock l(&mutex_, nullptr);
+  ClockHandle* lists[2] = {&probation_, &main_};
+  for (ClockHandle* list : lists) {
+    for (ClockHandle* e = list->next; e != list;) {
+      ClockHandle* next = e->next;
+      if (e->refs.load(std::memory_order_acquire) == 1) {
+        bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+        if (!erased) {  // to avoid unused variable when compiled NDEBUG
+          assert(erased);
+        }
+      }
+      e = next;
+    }
+  }
+}
+
+ShardStats ClockCache::Stats() const {
+  ReaderLock l(&mutex_, nullptr);
+  ShardStats stats;
+  stats.usage = usage_;
+  stats.capacity = capacity_;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.inserts = inserts_;
+  stats.evictions = evictions_;
+  stats.lock_waits = lock_waits_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+// Number of shards used when the caller does not choose one.
+static const int kDefaultNumShardBits = 4;
+static const int kMaxNumShardBits = 10;
+
+// Returns log2 of the shard count to use for "num_shards" (see
+// NewLRUCache()).
+static int ShardBits(int num_shards) {
+  if (num_shards <= 0) {
+    // Enough shards that concurrent readers rarely meet on one.
+    num_shards = std::max(1 << kDefaultNumShardBits,
+                          2 * static_cast<int>(
+                                  std::thread::hardware_concurrency()));
+  }
+  int bits = 0;
+  while (bits < kMaxNumShardBits && (1 << bits) < num_shards) {
+    bits++;
+  }
+  return bits;
+}
+
+// Spreads the entries over a power-of-two number of independent caches of
+// type Shard (LRUCache or ClockCache) by key hash.
+template <typename Shard>
+class ShardedCache : public Cache {
+ private:
+  typedef typename Shard::Entry Entry;
+
+  const int num_shard_bits_;
+  const int num_shards_;
+  Shard* const shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -346,56 +876,115 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  uint32_t ShardOf(uint32_t hash) const {
+    return (num_shard_bits_ == 0) ? 0 : hash >> (32 - num_shard_bits_);
+  }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
+  ShardedCache(size_t capacity, int num_shard_bits)
+      : num_shard_bits_(num_shard_bits),
+        num_shards_(1 << num_shard_bits),
+        shard_(new Shard[num_shards_]),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (num_shards_ - 1)) / num_shards_;
+    for (int s = 0; s < num_shards_; s++) {
       shard_[s].SetCapacity(per_shard);
     }
   }
-  ~ShardedLRUCache() override {}
+  ~ShardedCache() override { delete[] shard_; }
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[ShardOf(hash)].Insert(key, hash, value, charge, deleter);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Lookup(key, hash);
+    return shard_[ShardOf(hash)].Lookup(key, hash);
   }
   void Release(Handle* handle) override {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
-    shard_[Shard(h->hash)].Release(handle);
+    Entry* h = reinterpret_cast<Entry*>(handle);
+    shard_[ShardOf(h->hash)].Release(handle);
   }
   void Erase(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    shard_[Shard(hash)].Erase(key, hash);
+    shard_[ShardOf(hash)].Erase(key, hash);
   }
   void* Value(Handle* handle) override {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+    return reinterpret_cast<Entry*>(handle)->value;
   }
   uint64_t NewId() override {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < num_shards_; s++) {
       shard_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < num_shards_; s++) {
       total += shard_[s].TotalCharge();
     }
     return total;
   }
+  std::string GetStats() const override {
+    std::string result;
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "Shard   Usage(KB) Capacity(KB)       Hits     Misses"
+                  "    Inserts  Evictions  LockWaits\n"
+                  "-----------------------------------------------------"
+                  "---------------------------------\n");
+    result.append(buf);
+    ShardStats total = {};
+    for (int s = 0; s < num_shards_; s++) {
+      ShardStats stats = shard_[s].Stats();
+      AppendStatsLine(std::to_string(s), stats, &result);
+      total.usage += stats.usage;
+      total.capacity += stats.capacity;
+      total.hits += stats.hits;
+      total.misses += stats.misses;
+      total.inserts += stats.inserts;
+      total.evictions += stats.evictions;
+      total.lock_waits += stats.lock_waits;
+    }
+    AppendStatsLine("Total", total, &result);
+    return result;
+  }
+
+ private:
+  static void AppendStatsLine(const std::string& name, const ShardStats& stats,
+                              std::string* result) {
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "%5s %11.1f %12.1f %10llu %10llu %10llu %10llu %10llu\n",
+                  name.c_str(), stats.usage / 1024.0, stats.capacity / 1024.0,
+                  static_cast<unsigned long long>(stats.hits),
+                  static_cast<unsigned long long>(stats.misses),
+                  static_cast<unsigned long long>(stats.inserts),
+                  static_cast<unsigned long long>(stats.evictions),
+                  static_cast<unsigned long long>(stats.lock_waits));
+    result->append(buf);
+  }
 };
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) {
+  return new ShardedCache<LRUCache>(capacity, kDefaultNumShardBits);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shards) {
+  return new ShardedCache<LRUCache>(capacity, ShardBits(num_shards));
+}
+
+Cache* NewClockCache(size_t capacity) {
+  return new ShardedCache<ClockCache>(capacity, kDefaultNumShardBits);
+}
+
+Cache* NewClockCache(size_t capacity, int num_shards) {
+  return new ShardedCache<ClockCache>(capacity, ShardBits(num_shards));
+}
 
 }  // namespace leveldb
@@ -4,10 +4,15 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <cstdio>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "util/coding.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -24,7 +29,7 @@ static int DecodeKey(const Slice& k) {
 static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
 static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
 
-class CacheTest : public testing::Test {
+class CacheTestBase : public testing::Test {
  public:
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
@@ -36,9 +41,9 @@ class CacheTest : public testing::Test {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+  explicit CacheTestBase(Cache* cache) : cache_(cache) { current_ = this; }
 
-  ~CacheTest() { delete cache_; }
+  ~CacheTestBase() { delete cache_; }
 
   int Lookup(int key) {
     Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
@@ -51,20 +56,39 @@ class CacheTest : public testing::Test {
 
   void Insert(int key, int value, int charge = 1) {
     cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
-                                   &CacheTest::Deleter));
+                                   &CacheTestBase::Deleter));
   }
 
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
-                          &CacheTest::Deleter);
+                          &CacheTestBase::Deleter);
   }
 
   void Erase(int key) { cache_->Erase(EncodeKey(key)); }
-  static CacheTest* current_;
+  static CacheTestBase* current_;
 };
-CacheTest* CacheTest::current_;
+CacheTestBase* CacheTestBase::current_;
 
-TEST_F(CacheTest, HitAndMiss) {
+enum CacheType { kLRUCache, kClockCache };
+
+// Checks of the Cache interface, which every implementation must pass.
+class CacheTest : public CacheTestBase,
+                  public testing::WithParamInterface<CacheType> {
+ public:
+  CacheTest() : CacheTestBase(NewCache(kCacheSize)) {}
+
+  static Cache* NewCache(size_t capacity) {
+    return GetParam() == kClockCache ? NewClockCache(capacity)
+                                     : NewLRUCache(capacity);
+  }
+
+  static Cache* NewCache(size_t capacity, int num_shards) {
+    return GetParam() == kClockCache ? NewClockCache(capacity, num_shards)
+                                     : NewLRUCache(capacity, num_shards);
+  }
+};
+
+TEST_P(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -87,7 +111,7 @@ TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(101, deleted_values_[0]);
 }
 
-TEST_F(CacheTest, Erase) {
+TEST_P(CacheTest, Erase) {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,7 +130,7 @@ TEST_F(CacheTest, Erase) {
   ASSERT_EQ(1, deleted_keys_.size());
 }
 
-TEST_F(CacheTest, EntriesArePinned) {
+TEST_P(CacheTest, EntriesArePinned) {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,7 +155,7 @@ TEST_F(CacheTest, EntriesArePinned) {
   ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy) {
+TEST_P(CacheTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
   Insert(300, 301);
@@ -150,7 +174,7 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize) {
+TEST_P(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
   for (int i = 0; i < kCacheSize + 100; i++) {
@@ -167,7 +191,7 @@ TEST_F(CacheTest, UseExceedsCacheSize) {
   }
 }
 
-TEST_F(CacheTest, HeavyEntries) {
+TEST_P(CacheTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -192,15 +216,16 @@ TEST_F(CacheTest, HeavyEntries) {
     }
   }
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId) {
+TEST_P(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
-TEST_F(CacheTest, Prune) {
+TEST_P(CacheTest, Prune) {
   Insert(1, 100);
   Insert(2, 200);
 
@@ -213,14 +238,212 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache) {
+TEST_P(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = NewCache(0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
 }
 
+TEST_P(CacheTest, ShardCounts) {
+  for (int num_shards : {0, 1, 3, 64}) {
+    delete cache_;
+    cache_ = NewCache(kCacheSize, num_shards);
+    for (int i = 0; i < 100; i++) {
+      Insert(i, 1000 + i);
+    }
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ(1000 + i, Lookup(i));
+    }
+    ASSERT_EQ(100, cache_->TotalCharge());
+  }
+}
+
+// Parses the "Total" row of Cache::GetStats() into *stats (in the order
+// hits, misses, inserts, evictions, lock waits).
+static bool ParseTotalStats(const std::string& s, unsigned long long* stats) {
+  size_t pos = s.find("Total");
+  if (pos == std::string::npos) {
+    return false;
+  }
+  double usage, capacity;
+  return std::sscanf(s.c_str() + pos, "Total %lf %lf %llu %llu %llu %llu %llu",
+                     &usage, &capacity, &stats[0], &stats[1], &stats[2],
+                     &stats[3], &stats[4]) == 7;
+}
+
+TEST_P(CacheTest, Stats) {
+  delete cache_;
+  cache_ = NewCache(kCacheSize, 4);
+  ASSERT_EQ(-1, Lookup(1));
+  Insert(1, 100);
+  Insert(2, 200);
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(100, Lookup(1));
+  Insert(3, 300);
+
+  std::string stats = cache_->GetStats();
+  ASSERT_NE(std::string::npos, stats.find("LockWaits")) << stats;
+  unsigned long long total[5];
+  ASSERT_TRUE(ParseTotalStats(stats, total)) << stats;
+  ASSERT_EQ(2, total[0]);
+  ASSERT_EQ(1, total[1]);
+  ASSERT_EQ(3, total[2]);
+  ASSERT_EQ(0, total[3]);
+
+  // Overflowing a single shard evicts one entry.
+  delete cache_;
+  cache_ = NewCache(kCacheSize, 1);
+  for (int i = 0; i < kCacheSize + 1; i++) {
+    Insert(i, i);
+  }
+  ASSERT_TRUE(ParseTotalStats(cache_->GetStats(), total));
+  ASSERT_EQ(kCacheSize + 1, total[2]);
+  ASSERT_EQ(1, total[3]);
+}
+
+INSTANTIATE_TEST_SUITE_P(LRU, CacheTest, testing::Values(kLRUCache));
+INSTANTIATE_TEST_SUITE_P(Clock, CacheTest, testing::Values(kClockCache));
+
+// Checks specific to NewClockCache().
+class ClockCacheTest : public CacheTestBase {
+ public:
+  ClockCacheTest() : CacheTestBase(NewClockCache(kCacheSize)) {}
+};
+
+TEST_F(ClockCacheTest, ScanResistance) {
+  // A working set that is reused survives a scan of many entries that
+  // are each touched only once.
+  const int kHot = kCacheSize / 4;
+  for (int i = 0; i < kHot; i++) {
+    Insert(i, 1000 + i);
+  }
+  for (int i = 0; i < kHot; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  for (int i = 0; i < 10 * kCacheSize; i++) {
+    Insert(kHot + i, 1000 + kHot + i);
+  }
+  int hits = 0;
+  for (int i = 0; i < kHot; i++) {
+    if (Lookup(i) == 1000 + i) {
+      hits++;
+    }
+  }
+  ASSERT_GE(hits, kHot * 9 / 10);
+}
+
+namespace {
+
+struct ConcurrentCacheState {
+  Cache* cache;
+  std::atomic<int> next_id;
+  std::atomic<int> done;
+  std::atomic<int> live_values;
+};
+
+void CountingDeleter(const Slice& key, void* v) {
+  reinterpret_cast<std::atomic<int>*>(v)->fetch_sub(1);
+}
+
+void ConcurrentCacheUser(void* arg) {
+  ConcurrentCacheState* state = reinterpret_cast<ConcurrentCacheState*>(arg);
+  Random rnd(301 + state->next_id.fetch_add(1));
+  std::vector<Cache::Handle*> pinned;
+  for (int i = 0; i < 20000; i++) {
+    std::string key = EncodeKey(rnd.Uniform(200));
+    switch (rnd.Uniform(4)) {
+      case 0:
+        state->live_values.fetch_add(1);
+        pinned.push_back(state->cache->Insert(key, &state->live_values, 1,
+                                              &CountingDeleter));
+        break;
+      case 1:
+        state->cache->Erase(key);
+        break;
+      default: {
+        Cache::Handle* h = state->cache->Lookup(key);
+        if (h != nullptr) {
+          pinned.push_back(h);
+        }
+        break;
+      }
+    }
+    if (pinned.size() > 4) {
+      state->cache->Release(pinned.front());
+      pinned.erase(pinned.begin());
+    }
+  }
+  for (size_t i = 0; i < pinned.size(); i++) {
+    state->cache->Release(pinned[i]);
+  }
+  state->done.fetch_add(1);
+}
+
+}  // namespace
+
+TEST_F(ClockCacheTest, Concurrent) {
+  ConcurrentCacheState state;
+  state.cache = NewClockCache(64);
+  state.next_id = 0;
+  state.done = 0;
+  state.live_values = 0;
+  const int kThreads = 4;
+  for (int i = 0; i < kThreads; i++) {
+    Env::Default()->StartThread(ConcurrentCacheUser, &state);
+  }
+  while (state.done.load() < kThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  delete state.cache;
+  ASSERT_EQ(0, state.live_values.load());
+}
+
+namespace {
+
+struct LookupState {
+  Cache* cache;
+  std::atomic<int> done;
+};
+
+void LookupUser(void* arg) {
+  LookupState* state = reinterpret_cast<LookupState*>(arg);
+  for (int i = 0; i < 100000; i++) {
+    Cache::Handle* h = state->cache->Lookup(EncodeKey(i % 100));
+    if (h != nullptr) {
+      state->cache->Release(h);
+    }
+  }
+  state->done.fetch_add(1);
+}
+
+}  // namespace
+
+TEST_F(ClockCacheTest, ConcurrentLookupsDoNotWait) {
+  // Lookups share the lock of a shard, so they never wait for each other.
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 1);
+  for (int i = 0; i < 100; i++) {
+    Insert(i, i);
+  }
+  LookupState state;
+  state.cache = cache_;
+  state.done = 0;
+  const int kThreads = 4;
+  for (int i = 0; i < kThreads; i++) {
+    Env::Default()->StartThread(LookupUser, &state);
+  }
+  while (state.done.load() < kThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  unsigned long long total[5];
+  ASSERT_TRUE(ParseTotalStats(cache_->GetStats(), total));
+  ASSERT_EQ(kThreads * 100000, total[0]);
+  ASSERT_EQ(0, total[4]);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -22,6 +22,39 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::ReuseWritableFile(const std::string& fname,
+                              const std::string& old_fname,
+                              WritableFile** result) {
+  Status s = RenameFile(old_fname, fname);
+  if (!s.ok()) {
+    *result = nullptr;
+    return s;
+  }
+  return NewWritableFile(fname, result);
+}
+
+Status Env::NewRandomAccessFileWithMmap(const std::string& fname,
+                                        bool use_mmap,
+                                        RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+void Env::ScheduleHighPriority(void (*function)(void* arg), void* arg) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number) {}
+
 Status Env::RemoveDir(const std::string& dirname) { return DeleteDir(dirname); }
 Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 
@@ -32,8 +65,24 @@ SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+Status RandomAccessFile::MultiRead(ReadRequest* requests, size_t n) const {
+  Status result;
+  for (size_t i = 0; i < n; i++) {
+    ReadRequest* req = &requests[i];
+    req->status = Read(req->offset, req->n, &req->result, req->scratch);
+    if (result.ok()) {
+      result = req->status;
+    }
+  }
+  return result;
+}
+
+void RandomAccessFile::Prefetch(uint64_t offset, size_t n) const {}
+
 WritableFile::~WritableFile() = default;
 
+void WritableFile::Preallocate(uint64_t size) {}
+
 Logger::~Logger() = default;
 
 FileLock::~FileLock() = default;
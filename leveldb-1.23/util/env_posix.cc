@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -35,6 +36,10 @@
 #include "util/env_posix_test_helper.h"
 #include "util/posix_logger.h"
 
+#if HAVE_IO_URING
+#include <liburing.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -57,6 +62,46 @@ constexpr const int kOpenBaseFlags = 0;
 
 constexpr const size_t kWritableFileBufferSize = 65536;
 
+// Offsets, sizes and buffers of direct I/O must be multiples of the file
+// system's logical block size; 4096 bytes covers the common ones.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+// Writes bypassing the page cache are synchronous, so they are batched
+// into larger chunks than buffered writes.
+constexpr const size_t kDirectWritableFileBufferSize = 1 << 20;
+
+// Rounds |size| up to a multiple of kDirectIOAlignment.
+size_t RoundUpToDirectIOAlignment(size_t size) {
+  return (size + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+}
+
+// Returns a buffer of |size| bytes usable for direct I/O. The buffer must be
+// released with std::free().
+char* NewDirectIOBuffer(size_t size) {
+  void* buffer = nullptr;
+  if (::posix_memalign(&buffer, kDirectIOAlignment, size) != 0) {
+    std::abort();  // Out of memory, as operator new would report it.
+  }
+  return static_cast<char*>(buffer);
+}
+
+// Opens |filename| for I/O that bypasses the page cache, where the platform
+// allows it. Returns -1 and sets errno on failure; errno is EINVAL if the
+// file system does not support such I/O.
+int OpenDirect(const std::string& filename, int flags) {
+#if defined(O_DIRECT)
+  flags |= O_DIRECT;
+#endif  // defined(O_DIRECT)
+  int fd = ::open(filename.c_str(), flags | kOpenBaseFlags, 0644);
+#if defined(F_NOCACHE)
+  if (fd >= 0) {
+    // Best effort; the file remains usable if caching cannot be disabled.
+    ::fcntl(fd, F_NOCACHE, 1);
+  }
+#endif  // defined(F_NOCACHE)
+  return fd;
+}
+
 Status PosixError(const std::string& context, int error_number) {
   if (error_number == ENOENT) {
     return Status::NotFound(context, std::strerror(error_number));
@@ -140,11 +185,95 @@ class PosixSequentialFile final : public SequentialFile {
   const std::string filename_;
 };
 
+#if HAVE_IO_URING
+// Maximum number of reads a MultiRead() call keeps in flight at once.
+constexpr const size_t kIoUringQueueDepth = 32;
+
+// An io_uring instance owned by a single thread, used to keep the reads of
+// a MultiRead() call in flight together.
+class ThreadIoUring {
+ public:
+  // Returns the calling thread's ring, or nullptr if io_uring is not
+  // usable (e.g. not supported by the kernel).
+  static ThreadIoUring* Get() {
+    static thread_local ThreadIoUring thread_ring;
+    return thread_ring.usable_ ? &thread_ring : nullptr;
+  }
+
+  ThreadIoUring(const ThreadIoUring&) = delete;
+  ThreadIoUring& operator=(const ThreadIoUring&) = delete;
+
+  // Perform requests[0,n-1] on fd, with n <= kIoUringQueueDepth.  Sets
+  // done[i] for each request that completed.  Returns false if the ring
+  // failed, in which case it must not be used any more.
+  bool Read(int fd, const std::string& filename,
+            RandomAccessFile::ReadRequest* requests, size_t n, bool* done) {
+    assert(n <= kIoUringQueueDepth);
+    for (size_t i = 0; i < n; i++) {
+      ::io_uring_sqe* sqe = ::io_uring_get_sqe(&ring_);
+      assert(sqe != nullptr);  // The queue is empty between calls
+      ::io_uring_prep_read(sqe, fd, requests[i].scratch, requests[i].n,
+                           requests[i].offset);
+      ::io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(i));
+    }
+    int submitted;
+    do {
+      submitted = ::io_uring_submit(&ring_);
+    } while (submitted == -EINTR);
+    bool ok = (submitted == static_cast<int>(n));
+
+    // Reap everything that was submitted, even on failure, so that the
+    // kernel is done with the caller's buffers before we return.
+    for (int reaped = 0; reaped < std::max(submitted, 0); reaped++) {
+      ::io_uring_cqe* cqe;
+      int r;
+      do {
+        r = ::io_uring_wait_cqe(&ring_, &cqe);
+      } while (r == -EINTR);
+      if (r < 0) {
+        // Cannot tell whether the remaining reads are still running.
+        std::abort();
+      }
+      size_t i = reinterpret_cast<uintptr_t>(::io_uring_cqe_get_data(cqe));
+      RandomAccessFile::ReadRequest* req = &requests[i];
+      if (cqe->res < 0) {
+        req->result = Slice(req->scratch, 0);
+        req->status = PosixError(filename, -cqe->res);
+      } else {
+        req->result = Slice(req->scratch, cqe->res);
+        req->status = Status::OK();
+      }
+      done[i] = true;
+      ::io_uring_cqe_seen(&ring_, cqe);
+    }
+    if (!ok) {
+      ::io_uring_queue_exit(&ring_);
+      usable_ = false;
+    }
+    return ok;
+  }
+
+ private:
+  ThreadIoUring() {
+    usable_ = (::io_uring_queue_init(kIoUringQueueDepth, &ring_, 0) == 0);
+  }
+  ~ThreadIoUring() {
+    if (usable_) {
+      ::io_uring_queue_exit(&ring_);
+    }
+  }
+
+  ::io_uring ring_;
+  bool usable_;
+};
+#endif  // HAVE_IO_URING
+
 // Implements random read access in a file using pread().
 //
 // Instances of this class are thread-safe, as required by the RandomAccessFile
 // API. Instances are immutable and Read() only calls thread-safe library
-// functions.
+// functions.  When built with liburing, MultiRead() submits its reads through
+// a per-thread io_uring instance.
 class PosixRandomAccessFile final : public RandomAccessFile {
  public:
   // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
@@ -195,6 +324,65 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     return status;
   }
 
+#if HAVE_IO_URING
+  Status MultiRead(ReadRequest* requests, size_t n) const override {
+    if (n <= 1) {
+      return RandomAccessFile::MultiRead(requests, n);
+    }
+    int fd = fd_;
+    if (!has_permanent_fd_) {
+      fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+      if (fd < 0) {
+        return PosixError(filename_, errno);
+      }
+    }
+
+    assert(fd != -1);
+
+    bool done[kIoUringQueueDepth];
+    Status status;
+    for (size_t start = 0; start < n; start += kIoUringQueueDepth) {
+      const size_t count =
+          std::min(n - start, kIoUringQueueDepth);
+      std::fill(done, done + count, false);
+      ThreadIoUring* ring = ThreadIoUring::Get();
+      if (ring == nullptr ||
+          !ring->Read(fd, filename_, requests + start, count, done)) {
+        // Fall back to pread() for whatever the ring did not complete.
+        for (size_t i = 0; i < count; i++) {
+          if (!done[i]) {
+            ReadRequest* req = &requests[start + i];
+            ssize_t read_size = ::pread(fd, req->scratch, req->n,
+                                        static_cast<off_t>(req->offset));
+            req->result = Slice(req->scratch, (read_size < 0) ? 0 : read_size);
+            req->status = (read_size < 0) ? PosixError(filename_, errno)
+                                           : Status::OK();
+          }
+        }
+      }
+      for (size_t i = 0; i < count && status.ok(); i++) {
+        status = requests[start + i].status;
+      }
+    }
+
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+    return status;
+  }
+#endif  // HAVE_IO_URING
+
+  void Prefetch(uint64_t offset, size_t n) const override {
+#if HAVE_POSIX_FADVISE
+    if (has_permanent_fd_) {
+      ::posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(n),
+                      POSIX_FADV_WILLNEED);
+    }
+#endif  // HAVE_POSIX_FADVISE
+  }
+
  private:
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
@@ -215,7 +403,8 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   //
   // |mmap_limiter| must outlive this instance. The caller must have already
   // aquired the right to use one mmap region, which will be released when this
-  // instance is destroyed.
+  // instance is destroyed. |mmap_limiter| may be null if the region is not
+  // accounted for by the Env.
   PosixMmapReadableFile(std::string filename, char* mmap_base, size_t length,
                         Limiter* mmap_limiter)
       : mmap_base_(mmap_base),
@@ -225,7 +414,9 @@ class PosixMmapReadableFile final : public RandomAccessFile {
 
   ~PosixMmapReadableFile() override {
     ::munmap(static_cast<void*>(mmap_base_), length_);
-    mmap_limiter_->Release();
+    if (mmap_limiter_ != nullptr) {
+      mmap_limiter_->Release();
+    }
   }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
@@ -239,6 +430,19 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  void Prefetch(uint64_t offset, size_t n) const override {
+    if (offset >= length_) {
+      return;
+    }
+    n = std::min<size_t>(n, length_ - offset);
+    // madvise() needs a page-aligned start address.
+    static const uintptr_t kPageMask = ::sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t start = reinterpret_cast<uintptr_t>(mmap_base_ + offset);
+    uintptr_t aligned_start = start & ~kPageMask;
+    ::madvise(reinterpret_cast<void*>(aligned_start),
+              n + (start - aligned_start), MADV_WILLNEED);
+  }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -246,10 +450,72 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   const std::string filename_;
 };
 
+// Implements random read access in a file opened with OpenDirect().
+//
+// Each read is widened to the direct I/O alignment and goes through an
+// aligned buffer of its own, so instances are thread-safe.
+class PosixDirectRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|.
+  PosixDirectRandomAccessFile(std::string filename, int fd)
+      : fd_(fd), filename_(std::move(filename)) {}
+
+  ~PosixDirectRandomAccessFile() override { ::close(fd_); }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    const uint64_t aligned_offset = offset & ~(kDirectIOAlignment - 1);
+    const size_t skip = static_cast<size_t>(offset - aligned_offset);
+    const size_t aligned_size = RoundUpToDirectIOAlignment(skip + n);
+    char* buffer = NewDirectIOBuffer(aligned_size);
+
+    Status status;
+    size_t read_size = 0;
+    while (read_size < aligned_size) {
+      ssize_t result_size =
+          ::pread(fd_, buffer + read_size, aligned_size - read_size,
+                  static_cast<off_t>(aligned_offset + read_size));
+      if (result_size < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        status = PosixError(filename_, errno);
+        break;
+      }
+      read_size += result_size;
+      if (result_size == 0 || result_size % kDirectIOAlignment != 0) {
+        break;  // End of file
+      }
+    }
+
+    size_t size = 0;
+    if (status.ok() && read_size > skip) {
+      size = std::min(n, read_size - skip);
+      std::memcpy(scratch, buffer + skip, size);
+    }
+    *result = Slice(scratch, size);
+    std::free(buffer);
+    return status;
+  }
+
+ private:
+  const int fd_;
+  const std::string filename_;
+};
+
+// In direct mode (|fd| opened with OpenDirect()), data is written in aligned
+// chunks from an aligned buffer.  Flush() then leaves the data in the buffer
+// until it is full; Sync() and Close() write out the buffer padded to the
+// alignment and truncate the file to its actual size.
 class PosixWritableFile final : public WritableFile {
  public:
-  PosixWritableFile(std::string filename, int fd)
-      : pos_(0),
+  PosixWritableFile(std::string filename, int fd, bool direct_io = false)
+      : direct_io_(direct_io),
+        buf_size_(direct_io ? kDirectWritableFileBufferSize
+                            : kWritableFileBufferSize),
+        buf_(direct_io ? NewDirectIOBuffer(buf_size_) : new char[buf_size_]),
+        pos_(0),
+        file_offset_(0),
         fd_(fd),
         is_manifest_(IsManifest(filename)),
         filename_(std::move(filename)),
@@ -260,14 +526,37 @@ class PosixWritableFile final : public WritableFile {
       // Ignoring any potential errors
       Close();
     }
+    if (direct_io_) {
+      std::free(buf_);
+    } else {
+      delete[] buf_;
+    }
   }
 
   Status Append(const Slice& data) override {
     size_t write_size = data.size();
     const char* write_data = data.data();
 
+    if (direct_io_) {
+      // Everything goes through the aligned buffer.
+      while (write_size > 0) {
+        size_t copy_size = std::min(write_size, buf_size_ - pos_);
+        std::memcpy(buf_ + pos_, write_data, copy_size);
+        write_data += copy_size;
+        write_size -= copy_size;
+        pos_ += copy_size;
+        if (pos_ == buf_size_) {
+          Status status = FlushBuffer();
+          if (!status.ok()) {
+            return status;
+          }
+        }
+      }
+      return Status::OK();
+    }
+
     // Fit as much as possible into buffer.
-    size_t copy_size = std::min(write_size, kWritableFileBufferSize - pos_);
+    size_t copy_size = std::min(write_size, buf_size_ - pos_);
     std::memcpy(buf_ + pos_, write_data, copy_size);
     write_data += copy_size;
     write_size -= copy_size;
@@ -283,7 +572,7 @@ class PosixWritableFile final : public WritableFile {
     }
 
     // Small writes go to buffer, large writes are written directly.
-    if (write_size < kWritableFileBufferSize) {
+    if (write_size < buf_size_) {
       std::memcpy(buf_, write_data, write_size);
       pos_ = write_size;
       return Status::OK();
@@ -301,7 +590,10 @@ class PosixWritableFile final : public WritableFile {
     return status;
   }
 
-  Status Flush() override { return FlushBuffer(); }
+  Status Flush() override {
+    // In direct mode, partial chunks wait for Sync() or Close().
+    return direct_io_ ? Status::OK() : FlushBuffer();
+  }
 
   Status Sync() override {
     // Ensure new files referred to by the manifest are in the filesystem.
@@ -322,13 +614,56 @@ class PosixWritableFile final : public WritableFile {
     return SyncFd(fd_, filename_);
   }
 
+  void Preallocate(uint64_t size) override {
+#if HAVE_FALLOCATE
+    // Errors are ignored: appends allocate whatever space is missing.
+    ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+#endif  // HAVE_FALLOCATE
+  }
+
  private:
   Status FlushBuffer() {
+    if (direct_io_) {
+      return FlushAlignedBuffer();
+    }
     Status status = WriteUnbuffered(buf_, pos_);
     pos_ = 0;
     return status;
   }
 
+  // Writes buf_[0, pos_ - 1] at file_offset_, padded to the direct I/O
+  // alignment, and truncates the padding off the file.  A partial last chunk
+  // stays in the buffer; it is written again, extended, by the next flush.
+  Status FlushAlignedBuffer() {
+    const size_t write_size = RoundUpToDirectIOAlignment(pos_);
+    std::memset(buf_ + pos_, 0, write_size - pos_);
+    Status status;
+    size_t written = 0;
+    while (written < write_size) {
+      ssize_t write_result =
+          ::pwrite(fd_, buf_ + written, write_size - written,
+                   static_cast<off_t>(file_offset_ + written));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        status = PosixError(filename_, errno);
+        break;
+      }
+      written += write_result;
+    }
+    if (status.ok() && write_size != pos_ &&
+        ::ftruncate(fd_, static_cast<off_t>(file_offset_ + pos_)) != 0) {
+      status = PosixError(filename_, errno);
+    }
+
+    const size_t partial_start = pos_ - pos_ % kDirectIOAlignment;
+    std::memmove(buf_, buf_ + partial_start, pos_ - partial_start);
+    file_offset_ += partial_start;
+    pos_ -= partial_start;
+    return status;
+  }
+
   Status WriteUnbuffered(const char* data, size_t size) {
     while (size > 0) {
       ssize_t write_result = ::write(fd_, data, size);
@@ -426,9 +761,13 @@ class PosixWritableFile final : public WritableFile {
     return Basename(filename).starts_with("MANIFEST");
   }
 
+  const bool direct_io_;
+  const size_t buf_size_;
+
   // buf_[0, pos_ - 1] contains data to be written to fd_.
-  char buf_[kWritableFileBufferSize];
+  char* const buf_;
   size_t pos_;
+  uint64_t file_offset_;  // Direct mode: file offset of buf_[0]
   int fd_;
 
   const bool is_manifest_;  // True if the file's name starts with MANIFEST.
@@ -511,37 +850,39 @@ class PosixEnv : public Env {
 
   Status NewRandomAccessFile(const std::string& filename,
                              RandomAccessFile** result) override {
-    *result = nullptr;
-    int fd = ::open(filename.c_str(), O_RDONLY | kOpenBaseFlags);
-    if (fd < 0) {
-      return PosixError(filename, errno);
-    }
-
     if (!mmap_limiter_.Acquire()) {
-      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_);
-      return Status::OK();
-    }
-
-    uint64_t file_size;
-    Status status = GetFileSize(filename, &file_size);
-    if (status.ok()) {
-      void* mmap_base =
-          ::mmap(/*addr=*/nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
-      if (mmap_base != MAP_FAILED) {
-        *result = new PosixMmapReadableFile(filename,
-                                            reinterpret_cast<char*>(mmap_base),
-                                            file_size, &mmap_limiter_);
-      } else {
-        status = PosixError(filename, errno);
-      }
+      return OpenRandomAccessFile(filename, false, nullptr, result);
     }
-    ::close(fd);
+    Status status =
+        OpenRandomAccessFile(filename, true, &mmap_limiter_, result);
     if (!status.ok()) {
       mmap_limiter_.Release();
     }
     return status;
   }
 
+  Status NewRandomAccessFileWithMmap(const std::string& filename,
+                                     bool use_mmap,
+                                     RandomAccessFile** result) override {
+    return OpenRandomAccessFile(filename, use_mmap, nullptr, result);
+  }
+
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+    int fd = OpenDirect(filename, O_RDONLY);
+    if (fd < 0) {
+      if (errno == EINVAL) {
+        // The file system does not support direct I/O.
+        return NewRandomAccessFile(filename, result);
+      }
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+
+    *result = new PosixDirectRandomAccessFile(filename, fd);
+    return Status::OK();
+  }
+
   Status NewWritableFile(const std::string& filename,
                          WritableFile** result) override {
     int fd = ::open(filename.c_str(),
@@ -555,6 +896,22 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+    int fd = OpenDirect(filename, O_TRUNC | O_WRONLY | O_CREAT);
+    if (fd < 0) {
+      if (errno == EINVAL) {
+        // The file system does not support direct I/O.
+        return NewWritableFile(filename, result);
+      }
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+
+    *result = new PosixWritableFile(filename, fd, /*direct_io=*/true);
+    return Status::OK();
+  }
+
   Status NewAppendableFile(const std::string& filename,
                            WritableFile** result) override {
     int fd = ::open(filename.c_str(),
@@ -568,6 +925,25 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status ReuseWritableFile(const std::string& filename,
+                           const std::string& old_filename,
+                           WritableFile** result) override {
+    if (::rename(old_filename.c_str(), filename.c_str()) != 0) {
+      *result = nullptr;
+      return PosixError(old_filename, errno);
+    }
+    // No O_TRUNC: the blocks of the file are written over in place.
+    int fd =
+        ::open(filename.c_str(), O_WRONLY | O_CREAT | kOpenBaseFlags, 0644);
+    if (fd < 0) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+
+    *result = new PosixWritableFile(filename, fd);
+    return Status::OK();
+  }
+
   bool FileExists(const std::string& filename) override {
     return ::access(filename.c_str(), F_OK) == 0;
   }
@@ -661,7 +1037,20 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    background_pool_.Schedule(background_work_function, background_work_arg);
+  }
+
+  void ScheduleHighPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg) override {
+    high_priority_pool_.Schedule(background_work_function,
+                                 background_work_arg);
+  }
+
+  void SetBackgroundThreads(int number) override {
+    background_pool_.SetThreads(number);
+  }
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -717,32 +1106,84 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
+  // Opens "filename" for random access, memory-mapping it iff "use_mmap".
+  // A memory-mapped file releases its region to |mmap_limiter| (if
+  // non-null) when destroyed.
+  Status OpenRandomAccessFile(const std::string& filename, bool use_mmap,
+                              Limiter* mmap_limiter,
+                              RandomAccessFile** result) {
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_RDONLY | kOpenBaseFlags);
+    if (fd < 0) {
+      return PosixError(filename, errno);
+    }
 
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
+    if (!use_mmap) {
+      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_);
+      return Status::OK();
+    }
+
+    uint64_t file_size;
+    Status status = GetFileSize(filename, &file_size);
+    if (status.ok()) {
+      void* mmap_base =
+          ::mmap(/*addr=*/nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mmap_base != MAP_FAILED) {
+        *result = new PosixMmapReadableFile(filename,
+                                            reinterpret_cast<char*>(mmap_base),
+                                            file_size, mmap_limiter);
+      } else {
+        status = PosixError(filename, errno);
+      }
+    }
+    ::close(fd);
+    return status;
   }
 
-  // Stores the work item data in a Schedule() call.
-  //
-  // Instances are constructed on the thread calling Schedule() and used on the
-  // background thread.
-  //
-  // This structure is thread-safe beacuse it is immutable.
-  struct BackgroundWorkItem {
-    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
-        : function(function), arg(arg) {}
+  // Runs the work items passed to Schedule() on a set of detached threads
+  // that are started on demand.
+  class BackgroundThreadPool {
+   public:
+    BackgroundThreadPool();
 
-    void (*const function)(void*);
-    void* const arg;
-  };
+    void Schedule(void (*background_work_function)(void* background_work_arg),
+                  void* background_work_arg);
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+    // Raise the number of threads to "number" if it is larger.
+    void SetThreads(int number);
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+   private:
+    void BackgroundThreadMain();
+
+    static void BackgroundThreadEntryPoint(BackgroundThreadPool* pool) {
+      pool->BackgroundThreadMain();
+    }
+
+    // Stores the work item data in a Schedule() call.
+    //
+    // Instances are constructed on the thread calling Schedule() and used on
+    // the background thread.
+    //
+    // This structure is thread-safe beacuse it is immutable.
+    struct BackgroundWorkItem {
+      explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
+          : function(function), arg(arg) {}
+
+      void (*const function)(void*);
+      void* const arg;
+    };
+
+    port::Mutex background_work_mutex_;
+    port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
+    int max_background_threads_ GUARDED_BY(background_work_mutex_);
+    int started_background_threads_ GUARDED_BY(background_work_mutex_);
+
+    std::queue<BackgroundWorkItem> background_work_queue_
+        GUARDED_BY(background_work_mutex_);
+  };
+
+  BackgroundThreadPool background_pool_;     // Thread-safe.
+  BackgroundThreadPool high_priority_pool_;  // Thread-safe.
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -773,33 +1214,42 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
+    : mmap_limiter_(MaxMmaps()), fd_limiter_(MaxOpenFiles()) {}
+
+PosixEnv::BackgroundThreadPool::BackgroundThreadPool()
     : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
-      mmap_limiter_(MaxMmaps()),
-      fd_limiter_(MaxOpenFiles()) {}
+      max_background_threads_(1),
+      started_background_threads_(0) {}
 
-void PosixEnv::Schedule(
+void PosixEnv::BackgroundThreadPool::SetThreads(int number) {
+  background_work_mutex_.Lock();
+  if (number > max_background_threads_) {
+    max_background_threads_ = number;
+  }
+  background_work_mutex_.Unlock();
+}
+
+void PosixEnv::BackgroundThreadPool::Schedule(
     void (*background_work_function)(void* background_work_arg),
     void* background_work_arg) {
   background_work_mutex_.Lock();
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+  // Start the background threads, if we haven't done so already.
+  while (started_background_threads_ < max_background_threads_) {
+    ++started_background_threads_;
+    std::thread background_thread(
+        BackgroundThreadPool::BackgroundThreadEntryPoint, this);
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  // Wake up one of the background threads that may be waiting for work.
+  background_work_cv_.Signal();
 
   background_work_queue_.emplace(background_work_function, background_work_arg);
   background_work_mutex_.Unlock();
 }
 
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::BackgroundThreadPool::BackgroundThreadMain() {
   while (true) {
     background_work_mutex_.Lock();
 
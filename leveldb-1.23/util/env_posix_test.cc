@@ -212,6 +212,90 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestMmapChoice) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/mmap_choice.txt";
+  const char kFileData[] = "abcdefghijklmnopqrstuvwxyz";
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, kFileData, test_file));
+
+  // Files mapped at the caller's request do not count against the limit
+  // of the Env, so the last file opened by NewRandomAccessFile() is still
+  // memory-mapped.  Reads from memory-mapped files do not use the scratch
+  // buffer.
+  const int kNumFiles = kMMapLimit + 3;
+  leveldb::RandomAccessFile* files[kNumFiles] = {nullptr};
+  for (int i = 0; i < kNumFiles - 2; i++) {
+    ASSERT_LEVELDB_OK(
+        env_->NewRandomAccessFileWithMmap(test_file, true, &files[i]));
+  }
+  ASSERT_LEVELDB_OK(env_->NewRandomAccessFileWithMmap(test_file, false,
+                                                      &files[kNumFiles - 2]));
+  ASSERT_LEVELDB_OK(
+      env_->NewRandomAccessFile(test_file, &files[kNumFiles - 1]));
+  char scratch;
+  Slice read_result;
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(files[i]->Read(i, 1, &read_result, &scratch));
+    ASSERT_EQ(kFileData[i], read_result[0]);
+    ASSERT_EQ(i == kNumFiles - 2, read_result.data() == &scratch);
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, TestDirectIO) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+
+  // Appends of odd sizes that fill the write buffer more than once, with
+  // syncs of partial chunks in between.
+  leveldb::Random rnd(301);
+  std::string expected;
+  leveldb::WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(test_file, &writable_file));
+  for (int i = 0; expected.size() < 3 * 1024 * 1024; i++) {
+    std::string data;
+    leveldb::test::RandomString(&rnd, rnd.Skewed(17), &data);
+    ASSERT_LEVELDB_OK(writable_file->Append(data));
+    ASSERT_LEVELDB_OK(writable_file->Flush());
+    expected += data;
+    if (i % 50 == 0) {
+      ASSERT_LEVELDB_OK(writable_file->Sync());
+      uint64_t file_size;
+      ASSERT_LEVELDB_OK(env_->GetFileSize(test_file, &file_size));
+      ASSERT_EQ(expected.size(), file_size);
+    }
+  }
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file, &contents));
+  ASSERT_TRUE(contents == expected);
+
+  // Unaligned reads, including some past the end of the file.
+  leveldb::RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewDirectRandomAccessFile(test_file, &file));
+  std::string scratch(100000, '\0');
+  for (int i = 0; i < 200; i++) {
+    const uint64_t offset = rnd.Uniform(expected.size() + 10);
+    const size_t n = rnd.Uniform(scratch.size());
+    Slice result;
+    ASSERT_LEVELDB_OK(file->Read(offset, n, &result, &scratch[0]));
+    const size_t expected_size =
+        offset < expected.size() ? std::min(n, expected.size() - offset) : 0;
+    ASSERT_EQ(expected_size, result.size());
+    const size_t start = std::min<uint64_t>(offset, expected.size());
+    ASSERT_TRUE(result.ToString() == expected.substr(start, expected_size));
+  }
+  delete file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -5,6 +5,8 @@
 #include "leveldb/env.h"
 
 #include <algorithm>
+#include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "port/port.h"
@@ -70,6 +72,39 @@ TEST_F(EnvTest, ReadWrite) {
   delete sequential_file;
 }
 
+TEST_F(EnvTest, MultiRead) {
+  Random rnd(test::RandomSeed());
+
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file_name = test_dir + "/multi_read.txt";
+  std::string data;
+  test::RandomString(&rnd, 1 << 20, &data);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file_name));
+
+  RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file_name, &file));
+  // More requests than are likely kept in flight at once.
+  const size_t kNumRequests = 100;
+  std::vector<RandomAccessFile::ReadRequest> requests(kNumRequests);
+  std::vector<std::string> scratch(kNumRequests);
+  for (size_t i = 0; i < kNumRequests; i++) {
+    requests[i].n = 1 + rnd.Uniform(8192);
+    requests[i].offset = rnd.Uniform(data.size() - requests[i].n);
+    scratch[i].resize(requests[i].n);
+    requests[i].scratch = &scratch[i][0];
+  }
+
+  ASSERT_LEVELDB_OK(file->MultiRead(&requests[0], requests.size()));
+  for (size_t i = 0; i < kNumRequests; i++) {
+    const RandomAccessFile::ReadRequest& req = requests[i];
+    ASSERT_LEVELDB_OK(req.status);
+    ASSERT_EQ(data.substr(req.offset, req.n), req.result.ToString());
+  }
+  delete file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file_name));
+}
+
 TEST_F(EnvTest, RunImmediately) {
   struct RunState {
     port::Mutex mu;
@@ -134,6 +169,81 @@ TEST_F(EnvTest, RunMany) {
   }
 }
 
+TEST_F(EnvTest, RunHighPriorityWhileBusy) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    bool release_blocker = false;
+    bool blocker_done = false;
+    bool high_priority_done = false;
+
+    static void Block(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      while (!state->release_blocker) {
+        state->cvar.Wait();
+      }
+      state->blocker_done = true;
+      state->cvar.SignalAll();
+    }
+
+    static void Run(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->high_priority_done = true;
+      state->cvar.SignalAll();
+    }
+  };
+
+  // The high priority work must not wait for the blocked background work.
+  RunState state;
+  env_->Schedule(&RunState::Block, &state);
+  env_->ScheduleHighPriority(&RunState::Run, &state);
+
+  MutexLock l(&state.mu);
+  while (!state.high_priority_done) {
+    state.cvar.Wait();
+  }
+  state.release_blocker = true;
+  state.cvar.SignalAll();
+  while (!state.blocker_done) {
+    state.cvar.Wait();
+  }
+}
+
+TEST_F(EnvTest, RunConcurrently) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int num_started = 0;
+    int num_done = 0;
+
+    // Finishes only once both callbacks have started, which requires two
+    // background threads.
+    static void Run(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->num_started++;
+      state->cvar.SignalAll();
+      while (state->num_started < 2) {
+        state->cvar.Wait();
+      }
+      state->num_done++;
+      state->cvar.SignalAll();
+    }
+  };
+
+  RunState state;
+  env_->SetBackgroundThreads(2);
+  env_->Schedule(&RunState::Run, &state);
+  env_->Schedule(&RunState::Run, &state);
+
+  MutexLock l(&state.mu);
+  while (state.num_done != 2) {
+    state.cvar.Wait();
+  }
+}
+
 struct State {
   port::Mutex mu;
   port::CondVar cvar{&mu};
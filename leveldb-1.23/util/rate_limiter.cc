@@ -0,0 +1,107 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() {}
+
+namespace {
+
+// Keeps two token buckets refilled at the same rate: one charged with all
+// requests and one charged with kHigh requests only.  Requests may overdraw
+// a bucket; the requester then sleeps until the debt is paid back, so that
+// concurrent requesters are served in the order they asked.
+class TokenBucketRateLimiter : public RateLimiter {
+ public:
+  TokenBucketRateLimiter(int64_t bytes_per_second, Env* env)
+      : env_(env),
+        bytes_per_second_(bytes_per_second),
+        last_refill_micros_(env->NowMicros()),
+        available_(0),
+        high_available_(0) {}
+
+  void Request(size_t bytes, IOPriority priority) override {
+    double debt;
+    double bytes_per_second;
+    {
+      MutexLock l(&mu_);
+      if (bytes_per_second_ <= 0) {
+        return;
+      }
+      Refill();
+      available_ -= bytes;
+      if (priority == kHigh) {
+        high_available_ -= bytes;
+        debt = -high_available_;
+      } else {
+        debt = -available_;
+      }
+      bytes_per_second = static_cast<double>(bytes_per_second_);
+    }
+    if (debt > 0) {
+      const double wait_micros = debt * 1e6 / bytes_per_second;
+      env_->SleepForMicroseconds(static_cast<int>(std::min<double>(
+          wait_micros, std::numeric_limits<int>::max())));
+    }
+  }
+
+  void SetBytesPerSecond(int64_t bytes_per_second) override {
+    MutexLock l(&mu_);
+    Refill();
+    bytes_per_second_ = bytes_per_second;
+  }
+
+  int64_t GetBytesPerSecond() const override {
+    MutexLock l(&mu_);
+    return bytes_per_second_;
+  }
+
+ private:
+  // Refill period; the buckets hold at most one period's worth of bytes.
+  static const int kRefillPeriodMicros = 100000;
+
+  // Adds the bytes earned since the last refill to the buckets.
+  void Refill() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const uint64_t now = env_->NowMicros();
+    if (now <= last_refill_micros_) {
+      return;
+    }
+    if (bytes_per_second_ > 0) {
+      const double earned =
+          static_cast<double>(now - last_refill_micros_) * bytes_per_second_ /
+          1e6;
+      const double burst =
+          static_cast<double>(bytes_per_second_) * kRefillPeriodMicros / 1e6;
+      available_ = std::min(burst, available_ + earned);
+      high_available_ = std::min(burst, high_available_ + earned);
+    }
+    last_refill_micros_ = now;
+  }
+
+  Env* const env_;
+  mutable port::Mutex mu_;
+  int64_t bytes_per_second_ GUARDED_BY(mu_);
+  uint64_t last_refill_micros_ GUARDED_BY(mu_);
+  double available_ GUARDED_BY(mu_);       // Negative if overdrawn
+  double high_available_ GUARDED_BY(mu_);  // Negative if overdrawn
+};
+
+}  // namespace
+
+RateLimiter* NewTokenBucketRateLimiter(int64_t bytes_per_second) {
+  return new TokenBucketRateLimiter(bytes_per_second, Env::Default());
+}
+
+}  // namespace leveldb
@@ -0,0 +1,90 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <atomic>
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+TEST(RateLimiterTest, BytesPerSecond) {
+  std::unique_ptr<RateLimiter> limiter(NewTokenBucketRateLimiter(1000));
+  ASSERT_EQ(1000, limiter->GetBytesPerSecond());
+  limiter->SetBytesPerSecond(2000);
+  ASSERT_EQ(2000, limiter->GetBytesPerSecond());
+}
+
+TEST(RateLimiterTest, LimitsRate) {
+  Env* env = Env::Default();
+  std::unique_ptr<RateLimiter> limiter(NewTokenBucketRateLimiter(4 << 20));
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 300; i++) {
+    limiter->Request(4096, RateLimiter::kLow);
+  }
+  // 1.2MB at 4MB/s, with an empty bucket at the start.
+  const uint64_t elapsed = env->NowMicros() - start;
+  ASSERT_GE(elapsed, 250000);
+  ASSERT_LT(elapsed, 5000000);
+}
+
+TEST(RateLimiterTest, Disabled) {
+  Env* env = Env::Default();
+  std::unique_ptr<RateLimiter> limiter(NewTokenBucketRateLimiter(1 << 20));
+  limiter->SetBytesPerSecond(0);
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 100; i++) {
+    limiter->Request(1 << 20, RateLimiter::kLow);
+  }
+  ASSERT_LT(env->NowMicros() - start, 1000000);
+}
+
+namespace {
+struct LowPriorityRequest {
+  explicit LowPriorityRequest(RateLimiter* limiter)
+      : limiter(limiter), started(false), done(false) {}
+
+  RateLimiter* const limiter;
+  std::atomic<bool> started;
+  std::atomic<bool> done;
+};
+
+void RequestAtLowPriority(void* arg) {
+  LowPriorityRequest* request = reinterpret_cast<LowPriorityRequest*>(arg);
+  request->started.store(true);
+  request->limiter->Request(1 << 20, RateLimiter::kLow);
+  request->done.store(true);
+}
+}  // namespace
+
+TEST(RateLimiterTest, HighPriorityIsNotHeldUpByLowPriority) {
+  Env* env = Env::Default();
+  std::unique_ptr<RateLimiter> limiter(NewTokenBucketRateLimiter(1 << 20));
+
+  // Overdraw by 1MB at low priority, which takes a second to pay back.
+  LowPriorityRequest request(limiter.get());
+  env->StartThread(&RequestAtLowPriority, &request);
+  while (!request.started.load()) {
+    env->SleepForMicroseconds(1000);
+  }
+  env->SleepForMicroseconds(10000);
+
+  const uint64_t start = env->NowMicros();
+  limiter->Request(10 << 10, RateLimiter::kHigh);
+  ASSERT_LT(env->NowMicros() - start, 500000);
+
+  while (!request.done.load()) {
+    env->SleepForMicroseconds(10000);
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/slice_transform.h"
+
+#include <cassert>
+#include <string>
+
+namespace leveldb {
+
+SliceTransform::~SliceTransform() {}
+
+namespace {
+class FixedPrefixTransform : public SliceTransform {
+ public:
+  explicit FixedPrefixTransform(size_t prefix_len)
+      : prefix_len_(prefix_len),
+        name_("leveldb.FixedPrefix." + std::to_string(prefix_len)) {}
+
+  const char* Name() const override { return name_.c_str(); }
+
+  bool InDomain(const Slice& key) const override {
+    return key.size() >= prefix_len_;
+  }
+
+  Slice Transform(const Slice& key) const override {
+    assert(InDomain(key));
+    return Slice(key.data(), prefix_len_);
+  }
+
+ private:
+  const size_t prefix_len_;
+  const std::string name_;
+};
+}  // namespace
+
+const SliceTransform* NewFixedPrefixTransform(size_t prefix_len) {
+  return new FixedPrefixTransform(prefix_len);
+}
+
+}  // namespace leveldb
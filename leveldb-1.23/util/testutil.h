@@ -74,6 +74,17 @@ class ErrorEnv : public EnvWrapper {
     }
     return target()->NewAppendableFile(fname, result);
   }
+
+  Status ReuseWritableFile(const std::string& fname,
+                           const std::string& old_fname,
+                           WritableFile** result) override {
+    if (writable_file_error_) {
+      ++num_writable_file_errors_;
+      *result = nullptr;
+      return Status::IOError(fname, "fake error");
+    }
+    return target()->ReuseWritableFile(fname, old_fname, result);
+  }
 };
 
 }  // namespace test